@@ -1,58 +1,160 @@
 #include "buttonisrhandler.h"
-#include "systemeventhandler.h"
-#include "freertos/task.h"
+#include "inputring.h"
+#include "tracehandler.h"
 #include <freertos/projdefs.h>
 #include <portmacro.h>
 #include <stdint.h>
 #include <driver/gpio.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+
+// PRESS, DOUBLE_CLICK and CHORD can stem from the same edge
+#define MAX_EVENTS_PER_EDGE 3
+
+typedef struct {
+    ButtonConfig_t config;
+    esp_timer_handle_t debounce_timer; // end of the lockout after an accepted edge
+    esp_timer_handle_t hold_timer; // long press deadline
+    bool pressed; // debounced level
+    bool locked;
+    bool long_fired;
+    bool in_chord;
+    bool has_click; // last press was released before the long press deadline
+    int64_t pressed_at_us;
+    int64_t released_at_us;
+} ButtonState_t;
+
+typedef struct {
+    ButtonEvent_t events[MAX_EVENTS_PER_EDGE];
+    int count;
+} EventBatch_t;
+
+static ButtonState_t buttons[BUTTON_COUNT];
+static TaskHandle_t consumer_task;
+static uint32_t consumer_bits;
+static portMUX_TYPE button_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static ButtonLatencyStats_t latency_stats;
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void IRAM_ATTR add_event(EventBatch_t *batch, const ButtonEventType type, const Button button, const int64_t at_us) {
+    batch->events[batch->count++] = (ButtonEvent_t){.type = type, .button = button, .edge_us = at_us};
+}
+
+// called outside the lock, the notification may yield
+static void IRAM_ATTR emit(const EventBatch_t *batch) {
+    if (batch->count == 0) return;
+
+    for (int i = 0; i < batch->count; i++) {
+        input_ring_push(&batch->events[i]);
+    }
+
+    if (!xPortInIsrContext()) {
+        xTaskNotify(consumer_task, consumer_bits, eSetBits);
+        return;
+    }
+
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    xTaskNotifyFromISR(consumer_task, consumer_bits, eSetBits, &higher_priority_task_woken);
+    if (higher_priority_task_woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+// debounced level change of button, caller holds button_mux
+static void IRAM_ATTR apply_transition(const Button button, const bool pressed, const int64_t now, EventBatch_t *batch) {
+    ButtonState_t *state = &buttons[button];
+    state->pressed = pressed;
 
-#define GPIO_BUTTON_1 GPIO_NUM_5
-#define GPIO_BUTTON_2 GPIO_NUM_18
-
-static QueueHandle_t button_isr_queue = NULL;
-
-static void button_task() {
-    uint32_t io_num; // save the pressed GPIO number
-    static bool btn1_pressed = false;
-    static bool btn2_pressed = false;
-
-    // ReSharper disable once CppDFAEndlessLoop
-    while (1) {
-        if (xQueueReceive(button_isr_queue, &io_num, portMAX_DELAY)) {
-            const bool is_pressed = gpio_get_level(io_num) == 0;
-
-            if (io_num == GPIO_BUTTON_1) {
-                if (is_pressed && !btn1_pressed) {
-                    set_event_bit_isr(EVENT_BIT_BUTTON_1_PRESSED);
-                } else if (!is_pressed) {
-                    btn1_pressed = false;
-                }
-            }
-
-            if (io_num == GPIO_BUTTON_2) {
-                if (is_pressed && !btn2_pressed) {
-                    set_event_bit_isr(EVENT_BIT_BUTTON_2_PRESSED);
-                } else if (!is_pressed) {
-                    btn2_pressed = false;
-                }
-            }
-
-            vTaskDelay(pdMS_TO_TICKS(30)); // wait 50 ms for the debouncing the button press
-
-            // remove all queue entries, which could be added due to the debounced effect
-            uint32_t *dummy;
-            while (xQueueReceive(button_isr_queue, &dummy, 0)) {
-                // do nothing
-            }
+    if (pressed) {
+        state->pressed_at_us = now;
+        state->long_fired = false;
+        esp_timer_start_once(state->hold_timer, state->config.long_press_us);
+        add_event(batch, BUTTON_EVENT_PRESS, button, now);
+
+        if (state->has_click && now - state->released_at_us <= state->config.double_click_us) {
+            add_event(batch, BUTTON_EVENT_DOUBLE_CLICK, button, now);
+        }
+        state->has_click = false;
+
+        ButtonState_t *other = &buttons[button == BUTTON_1 ? BUTTON_2 : BUTTON_1];
+        if (other->pressed && !other->in_chord && now - other->pressed_at_us <= CHORD_WINDOW_US) {
+            other->in_chord = true;
+            state->in_chord = true;
+            add_event(batch, BUTTON_EVENT_CHORD, button, now);
         }
+    } else {
+        esp_timer_stop(state->hold_timer);
+        add_event(batch, BUTTON_EVENT_RELEASE, button, now);
+
+        state->released_at_us = now;
+        state->has_click = state->config.double_click_us > 0 && !state->long_fired && !state->in_chord;
+        state->in_chord = false;
+    }
+}
+
+// The first edge is taken right away and starts the lockout, bounces inside it are dropped.
+// Level triggered interrupts keep working in light sleep, so the opposite level is armed each time.
+static void IRAM_ATTR button_isr_handler(void *arg) {
+    const Button button = (Button) (uintptr_t) arg;
+    ButtonState_t *state = &buttons[button];
+    const int64_t now = esp_timer_get_time();
+    const bool pressed = gpio_get_level(state->config.gpio) == 0;
+    TRACE(TRACE_EVENT_BUTTON_EDGE, button << 1 | pressed);
+
+    gpio_set_intr_type(state->config.gpio, pressed ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+
+    EventBatch_t batch = {0};
+    portENTER_CRITICAL_ISR(&button_mux);
+    if (!state->locked && pressed != state->pressed) {
+        state->locked = true;
+        esp_timer_start_once(state->debounce_timer, state->config.debounce_us);
+        apply_transition(button, pressed, now, &batch);
     }
+    portEXIT_CRITICAL_ISR(&button_mux);
+
+    emit(&batch);
 }
 
-static gpio_config_t create_config() {
+// end of the lockout: catch up with a level which changed while edges were ignored
+static void debounce_timer_callback(void *arg) {
+    const Button button = (Button) (uintptr_t) arg;
+    ButtonState_t *state = &buttons[button];
+    const bool pressed = gpio_get_level(state->config.gpio) == 0;
+
+    EventBatch_t batch = {0};
+    portENTER_CRITICAL(&button_mux);
+    state->locked = false;
+    if (pressed != state->pressed) {
+        state->locked = true;
+        esp_timer_start_once(state->debounce_timer, state->config.debounce_us);
+        apply_transition(button, pressed, esp_timer_get_time(), &batch);
+    }
+    portEXIT_CRITICAL(&button_mux);
+
+    emit(&batch);
+}
+
+static void hold_timer_callback(void *arg) {
+    const Button button = (Button) (uintptr_t) arg;
+    ButtonState_t *state = &buttons[button];
+
+    EventBatch_t batch = {0};
+    portENTER_CRITICAL(&button_mux);
+    if (state->pressed && !state->long_fired) {
+        state->long_fired = true;
+        add_event(&batch, BUTTON_EVENT_LONG_PRESS, button, state->pressed_at_us + state->config.long_press_us);
+    }
+    portEXIT_CRITICAL(&button_mux);
+
+    emit(&batch);
+}
+
+static gpio_config_t create_config(const ButtonConfig_t configs[BUTTON_COUNT]) {
     const gpio_config_t config = {
-        .intr_type = GPIO_INTR_NEGEDGE,
+        .intr_type = GPIO_INTR_LOW_LEVEL, // level triggers are the only ones that wake from light sleep
         .mode = GPIO_MODE_INPUT,
-        .pin_bit_mask = (1ULL << GPIO_BUTTON_1) | (1ULL << GPIO_BUTTON_2),
+        .pin_bit_mask = (1ULL << configs[BUTTON_1].gpio) | (1ULL << configs[BUTTON_2].gpio),
         .pull_down_en = GPIO_PULLDOWN_DISABLE,
         .pull_up_en = GPIO_PULLUP_ENABLE,
     };
@@ -60,28 +162,58 @@ static gpio_config_t create_config() {
     return config;
 }
 
-static void IRAM_ATTR button_isr_handler(void *arg) {
-    const uint32_t gpio_num = (uint32_t) arg;
-    xQueueSendFromISR(button_isr_queue, &gpio_num, NULL);
-}
+void init_button_isr_handler(const ButtonConfig_t configs[BUTTON_COUNT], TaskHandle_t consumer, const uint32_t notify_bits) {
+    consumer_task = consumer;
+    consumer_bits = notify_bits;
+    input_ring_init();
 
-void create_button_isr_handler() {
-    if (button_isr_queue != NULL) {
-        vQueueDelete(button_isr_queue);
-        button_isr_queue = NULL;
+    const gpio_config_t button_config = create_config(configs);
+    gpio_config(&button_config);
+
+    gpio_install_isr_service(0);
+
+    for (int i = 0; i < BUTTON_COUNT; i++) {
+        ButtonState_t *state = &buttons[i];
+        state->config = configs[i];
+
+        const esp_timer_create_args_t debounce_args = {
+            .callback = debounce_timer_callback,
+            .arg = (void *) (uintptr_t) i,
+            .name = "button_debounce",
+        };
+        const esp_timer_create_args_t hold_args = {
+            .callback = hold_timer_callback,
+            .arg = (void *) (uintptr_t) i,
+            .name = "button_hold",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&debounce_args, &state->debounce_timer));
+        ESP_ERROR_CHECK(esp_timer_create(&hold_args, &state->hold_timer));
+
+        gpio_isr_handler_add(state->config.gpio, button_isr_handler, (void *) (uintptr_t) i);
+
+        // wake the CPU from automatic light sleep on a press
+        gpio_wakeup_enable(state->config.gpio, GPIO_INTR_LOW_LEVEL);
     }
 
-    const gpio_config_t button_config = create_config();
-    gpio_config(&button_config);
+    esp_sleep_enable_gpio_wakeup();
+}
+
+bool button_read_event(ButtonEvent_t *event) {
+    return input_ring_pop(event);
+}
 
-    button_isr_queue = xQueueCreate(10, sizeof(uint32_t));
+void button_record_latency(const ButtonEvent_t *event) {
+    const uint32_t latency = (uint32_t) (esp_timer_get_time() - event->edge_us);
 
-    gpio_install_isr_service(0);
-    gpio_isr_handler_add(GPIO_BUTTON_1, button_isr_handler, (void *) GPIO_BUTTON_1);
-    gpio_isr_handler_add(GPIO_BUTTON_2, button_isr_handler, (void *) GPIO_BUTTON_2);
+    taskENTER_CRITICAL(&stats_mux);
+    latency_stats.count++;
+    latency_stats.total_us += latency;
+    if (latency > latency_stats.max_us) latency_stats.max_us = latency;
+    taskEXIT_CRITICAL(&stats_mux);
 }
 
-void init_button_isr_handler(const int priority) {
-    create_button_isr_handler();
-    xTaskCreate(button_task, "button_task", 2048, NULL, priority, NULL);
+void get_button_latency_stats(ButtonLatencyStats_t *stats) {
+    taskENTER_CRITICAL(&stats_mux);
+    *stats = latency_stats;
+    taskEXIT_CRITICAL(&stats_mux);
 }
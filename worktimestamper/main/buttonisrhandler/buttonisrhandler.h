@@ -2,9 +2,66 @@
 #define BUTTONISRHANDLER_H
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <driver/gpio.h>
+#include <stdbool.h>
+#include <stdint.h>
 
-typedef void (*button_callback_t)(void);
+#define GPIO_BUTTON_1 GPIO_NUM_5
+#define GPIO_BUTTON_2 GPIO_NUM_18
 
-void init_button_isr_handler(int priority);
+// both buttons pressed within this window form a chord
+#define CHORD_WINDOW_US 80000
 
-#endif
\ No newline at end of file
+typedef enum {
+    BUTTON_1,
+    BUTTON_2,
+    BUTTON_COUNT,
+} Button;
+
+typedef struct {
+    gpio_num_t gpio;
+    uint32_t debounce_us; // edges after an accepted one are ignored this long
+    uint32_t long_press_us;
+    uint32_t double_click_us; // max gap between release and the next press, 0 disables double clicks
+} ButtonConfig_t;
+
+#define BUTTON_CONFIG_DEFAULT(pin) { \
+    .gpio = (pin), \
+    .debounce_us = 30000, \
+    .long_press_us = 800000, \
+    .double_click_us = 300000, \
+}
+
+typedef enum {
+    BUTTON_EVENT_PRESS, // sent straight from the interrupt of the first edge
+    BUTTON_EVENT_RELEASE,
+    BUTTON_EVENT_LONG_PRESS,
+    BUTTON_EVENT_DOUBLE_CLICK, // follows the PRESS of the second click
+    BUTTON_EVENT_CHORD, // follows the PRESS of the second button
+} ButtonEventType;
+
+typedef struct {
+    ButtonEventType type;
+    Button button;
+    int64_t edge_us; // esp_timer time of the edge (or deadline) the event stems from
+} ButtonEvent_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+} ButtonLatencyStats_t;
+
+// Events go into a lock-free ring, consumer gets notify_bits (eSetBits) whenever one was added
+void init_button_isr_handler(const ButtonConfig_t configs[BUTTON_COUNT], TaskHandle_t consumer, uint32_t notify_bits);
+
+// Oldest pending event, only called by the consumer task. Every press is kept, none is merged.
+bool button_read_event(ButtonEvent_t *event);
+
+// The consumer handled event, adds its edge-to-handled time to the latency stats
+void button_record_latency(const ButtonEvent_t *event);
+
+void get_button_latency_stats(ButtonLatencyStats_t *stats);
+
+#endif
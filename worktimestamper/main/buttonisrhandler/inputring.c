@@ -0,0 +1,80 @@
+#include "inputring.h"
+
+#include <esp_attr.h>
+#include <assert.h>
+#include <stdatomic.h>
+
+#define RING_MASK (INPUT_RING_SIZE - 1)
+
+static_assert((INPUT_RING_SIZE & RING_MASK) == 0, "INPUT_RING_SIZE must be a power of two");
+
+// a slot is free for position p while sequence == p and readable while sequence == p + 1
+typedef struct {
+    atomic_uint sequence;
+    ButtonEvent_t event;
+} InputSlot_t;
+
+static InputSlot_t slots[INPUT_RING_SIZE];
+static atomic_uint head; // next position a producer claims
+static unsigned tail; // next position the consumer reads
+static atomic_uint dropped;
+
+void input_ring_init(void) {
+    for (unsigned i = 0; i < INPUT_RING_SIZE; i++) {
+        atomic_init(&slots[i].sequence, i);
+    }
+    atomic_init(&head, 0);
+    atomic_init(&dropped, 0);
+    tail = 0;
+}
+
+bool IRAM_ATTR input_ring_push(const ButtonEvent_t *event) {
+    unsigned pos = atomic_load_explicit(&head, memory_order_relaxed);
+    InputSlot_t *slot;
+
+    // claim a position, an interrupt between load and exchange just makes the exchange fail once
+    for (;;) {
+        slot = &slots[pos & RING_MASK];
+        const unsigned sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        const int diff = (int) (sequence - pos);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            return false;
+        } else {
+            pos = atomic_load_explicit(&head, memory_order_relaxed);
+        }
+    }
+
+    slot->event = *event;
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+bool input_ring_pop(ButtonEvent_t *event) {
+    InputSlot_t *slot = &slots[tail & RING_MASK];
+    const unsigned sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+
+    // not published yet, its producer notifies again once it is
+    if (sequence != tail + 1) return false;
+
+    *event = slot->event;
+    atomic_store_explicit(&slot->sequence, tail + INPUT_RING_SIZE, memory_order_release);
+    tail++;
+    return true;
+}
+
+uint32_t input_ring_dropped(void) {
+    return atomic_load_explicit(&dropped, memory_order_relaxed);
+}
+
+uint32_t input_ring_depth(void) {
+    // claimed slots count before they are published, a racing pop may make tail pass the loaded head
+    const unsigned depth = atomic_load_explicit(&head, memory_order_relaxed) - tail;
+    return depth > INPUT_RING_SIZE ? 0 : depth;
+}
@@ -0,0 +1,25 @@
+#ifndef INPUTRING_H
+#define INPUTRING_H
+
+#include "buttonisrhandler.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define INPUT_RING_SIZE 32 // power of two
+
+// Bounded multi-producer single-consumer ring of button events. Producers (GPIO interrupt,
+// esp_timer task) never block and never take a lock, a full ring drops and counts the event.
+void input_ring_init(void);
+
+// any context, including interrupts
+bool input_ring_push(const ButtonEvent_t *event);
+
+// single consumer only
+bool input_ring_pop(ButtonEvent_t *event);
+
+uint32_t input_ring_dropped(void);
+
+// events waiting for the consumer, a snapshot from any task
+uint32_t input_ring_depth(void);
+
+#endif
@@ -0,0 +1,186 @@
+#include "consolehandler.h"
+#include "inputring.h"
+#include "oledbus.h"
+#include "oledhandler.h"
+#include "powerhandler.h"
+#include "tracehandler.h"
+#include "wifisynchandler.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <driver/uart.h>
+#include <esp_console.h>
+#include <esp_heap_caps.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <stdio.h>
+
+#define CONSOLE_PROMPT "wts> "
+#define CONSOLE_STACK 4096
+#define CONSOLE_HISTORY 8
+// RX edges needed to wake from light sleep
+#define CONSOLE_WAKE_EDGES 3
+
+// tasks of app_main and the init_* functions, then the IDF ones sharing the CPU with them,
+// xTaskGetHandle only finds names within configMAX_TASK_NAME_LEN (15 characters)
+static const char *task_names[] = {
+    "tracker_loop", "display_task", "oled_bus_task", "wifi_sync_task", "export_task", "trace_dump",
+    "console_repl", "esp_timer", "IDLE0", "IDLE1",
+};
+
+#define TASK_COUNT (sizeof(task_names) / sizeof(task_names[0]))
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+// run time counters (us) at the previous tasks command, the CPU share is taken over the time in between
+static uint32_t last_run_time[TASK_COUNT];
+static int64_t last_sample_us;
+#endif
+
+static int tasks_command(int argc, char **argv) {
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    const int64_t now = esp_timer_get_time();
+    const int64_t window_us = now - last_sample_us;
+    last_sample_us = now;
+    printf("%-16s %4s %10s %6s  (cpu over the last %lld ms)\n", "task", "prio", "stack free", "cpu",
+           (long long) (window_us / 1000));
+#else
+    printf("%-16s %4s %10s\n", "task", "prio", "stack free");
+#endif
+
+    for (size_t i = 0; i < TASK_COUNT; i++) {
+        TaskHandle_t task = xTaskGetHandle(task_names[i]);
+        if (task == NULL) continue;
+
+        const unsigned priority = (unsigned) uxTaskPriorityGet(task);
+        const unsigned stack_free = (unsigned) uxTaskGetStackHighWaterMark(task);
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        const uint32_t run_time = (uint32_t) ulTaskGetRunTimeCounter(task);
+        const uint32_t permille = window_us > 0 ? (uint32_t) ((run_time - last_run_time[i]) * 1000ULL / window_us) : 0;
+        last_run_time[i] = run_time;
+        printf("%-16s %4u %10u %4lu.%lu%%\n", task_names[i], priority, stack_free,
+               (unsigned long) (permille / 10), (unsigned long) (permille % 10));
+#else
+        printf("%-16s %4u %10u\n", task_names[i], priority, stack_free);
+#endif
+    }
+    return 0;
+}
+
+static int queues_command(int argc, char **argv) {
+    OledBusStats_t bus;
+    get_oled_bus_stats(&bus);
+
+    printf("oled bus    %2u/%u queued, max %u\n", bus.queued, OLED_BUS_QUEUE_LEN, bus.max_queued);
+    printf("input ring  %2lu/%u queued, %lu dropped\n", (unsigned long) input_ring_depth(), INPUT_RING_SIZE,
+           (unsigned long) input_ring_dropped());
+    return 0;
+}
+
+static int display_command(int argc, char **argv) {
+    DisplayUpdateStats_t updates;
+    DisplayDeltaStats_t delta;
+    OledBusStats_t bus;
+    get_display_update_stats(&updates);
+    get_display_delta_stats(&delta);
+    get_oled_bus_stats(&bus);
+
+    printf("row writes  %lu, %lu coalesced into %lu redraws, max %u rows pending\n",
+           (unsigned long) updates.writes, (unsigned long) updates.coalesced, (unsigned long) updates.redraws,
+           updates.max_pending_rows);
+    printf("flushes     %lu, %lu cells, %lu bytes queued, %lu full-queue retries\n", (unsigned long) delta.flushes,
+           (unsigned long) delta.cells_changed, (unsigned long) delta.bytes_on_bus, (unsigned long) delta.retries);
+    printf("dropped     %lu submissions rejected by the full bus queue\n", (unsigned long) bus.rejected);
+    return 0;
+}
+
+static int bus_command(int argc, char **argv) {
+    OledBusStats_t bus;
+    get_oled_bus_stats(&bus);
+
+    printf("transactions %lu for %lu batches, %lu ops merged, %lu bytes\n", (unsigned long) bus.transactions,
+           (unsigned long) bus.batches, (unsigned long) bus.merged_ops, (unsigned long) bus.bytes);
+    printf("retries      %lu, errors %lu, last %s\n", (unsigned long) bus.retries, (unsigned long) bus.errors,
+           bus.errors > 0 ? esp_err_to_name(bus.last_error) : "none");
+    return 0;
+}
+
+static void print_heap(const char *name, const uint32_t caps) {
+    const size_t free_bytes = heap_caps_get_free_size(caps);
+    const size_t largest = heap_caps_get_largest_free_block(caps);
+    // share of the free memory a single allocation can not get
+    const unsigned fragmentation = free_bytes > 0 ? (unsigned) (100 - largest * 100 / free_bytes) : 0;
+
+    printf("%-9s free %7u, minimum %7u, largest block %7u, fragmentation %3u%%\n", name, (unsigned) free_bytes,
+           (unsigned) heap_caps_get_minimum_free_size(caps), (unsigned) largest, fragmentation);
+}
+
+static int power_command(int argc, char **argv) {
+    power_log_report();
+    return 0;
+}
+
+static int heap_command(int argc, char **argv) {
+    print_heap("8-bit", MALLOC_CAP_8BIT);
+    print_heap("internal", MALLOC_CAP_INTERNAL);
+    return 0;
+}
+
+static int wifi_command(int argc, char **argv) {
+    WifiSyncTimings_t timings;
+    get_wifi_sync_timings(&timings);
+
+    printf("runs       %lu, radio on %lu ms in total, %lu ppm of the uptime\n", (unsigned long) timings.runs,
+           (unsigned long) timings.radio_on_total_ms, (unsigned long) timings.radio_duty_ppm);
+    printf("last run   %s, assoc %lu ms, ip %lu ms, sntp %lu ms, radio on %lu ms\n",
+           timings.fast_path ? "cached AP and lease" : "scan and DHCP", (unsigned long) timings.assoc_ms,
+           (unsigned long) timings.ip_ms, (unsigned long) timings.sntp_ms, (unsigned long) timings.radio_on_ms);
+    printf("ntp        %s, %u answers, rtt %lu ms, latency %lu ms\n",
+           timings.ntp_server ? timings.ntp_server : "-", timings.ntp_answers, (unsigned long) timings.ntp_rtt_ms,
+           (unsigned long) timings.ntp_latency_ms);
+    return 0;
+}
+
+#if HOT_PATH_TRACE
+static int trace_command(int argc, char **argv) {
+    trace_dump();
+    return 0;
+}
+#endif
+
+static void register_command(const char *command, const char *help, const esp_console_cmd_func_t func) {
+    const esp_console_cmd_t cmd = {
+        .command = command,
+        .help = help,
+        .func = func,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+}
+
+void init_console_handler(const int priority) {
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    repl_config.prompt = CONSOLE_PROMPT;
+    repl_config.task_priority = priority;
+    repl_config.task_stack_size = CONSOLE_STACK;
+    repl_config.max_history_len = CONSOLE_HISTORY;
+
+    const esp_console_dev_uart_config_t uart_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_console_new_repl_uart(&uart_config, &repl_config, &repl));
+
+    esp_console_register_help_command();
+    register_command("tasks", "stack high-water mark and CPU share of the firmware tasks", tasks_command);
+    register_command("queues", "depth of the oled bus queue and the button input ring", queues_command);
+    register_command("display", "coalesced and dropped display updates, flush retries", display_command);
+    register_command("bus", "panel bus transactions and errors", bus_command);
+    register_command("power", "time per display power state and, with PM profiling, per CPU mode", power_command);
+    register_command("heap", "free heap and fragmentation", heap_command);
+    register_command("wifi", "phase timings of the last sync run", wifi_command);
+#if HOT_PATH_TRACE
+    register_command("trace", "dump new trace events and the latency histograms", trace_command);
+#endif
+
+    uart_set_wakeup_threshold(uart_config.channel, CONSOLE_WAKE_EDGES);
+    esp_sleep_enable_uart_wakeup(uart_config.channel);
+
+    ESP_ERROR_CHECK(esp_console_start_repl(repl));
+}
@@ -0,0 +1,20 @@
+#ifndef CONSOLEHANDLER_H
+#define CONSOLEHANDLER_H
+
+// Diagnostics shell on the console UART (UART0, 115200 8N1), type help for the commands.
+// Every command prints straight from the counters, nothing is buffered per task or per entry.
+//
+//   tasks    stack high-water mark and, with CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS, CPU share
+//            since the previous call of every firmware task
+//   queues   depth of the oled bus queue and the button input ring
+//   display  coalesced and dropped display updates, flush retries
+//   bus      transactions, errors and the last error of the panel bus
+//   heap     free, minimum free and largest block, fragmentation
+//   wifi     phase timings of the last sync run
+//   trace    hot path trace dump, only in HOT_PATH_TRACE builds
+//
+// The UART wakes the CPU from light sleep on RX edges, the first characters typed are lost.
+
+void init_console_handler(int priority);
+
+#endif
@@ -0,0 +1,189 @@
+#include "exporthandler.h"
+#include "stampframe.h"
+#include "timetracker_journal.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <driver/gpio.h>
+#include <driver/uart.h>
+#include <esp_log.h>
+#include <esp_pm.h>
+#include <esp_rom_crc.h>
+#include <esp_sleep.h>
+
+#define EXPORT_UART UART_NUM_1
+#define EXPORT_TX_IO GPIO_NUM_17
+#define EXPORT_RX_IO GPIO_NUM_16
+#define EXPORT_BAUD 921600
+#define EXPORT_RX_BUFFER 256
+#define EXPORT_TX_BUFFER 1024
+// RX edges needed to wake from light sleep, the wake bytes of the host provide them
+#define EXPORT_WAKE_EDGES 3
+#define EXPORT_MAX_QUERY_PAYLOAD 16
+
+typedef enum {
+    PARSE_SYNC_0,
+    PARSE_SYNC_1,
+    PARSE_HEADER,
+    PARSE_PAYLOAD,
+} ParseState;
+
+typedef struct {
+    ParseState state;
+    uint16_t expected; // bytes still missing in PARSE_HEADER / PARSE_PAYLOAD
+    uint16_t used;
+    uint8_t buffer[EXPORT_HEADER_SIZE - 2 + EXPORT_MAX_QUERY_PAYLOAD + EXPORT_CRC_SIZE];
+} FrameParser_t;
+
+static const char *TAG = "EXPORT";
+
+// only touched by the export task, a frame is built and sent before the next chunk is read
+static esp_pm_lock_handle_t stream_lock;
+static JournalEntry_t entries[EXPORT_RECORDS_PER_FRAME];
+static uint8_t frame[EXPORT_HEADER_SIZE + EXPORT_RECORDS_PER_FRAME * EXPORT_RECORD_SIZE + EXPORT_CRC_SIZE];
+
+static uint8_t *put_u32(uint8_t *dst, const uint32_t value) {
+    dst[0] = (uint8_t) value;
+    dst[1] = (uint8_t) (value >> 8);
+    dst[2] = (uint8_t) (value >> 16);
+    dst[3] = (uint8_t) (value >> 24);
+    return dst + 4;
+}
+
+static uint32_t get_u32(const uint8_t *src) {
+    return src[0] | (uint32_t) src[1] << 8 | (uint32_t) src[2] << 16 | (uint32_t) src[3] << 24;
+}
+
+// frame holds the payload behind the header already
+static void send_frame(const uint8_t type, const uint16_t length) {
+    frame[0] = EXPORT_SYNC_0;
+    frame[1] = EXPORT_SYNC_1;
+    frame[2] = type;
+    frame[3] = (uint8_t) length;
+    frame[4] = (uint8_t) (length >> 8);
+
+    const uint32_t crc = esp_rom_crc32_le(0, frame + 2, EXPORT_HEADER_SIZE - 2 + length);
+    put_u32(frame + EXPORT_HEADER_SIZE + length, crc);
+    uart_write_bytes(EXPORT_UART, frame, EXPORT_HEADER_SIZE + length + EXPORT_CRC_SIZE);
+}
+
+static void put_record(uint8_t *dst, const JournalEntry_t *entry) {
+    dst = put_u32(dst, entry->sequence);
+
+    if (entry->type == JOURNAL_ENTRY_CORRECTION) {
+        *dst++ = STAMP_FRAME_CORRECTION;
+        dst = put_u32(dst, (uint32_t) entry->correction.offset);
+        put_u32(dst, entry->correction.first_sequence);
+        return;
+    }
+
+    const uint8_t kind = entry->type == JOURNAL_ENTRY_START ? STAMP_FRAME_START : STAMP_FRAME_END;
+    *dst++ = kind | (entry->synced ? 0 : STAMP_FRAME_UNSYNCED);
+    dst = put_u32(dst, (uint32_t) entry->timestamp);
+    put_u32(dst, 0);
+}
+
+// reads the journal one frame worth at a time, nothing more than that is held in RAM
+static void stream_since(const uint32_t since) {
+    esp_pm_lock_acquire(stream_lock);
+
+    uint32_t last_sequence = since;
+    uint32_t total = 0;
+    int count;
+
+    while ((count = journal_read_since(last_sequence, entries, EXPORT_RECORDS_PER_FRAME)) > 0) {
+        for (int i = 0; i < count; i++) {
+            put_record(frame + EXPORT_HEADER_SIZE + i * EXPORT_RECORD_SIZE, &entries[i]);
+        }
+        send_frame(EXPORT_FRAME_RECORDS, (uint16_t) (count * EXPORT_RECORD_SIZE));
+
+        last_sequence = entries[count - 1].sequence;
+        total += (uint32_t) count;
+    }
+
+    uint8_t *payload = frame + EXPORT_HEADER_SIZE;
+    put_u32(put_u32(payload, last_sequence), total);
+    send_frame(EXPORT_FRAME_END, 8);
+    uart_wait_tx_done(EXPORT_UART, portMAX_DELAY);
+
+    esp_pm_lock_release(stream_lock);
+    ESP_LOGI(TAG, "streamed %lu records since %lu", (unsigned long) total, (unsigned long) since);
+}
+
+static void handle_frame(const uint8_t type, const uint8_t *payload, const uint16_t length) {
+    if (type == EXPORT_FRAME_QUERY && length == 4) {
+        stream_since(get_u32(payload));
+    } else {
+        ESP_LOGW(TAG, "unknown frame %02x length %u", type, length);
+    }
+}
+
+// resynchronizes on the next sync bytes after any damaged or foreign frame
+static void parse_byte(FrameParser_t *parser, const uint8_t byte) {
+    switch (parser->state) {
+        case PARSE_SYNC_0:
+            if (byte == EXPORT_SYNC_0) parser->state = PARSE_SYNC_1;
+            return;
+        case PARSE_SYNC_1:
+            parser->state = byte == EXPORT_SYNC_1 ? PARSE_HEADER : byte == EXPORT_SYNC_0 ? PARSE_SYNC_1 : PARSE_SYNC_0;
+            parser->used = 0;
+            parser->expected = EXPORT_HEADER_SIZE - 2;
+            return;
+        case PARSE_HEADER:
+        case PARSE_PAYLOAD:
+            parser->buffer[parser->used++] = byte;
+            if (--parser->expected > 0) return;
+            break;
+    }
+
+    if (parser->state == PARSE_HEADER) {
+        const uint16_t length = parser->buffer[1] | (uint16_t) parser->buffer[2] << 8;
+        parser->state = length <= EXPORT_MAX_QUERY_PAYLOAD ? PARSE_PAYLOAD : PARSE_SYNC_0;
+        parser->expected = length + EXPORT_CRC_SIZE;
+        return;
+    }
+
+    parser->state = PARSE_SYNC_0;
+    const uint16_t length = parser->used - (EXPORT_HEADER_SIZE - 2) - EXPORT_CRC_SIZE;
+    const uint32_t crc = esp_rom_crc32_le(0, parser->buffer, parser->used - EXPORT_CRC_SIZE);
+    if (crc != get_u32(parser->buffer + parser->used - EXPORT_CRC_SIZE)) {
+        ESP_LOGW(TAG, "crc mismatch");
+        return;
+    }
+
+    handle_frame(parser->buffer[0], parser->buffer + EXPORT_HEADER_SIZE - 2, length);
+}
+
+static void export_task(void *arg) {
+    FrameParser_t parser = {.state = PARSE_SYNC_0};
+    uint8_t received[64];
+
+    // ReSharper disable once CppDFAEndlessLoop
+    while (1) {
+        const int count = uart_read_bytes(EXPORT_UART, received, sizeof(received), portMAX_DELAY);
+        for (int i = 0; i < count; i++) {
+            parse_byte(&parser, received[i]);
+        }
+    }
+}
+
+void init_export_handler(const int priority) {
+    const uart_config_t config = {
+        .baud_rate = EXPORT_BAUD,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_APB,
+    };
+    ESP_ERROR_CHECK(uart_driver_install(EXPORT_UART, EXPORT_RX_BUFFER, EXPORT_TX_BUFFER, 0, NULL, 0));
+    ESP_ERROR_CHECK(uart_param_config(EXPORT_UART, &config));
+    ESP_ERROR_CHECK(uart_set_pin(EXPORT_UART, EXPORT_TX_IO, EXPORT_RX_IO, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+
+    // the baud rate must hold while a stream runs, light sleep would stop the APB clock
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "uart_export", &stream_lock));
+    uart_set_wakeup_threshold(EXPORT_UART, EXPORT_WAKE_EDGES);
+    esp_sleep_enable_uart_wakeup(EXPORT_UART);
+
+    xTaskCreate(export_task, "export_task", 3072, NULL, priority, NULL);
+}
@@ -0,0 +1,35 @@
+#ifndef EXPORTHANDLER_H
+#define EXPORTHANDLER_H
+
+// Serves the stamp journal over UART1 (TX GPIO 17, RX GPIO 16, 921600 8N1).
+//
+// Every frame, both directions, little endian:
+//   [0xA5][0x5A][type:1][length:2][payload:length][crc32:4]   crc over type, length and payload
+//
+// EXPORT_FRAME_QUERY   host -> device  [since:4]  stream every record with a higher sequence
+// EXPORT_FRAME_RECORDS device -> host  up to EXPORT_RECORDS_PER_FRAME records of EXPORT_RECORD_SIZE:
+//                                      [sequence:4][kind:1][value:4][aux:4]
+//                                      stamps:      value = unix time, aux = 0
+//                                      corrections: value = offset in seconds, aux = first sequence
+//                                      kind as in stampframe.h (start, end, correction, unsynced flag)
+// EXPORT_FRAME_END     device -> host  [last sequence:4][records:4]  last sequence is the next since
+//
+// The UART wakes the CPU from light sleep on RX edges, the bytes doing so are lost: the host sends
+// a few EXPORT_WAKE_BYTE first and waits EXPORT_WAKE_MS before the query.
+// tools/export_decoder.py is the host side.
+
+#define EXPORT_SYNC_0 0xA5
+#define EXPORT_SYNC_1 0x5A
+#define EXPORT_HEADER_SIZE 5
+#define EXPORT_CRC_SIZE 4
+#define EXPORT_FRAME_QUERY 0x01
+#define EXPORT_FRAME_RECORDS 0x81
+#define EXPORT_FRAME_END 0x82
+#define EXPORT_RECORD_SIZE 13
+#define EXPORT_RECORDS_PER_FRAME 32
+#define EXPORT_WAKE_BYTE 0x00
+#define EXPORT_WAKE_MS 20
+
+void init_export_handler(int priority);
+
+#endif
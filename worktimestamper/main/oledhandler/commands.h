@@ -4,9 +4,15 @@
 
 #define SSD1306_ADDR 0x3C
 
-// control byte - needed before setting a command
+// I2C control byte - all following bytes are commands
 #define COMMAND_CONTROL_BYTE 0x00
 
+// I2C control byte - exactly one command byte follows, then another control byte
+#define SINGLE_COMMAND_CONTROL_BYTE 0x80
+
+// I2C control byte - all following bytes are GDDRAM data
+#define DATA_CONTROL_BYTE 0x40
+
 // 0xAE: Display OFF
 #define DISPLAY_OFF_COMMAND 0xAE
 
@@ -64,23 +70,33 @@
 // 0xAF: Display ON
 #define DISPLAY_ON_COMMAND 0xAF
 
+// 0x21: Set Column Address - start, end
+#define SET_COLUMN_ADDRESS_COMMAND 0x21
+
+// 0x22: Set Page Address - start, end
+#define SET_PAGE_ADDRESS_COMMAND 0x22
+
+// 0xE3: No Operation - used to probe the bus
+#define NOP_COMMAND 0xE3
+
+// plain command bytes, the transport adds its own framing (I2C control bytes, SPI D/C line)
 static const uint8_t init_sequence[] = {
-    COMMAND_CONTROL_BYTE, DISPLAY_OFF_COMMAND,
-    COMMAND_CONTROL_BYTE, DISPLAY_CLOCK_DIVIDE_RATIO_COMMAND, DISPLAY_CLOCK_DIVIDE_RATIO_ARG_DEFAULT,
-    COMMAND_CONTROL_BYTE, SET_MULTIPLEX_RATIO_COMMAND, MULTIPLEX_RATIO_128X64,
-    COMMAND_CONTROL_BYTE, SET_DISPLAY_OFFSET_COMMAND, DISPLAY_OFFSET_NONE,
-    COMMAND_CONTROL_BYTE, SET_START_LINE_COMMAND,
-    COMMAND_CONTROL_BYTE, CHARGE_PUMP_SETTING_COMMAND, CHARGE_PUMP_ENABLE,
-    COMMAND_CONTROL_BYTE, MEMORY_ADDR_MODE_COMMAND, MEMORY_ADDR_MODE_HORIZONTAL,
-    COMMAND_CONTROL_BYTE, SEGMENT_REMAP_COMMAND,
-    COMMAND_CONTROL_BYTE, COM_OUTPUT_SCAN_DIR_COMMAND,
-    COMMAND_CONTROL_BYTE, COM_PINS_CONFIG_COMMAND, COM_PINS_CONFIG_128X64,
-    COMMAND_CONTROL_BYTE, SET_CONTRAST_COMMAND, DEFAULT_CONTRAST,
-    COMMAND_CONTROL_BYTE, SET_PRECHARGE_PERIOD_COMMAND, DEFAULT_PRECHARGE_PERIOD,
-    COMMAND_CONTROL_BYTE, SET_VCOMH_DESELECT_LEVEL_COMMAND, DEFAULT_VCOMH_LEVEL,
-    COMMAND_CONTROL_BYTE, ENTIRE_DISPLAY_ON_RESUME_COMMAND,
-    COMMAND_CONTROL_BYTE, NORMAL_DISPLAY_COMMAND,
-    COMMAND_CONTROL_BYTE, DISPLAY_ON_COMMAND,
+    DISPLAY_OFF_COMMAND,
+    DISPLAY_CLOCK_DIVIDE_RATIO_COMMAND, DISPLAY_CLOCK_DIVIDE_RATIO_ARG_DEFAULT,
+    SET_MULTIPLEX_RATIO_COMMAND, MULTIPLEX_RATIO_128X64,
+    SET_DISPLAY_OFFSET_COMMAND, DISPLAY_OFFSET_NONE,
+    SET_START_LINE_COMMAND,
+    CHARGE_PUMP_SETTING_COMMAND, CHARGE_PUMP_ENABLE,
+    MEMORY_ADDR_MODE_COMMAND, MEMORY_ADDR_MODE_HORIZONTAL,
+    SEGMENT_REMAP_COMMAND,
+    COM_OUTPUT_SCAN_DIR_COMMAND,
+    COM_PINS_CONFIG_COMMAND, COM_PINS_CONFIG_128X64,
+    SET_CONTRAST_COMMAND, DEFAULT_CONTRAST,
+    SET_PRECHARGE_PERIOD_COMMAND, DEFAULT_PRECHARGE_PERIOD,
+    SET_VCOMH_DESELECT_LEVEL_COMMAND, DEFAULT_VCOMH_LEVEL,
+    ENTIRE_DISPLAY_ON_RESUME_COMMAND,
+    NORMAL_DISPLAY_COMMAND,
+    DISPLAY_ON_COMMAND,
 };
 
 #endif //COMMANDS_H
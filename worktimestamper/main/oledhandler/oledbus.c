@@ -0,0 +1,343 @@
+#include "oledbus.h"
+#include "commands.h"
+#include "tracehandler.h"
+
+#include "esp_log.h"
+#include <string.h>
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#define SUBMIT_TIMEOUT_MS 100
+#define MAX_COMPLETIONS 8
+
+// column + page address commands
+#define WINDOW_SIZE 6
+#define FRAME_SIZE (OLED_WIDTH * OLED_PAGES)
+
+static const char *TAG = "OLED_BUS";
+
+static QueueHandle_t bus_queue;
+static SemaphoreHandle_t submit_mutex; // keeps the ops of one batch contiguous in the queue
+static const OledTransport_t *transport;
+static bool transport_ready; // false if init failed, ops then never reach the transport
+
+// one transaction in flight: optional window, then a single data section
+static uint8_t tx_window[WINDOW_SIZE];
+static bool tx_has_window;
+static uint8_t tx_data[FRAME_SIZE];
+static size_t tx_data_len;
+
+typedef struct {
+    TaskHandle_t notify;
+    esp_err_t result; // error of earlier transactions of the batch
+} Completion_t;
+
+// batches which ended inside the open transaction, notified once it is on the wire
+static Completion_t completions[MAX_COMPLETIONS];
+static int completion_count;
+static esp_err_t batch_result = ESP_OK; // error of the batch still being received
+static bool open_batch_in_tx;
+
+// op which did not fit into the last transaction
+static OledBusOp_t carry;
+static bool has_carry;
+
+static OledBusStats_t bus_stats;
+static uint32_t failed_in_row; // only touched by the bus task
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+OledBusOp_t oled_bus_cursor(const uint8_t column_start, const uint8_t column_end,
+                            const uint8_t page_start, const uint8_t page_end) {
+    const OledBusOp_t op = {
+        .type = OLED_BUS_OP_CURSOR,
+        .column_start = column_start,
+        .column_end = column_end,
+        .page_start = page_start,
+        .page_end = page_end,
+    };
+    return op;
+}
+
+static void set_window(const OledBusOp_t *op) {
+    const uint8_t window[WINDOW_SIZE] = {
+        SET_COLUMN_ADDRESS_COMMAND, op->column_start, op->column_end,
+        SET_PAGE_ADDRESS_COMMAND, op->page_start, op->page_end,
+    };
+    memcpy(tx_window, window, sizeof(window));
+    tx_has_window = true;
+}
+
+static bool append_data(const uint8_t *data, const size_t length) {
+    if (tx_data_len + length > FRAME_SIZE) return false;
+
+    if (data) {
+        memcpy(tx_data + tx_data_len, data, length);
+    } else {
+        memset(tx_data + tx_data_len, 0, length);
+    }
+    tx_data_len += length;
+    return true;
+}
+
+// returns false if the op has to start a new transaction
+static bool merge_op(const OledBusOp_t *op) {
+    switch (op->type) {
+        case OLED_BUS_OP_CURSOR:
+            if (tx_data_len > 0) return false;
+            set_window(op); // a later window replaces one nothing was written to yet
+            return true;
+        case OLED_BUS_OP_DATA:
+            return append_data(op->data, op->length);
+        case OLED_BUS_OP_CLEAR: {
+            if (tx_data_len > 0) return false;
+            const OledBusOp_t full = oled_bus_cursor(0, OLED_WIDTH - 1, 0, OLED_PAGES - 1);
+            set_window(&full);
+            return append_data(NULL, FRAME_SIZE);
+        }
+        default:
+            return false;
+    }
+}
+
+// only the first failure of a run is logged, a missing panel would flood the console otherwise
+static void count_transaction(const size_t bytes, const esp_err_t result) {
+    taskENTER_CRITICAL(&stats_mux);
+    bus_stats.transactions++;
+    bus_stats.bytes += bytes;
+    if (result != ESP_OK) {
+        bus_stats.errors++;
+        bus_stats.last_error = result;
+    }
+    taskEXIT_CRITICAL(&stats_mux);
+
+    if (result != ESP_OK && failed_in_row++ == 0) {
+        ESP_LOGW(TAG, "transaction failed: %s", esp_err_to_name(result));
+    } else if (result == ESP_OK && failed_in_row > 0) {
+        ESP_LOGI(TAG, "recovered after %lu failed transactions", (unsigned long) failed_in_row);
+        failed_in_row = 0;
+    }
+}
+
+static void count_retry(const esp_err_t result) {
+    taskENTER_CRITICAL(&stats_mux);
+    bus_stats.retries++;
+    taskEXIT_CRITICAL(&stats_mux);
+
+    ESP_LOGD(TAG, "transaction failed, retrying: %s", esp_err_to_name(result));
+}
+
+static esp_err_t send_transaction(void) {
+    esp_err_t result = ESP_OK;
+    if (tx_has_window) {
+        result = transport->write_commands(tx_window, WINDOW_SIZE);
+    }
+    if (result == ESP_OK && tx_data_len > 0) {
+        result = transport->write_data(tx_data, tx_data_len);
+    }
+    const esp_err_t flushed = transport->flush();
+    return result == ESP_OK ? flushed : result;
+}
+
+// The cells of a transaction are no longer dirty in the display task, so a failed one is sent a
+// second time before the pixels stay stale. Data without its window would land behind the part
+// the first attempt got through, only windowed transactions are repeated.
+static esp_err_t write_transaction(void) {
+    if (!tx_has_window && tx_data_len == 0) return ESP_OK;
+
+    esp_err_t result = ESP_ERR_INVALID_STATE;
+    if (transport_ready) {
+        result = send_transaction();
+        if (result != ESP_OK && tx_has_window) {
+            count_retry(result);
+            result = send_transaction();
+        }
+    }
+
+    count_transaction((tx_has_window ? WINDOW_SIZE : 0) + tx_data_len, result);
+
+    tx_has_window = false;
+    tx_data_len = 0;
+    return result;
+}
+
+static esp_err_t write_commands(const uint8_t *commands, const size_t length) {
+    const esp_err_t result = transport->write_commands(commands, length);
+    const esp_err_t flushed = transport->flush();
+    return result == ESP_OK ? flushed : result;
+}
+
+static esp_err_t send_commands(const uint8_t *commands, const size_t length) {
+    esp_err_t result = ESP_ERR_INVALID_STATE;
+    if (transport_ready) {
+        result = write_commands(commands, length);
+        if (result != ESP_OK) {
+            count_retry(result);
+            result = write_commands(commands, length);
+        }
+    }
+
+    count_transaction(length, result);
+    return result;
+}
+
+// init sequences and raw commands always go out as their own transaction
+static esp_err_t send_standalone(const OledBusOp_t *op) {
+    if (op->type == OLED_BUS_OP_INIT) {
+        return send_commands(init_sequence, sizeof(init_sequence));
+    }
+    return send_commands(op->data, op->length);
+}
+
+static bool is_standalone(const OledBusOp_t *op) {
+    return op->type == OLED_BUS_OP_INIT || op->type == OLED_BUS_OP_COMMAND;
+}
+
+// remember a batch which ended inside the open transaction
+static void track_batch(const OledBusOp_t *op) {
+    TRACE_BUS_OP();
+
+    if (!op->batch_end) {
+        open_batch_in_tx = true;
+        return;
+    }
+
+    completions[completion_count++] = (Completion_t){.notify = op->notify, .result = batch_result};
+    batch_result = ESP_OK;
+    open_batch_in_tx = false;
+}
+
+static void finish_transaction(const esp_err_t result) {
+    TRACE_BUS_WRITTEN(result);
+
+    for (int i = 0; i < completion_count; i++) {
+        const esp_err_t final = completions[i].result != ESP_OK ? completions[i].result : result;
+        if (completions[i].notify) {
+            xTaskNotify(completions[i].notify, (uint32_t) final, eSetValueWithOverwrite);
+        }
+    }
+
+    taskENTER_CRITICAL(&stats_mux);
+    bus_stats.batches += completion_count;
+    taskEXIT_CRITICAL(&stats_mux);
+
+    completion_count = 0;
+    if (open_batch_in_tx && batch_result == ESP_OK) batch_result = result;
+    open_batch_in_tx = false;
+}
+
+static bool next_op(OledBusOp_t *op, const TickType_t wait) {
+    if (has_carry) {
+        *op = carry;
+        has_carry = false;
+        return true;
+    }
+    if (xQueueReceive(bus_queue, op, wait) != pdPASS) return false;
+
+    const UBaseType_t depth = uxQueueMessagesWaiting(bus_queue) + 1;
+    if (depth > bus_stats.max_queued) {
+        taskENTER_CRITICAL(&stats_mux);
+        bus_stats.max_queued = depth;
+        taskEXIT_CRITICAL(&stats_mux);
+    }
+    TRACE_BUS_DEQUEUE(depth);
+    return true;
+}
+
+static void bus_task() {
+    OledBusOp_t op;
+
+    // ReSharper disable once CppDFAEndlessLoop
+    for (;;) {
+        if (!next_op(&op, portMAX_DELAY)) continue;
+
+        if (is_standalone(&op)) {
+            track_batch(&op);
+            finish_transaction(send_standalone(&op));
+            continue;
+        }
+
+        merge_op(&op);
+        track_batch(&op);
+
+        // merge queued ops into the open transaction until one does not fit,
+        // the rest of a batch is already on its way so it is worth waiting for
+        while (completion_count < MAX_COMPLETIONS) {
+            const TickType_t wait = op.batch_end ? 0 : pdMS_TO_TICKS(SUBMIT_TIMEOUT_MS);
+            if (!next_op(&op, wait)) break;
+
+            if (is_standalone(&op) || !merge_op(&op)) {
+                carry = op;
+                has_carry = true;
+                break;
+            }
+
+            track_batch(&op);
+            taskENTER_CRITICAL(&stats_mux);
+            bus_stats.merged_ops++;
+            taskEXIT_CRITICAL(&stats_mux);
+        }
+
+        finish_transaction(write_transaction());
+    }
+}
+
+bool oled_bus_submit(const OledBusOp_t *ops, const size_t count, TaskHandle_t notify) {
+    if (count == 0 || count > OLED_BUS_QUEUE_LEN) return false;
+
+    bool queued = false;
+
+    if (xSemaphoreTake(submit_mutex, pdMS_TO_TICKS(SUBMIT_TIMEOUT_MS)) == pdTRUE) {
+        // only the bus task takes from the queue, so the space can not shrink while the mutex is held
+        if (uxQueueSpacesAvailable(bus_queue) >= count) {
+            TRACE_BUS_SUBMIT(count);
+            for (size_t i = 0; i < count; i++) {
+                OledBusOp_t op = ops[i];
+                op.batch_end = i == count - 1;
+                op.notify = op.batch_end ? notify : NULL;
+                xQueueSend(bus_queue, &op, 0);
+            }
+            queued = true;
+        }
+        xSemaphoreGive(submit_mutex);
+    }
+
+    if (!queued) {
+        taskENTER_CRITICAL(&stats_mux);
+        bus_stats.rejected++;
+        taskEXIT_CRITICAL(&stats_mux);
+    }
+
+    return queued;
+}
+
+esp_err_t oled_bus_wait(const TickType_t timeout) {
+    uint32_t result;
+    if (xTaskNotifyWait(0, UINT32_MAX, &result, timeout) != pdTRUE) return ESP_ERR_TIMEOUT;
+    return (esp_err_t) result;
+}
+
+void get_oled_bus_stats(OledBusStats_t *stats) {
+    taskENTER_CRITICAL(&stats_mux);
+    *stats = bus_stats;
+    taskEXIT_CRITICAL(&stats_mux);
+
+    stats->queued = bus_queue ? uxQueueMessagesWaiting(bus_queue) : 0;
+}
+
+esp_err_t init_oled_bus(const OledTransport_t *bus_transport, const int priority) {
+    transport = bus_transport;
+
+    bus_queue = xQueueCreate(OLED_BUS_QUEUE_LEN, sizeof(OledBusOp_t));
+    submit_mutex = xSemaphoreCreateMutex();
+    if (bus_queue == NULL || submit_mutex == NULL) return ESP_ERR_NO_MEM;
+
+    // a missing panel must not stop the tracking, its failed ops show up in the stats
+    const esp_err_t result = transport->init();
+    transport_ready = result == ESP_OK;
+    if (!transport_ready) {
+        ESP_LOGE(TAG, "%s transport failed: %s", transport->name, esp_err_to_name(result));
+    }
+
+    if (xTaskCreate(bus_task, "oled_bus_task", 3072, NULL, priority, NULL) != pdPASS) return ESP_ERR_NO_MEM;
+    return ESP_OK;
+}
@@ -0,0 +1,63 @@
+#ifndef OLEDBUS_H
+#define OLEDBUS_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "oledtransport.h"
+#include <esp_err.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define OLED_WIDTH 128
+#define OLED_PAGES 8
+#define OLED_BUS_QUEUE_LEN 16
+
+typedef enum {
+    OLED_BUS_OP_INIT, // send the SSD1306 init sequence
+    OLED_BUS_OP_CURSOR, // set the column/page window for following data
+    OLED_BUS_OP_DATA, // write data into the current window
+    OLED_BUS_OP_CLEAR, // zero the whole GDDRAM
+    OLED_BUS_OP_COMMAND, // raw command bytes in data, e.g. contrast or display on/off
+} OledBusOpType_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t column_start;
+    uint8_t column_end;
+    uint8_t page_start;
+    uint8_t page_end;
+    bool batch_end; // set by oled_bus_submit on the last op of a batch
+    uint8_t length;
+    TaskHandle_t notify; // task notified with the batch result, only on the last op of a batch
+    uint8_t data[OLED_WIDTH];
+} OledBusOp_t;
+
+typedef struct {
+    uint32_t batches;
+    uint32_t transactions;
+    uint32_t merged_ops;
+    uint32_t bytes; // command and data bytes, without transport framing
+    uint32_t errors; // failed transactions, counted after their retry
+    uint32_t retries; // failed transactions sent a second time
+    uint32_t rejected; // submissions dropped because the queue stayed full
+    esp_err_t last_error; // of the last failed transaction, ESP_OK while none failed
+    uint8_t queued; // ops waiting right now
+    uint8_t max_queued; // most ops the task found waiting
+} OledBusStats_t;
+
+// Bring up the transport and start the task owning it. Only fails if the task could not start, a
+// transport which did not come up fails every op with ESP_ERR_INVALID_STATE and counts it in errors.
+esp_err_t init_oled_bus(const OledTransport_t *bus_transport, int priority);
+
+// queue a batch of ops without waiting for the wire, notify (may be NULL) receives the result via oled_bus_wait
+bool oled_bus_submit(const OledBusOp_t *ops, size_t count, TaskHandle_t notify);
+
+// block the calling task until a batch submitted with its handle completed
+esp_err_t oled_bus_wait(TickType_t timeout);
+
+OledBusOp_t oled_bus_cursor(uint8_t column_start, uint8_t column_end, uint8_t page_start, uint8_t page_end);
+
+void get_oled_bus_stats(OledBusStats_t *stats);
+
+#endif
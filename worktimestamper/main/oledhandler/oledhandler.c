@@ -1,31 +1,45 @@
 #include "oledhandler.h"
-#include "font5x7.h"
+#include "oledbus.h"
 #include "commands.h"
+#include "font5x7.h"
+#include "tracehandler.h"
 
 #include "esp_log.h"
 #include <string.h>
-#include "driver/i2c.h"
 
-#define I2C_MASTER_NUM I2C_NUM_0
-#define I2C_MASTER_SCL_IO GPIO_NUM_19
-#define I2C_MASTER_SDA_IO GPIO_NUM_21
-#define I2C_MASTER_FREQ_HZ 100000
-#define I2C_MASTER_TX_BUF_DISABLE 0
-#define I2C_MASTER_RX_BUF_DISABLE 0
-
-#define MSG_QUEUE_LEN 20
 #define DISPLAY_CACHE_SIZE 20
+#define OLED_BUS_PRIORITY 2
+#define OLED_TRANSPORT oled_transport_i2c // oled_transport_spi for the SPI wired module
+#define OLED_INIT_TIMEOUT_MS 1000
+
+#define GLYPH_WIDTH 6
+#define CELLS_PER_PAGE ((OLED_WIDTH + GLYPH_WIDTH - 1) / GLYPH_WIDTH)
+#define ALL_CELLS_DIRTY ((1UL << CELLS_PER_PAGE) - 1)
+#define TEXT_ROWS 8
+#define CLEAR_REQUEST_BIT (1UL << TEXT_ROWS)
+#define FLUSH_RETRY_MS 50
+
+// bus cost of one addressed span: column/page window (Co=1 command pairs) + data control byte
+#define SPAN_HEADER_SIZE 13
+
+// bytes the old per-glyph path put on the bus for every character of a changed row
+#define LEGACY_BYTES_PER_CHAR 7
+
+static_assert(CELLS_PER_PAGE <= 32, "dirty cells must fit into an uint32_t");
 
-QueueHandle_t message_queue;
+static TaskHandle_t display_task_handle;
 
-static char current_displayed_lines[8][21]; // cache for current OLED output
+static uint8_t framebuffer[OLED_PAGES][OLED_WIDTH]; // shadow of the SSD1306 GDDRAM, only touched by display_task
+static uint32_t dirty_cells[OLED_PAGES]; // per page bitmask of glyph cells not yet flushed
+
+static char current_displayed_lines[8][21]; // text rendered into the framebuffer
 static char latest_text_buffer[8][21]; // cache for last text received
-static portMUX_TYPE buffer_mux = portMUX_INITIALIZER_UNLOCKED; // safe for latest_text_buffer
+static uint32_t dirty_rows; // rows of latest_text_buffer not rendered yet, CLEAR_REQUEST_BIT for a pending clear
+static portMUX_TYPE buffer_mux = portMUX_INITIALIZER_UNLOCKED; // safe for latest_text_buffer and dirty_rows
 
-bool is_display_update_needed(const TextMessage_t *msg) {
-    if (msg->row >= 8 || msg->column != 0) return true; // skip optimization if column != 0
-    return strncmp(current_displayed_lines[msg->row], msg->text, sizeof(current_displayed_lines[0])) != 0;
-}
+static DisplayDeltaStats_t delta_stats;
+static DisplayUpdateStats_t update_stats;
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
 
 void update_display_cache(const TextMessage_t *msg) {
     if (msg->row < 8 && msg->column == 0) {
@@ -34,135 +48,324 @@ void update_display_cache(const TextMessage_t *msg) {
     }
 }
 
-static esp_err_t ssd1306_send_init_sequence(void) {
-    return i2c_master_write_to_device(I2C_MASTER_NUM,
-                                      SSD1306_ADDR,
-                                      init_sequence,
-                                      sizeof(init_sequence),
-                                      pdMS_TO_TICKS(1000));
+// returns true if the glyph cell changed in the framebuffer
+static bool render_char(const char character, const uint8_t column, const uint8_t page) {
+    const uint16_t x = column * GLYPH_WIDTH;
+    if (x + GLYPH_WIDTH > OLED_WIDTH) return false;
+
+    const uint8_t *glyph = getFontData(character);
+    uint8_t *cell = &framebuffer[page][x];
+    const uint8_t pixels[GLYPH_WIDTH] = {glyph[0], glyph[1], glyph[2], glyph[3], glyph[4], 0x00};
+
+    if (memcmp(cell, pixels, GLYPH_WIDTH) == 0) return false;
+
+    memcpy(cell, pixels, GLYPH_WIDTH);
+    dirty_cells[page] |= 1UL << column;
+    return true;
+}
+
+static void clear_framebuffer(void) {
+    memset(framebuffer, 0, sizeof(framebuffer));
+
+    const OledBusOp_t clear = {.type = OLED_BUS_OP_CLEAR};
+    const bool queued = oled_bus_submit(&clear, 1, NULL);
+
+    for (int page = 0; page < OLED_PAGES; page++) {
+        dirty_cells[page] = queued ? 0 : ALL_CELLS_DIRTY;
+        current_displayed_lines[page][0] = '\0';
+    }
+}
+
+static bool flush_span(const uint8_t page, const uint8_t start, const uint8_t end) {
+    OledBusOp_t ops[2] = {
+        oled_bus_cursor(start, end - 1, page, page),
+        {.type = OLED_BUS_OP_DATA, .length = end - start},
+    };
+    memcpy(ops[1].data, &framebuffer[page][start], end - start);
+
+    return oled_bus_submit(ops, 2, NULL);
 }
 
-void clear_display() {
-    const uint8_t clear_data[1024] = {0};
+// queues the dirty cells of one page, returns the bytes they put on the bus
+static uint32_t flush_page(const uint8_t page) {
+    const uint32_t dirty = dirty_cells[page];
+    uint32_t bus_bytes = 0;
+    int cell = 0;
 
-    uint8_t data_buf[1 + 1024];
-    data_buf[0] = 0x40;
-    memcpy(data_buf + 1, clear_data, 1024);
+    while (cell < CELLS_PER_PAGE) {
+        if ((dirty & (1UL << cell)) == 0) {
+            cell++;
+            continue;
+        }
 
-    i2c_master_write_to_device(I2C_MASTER_NUM, SSD1306_ADDR, (uint8_t[]){COMMAND_CONTROL_BYTE, 0x21, 0x00, 0x7F}, 4,
-                               pdMS_TO_TICKS(100));
-    i2c_master_write_to_device(I2C_MASTER_NUM, SSD1306_ADDR, (uint8_t[]){COMMAND_CONTROL_BYTE, 0x22, 0x00, 0x07}, 4,
-                               pdMS_TO_TICKS(100));
-    i2c_master_write_to_device(I2C_MASTER_NUM, SSD1306_ADDR, data_buf, sizeof(data_buf), pdMS_TO_TICKS(1000));
+        // merge following runs as long as resending the clean gap is cheaper than a new transaction
+        int last = cell;
+        for (int next = cell + 1; next < CELLS_PER_PAGE; next++) {
+            if ((dirty & (1UL << next)) == 0) continue;
+            if ((next - last - 1) * GLYPH_WIDTH >= SPAN_HEADER_SIZE) break;
+            last = next;
+        }
 
-    for (int i = 0; i < 8; i++) {
-        current_displayed_lines[i][0] = '\0';
+        const uint8_t start = cell * GLYPH_WIDTH;
+        const uint8_t end = (last + 1) * GLYPH_WIDTH > OLED_WIDTH ? OLED_WIDTH : (last + 1) * GLYPH_WIDTH;
+
+        if (flush_span(page, start, end)) {
+            dirty_cells[page] &= ~(((1UL << (last + 1)) - 1) & ~((1UL << cell) - 1));
+            bus_bytes += SPAN_HEADER_SIZE + (end - start);
+        }
+
+        cell = last + 1;
     }
+
+    return bus_bytes;
 }
 
-void set_cursor(const uint8_t column, const uint8_t row) {
-    const uint8_t pixel_start = column * 6;
-    const uint8_t cmd_col[] = {COMMAND_CONTROL_BYTE, 0x21, pixel_start, pixel_start + 5};
-    const uint8_t cmd_page[] = {COMMAND_CONTROL_BYTE, 0x22, row, row};
+static void flush_framebuffer(const uint32_t legacy_bytes) {
+    uint32_t bus_bytes = 0;
+
+    for (uint8_t page = 0; page < OLED_PAGES; page++) {
+        if (dirty_cells[page] != 0) {
+            bus_bytes += flush_page(page);
+        }
+    }
 
-    ESP_ERROR_CHECK(
-        i2c_master_write_to_device(I2C_MASTER_NUM, SSD1306_ADDR, cmd_col, sizeof(cmd_col), pdMS_TO_TICKS(100)));
-    ESP_ERROR_CHECK(
-        i2c_master_write_to_device(I2C_MASTER_NUM, SSD1306_ADDR, cmd_page, sizeof(cmd_page), pdMS_TO_TICKS(100)));
+    if (bus_bytes == 0) return;
+    TRACE_REDRAW_QUEUED();
+
+    taskENTER_CRITICAL(&stats_mux);
+    delta_stats.flushes++;
+    delta_stats.bytes_on_bus += bus_bytes;
+    delta_stats.legacy_bytes += legacy_bytes;
+    taskEXIT_CRITICAL(&stats_mux);
+
+    ESP_LOGD("OLED", "flush: %lu bytes on bus, %ld saved",
+             (unsigned long) bus_bytes, (long) legacy_bytes - (long) bus_bytes);
 }
 
-void send_char(const char character) {
-    const uint8_t *glyph = getFontData(character);
-    const uint8_t i2c_data[7] = {0x40, glyph[0], glyph[1], glyph[2], glyph[3], glyph[4], 0x00};
-    i2c_master_write_to_device(I2C_MASTER_NUM, SSD1306_ADDR, i2c_data, sizeof(i2c_data), pdMS_TO_TICKS(1000));
+static void wake_display_task(void) {
+    if (display_task_handle) {
+        xTaskNotifyGive(display_task_handle);
+    }
 }
 
-TextMessage_t create_display_message(const char *text, const uint8_t column, const uint8_t row) {
-    TextMessage_t msg = {.column = column, .row = row};
-    strncpy(msg.text, text, sizeof(msg.text) - 1);
-    msg.text[sizeof(msg.text) - 1] = '\0';
-    return msg;
+void clear_display() {
+    taskENTER_CRITICAL(&buffer_mux);
+    for (int i = 0; i < 8; i++) {
+        latest_text_buffer[i][0] = '\0';
+    }
+    // rows written before the clear are gone with it
+    dirty_rows = CLEAR_REQUEST_BIT;
+    taskEXIT_CRITICAL(&buffer_mux);
+
+    wake_display_task();
+}
+
+// caller holds buffer_mux, returns true if the row has to be redrawn
+static bool store_row(const char *text, const uint8_t row) {
+    if (strncmp(latest_text_buffer[row], text, 20) == 0) return false;
+
+    strncpy(latest_text_buffer[row], text, 20);
+    latest_text_buffer[row][20] = '\0';
+
+    update_stats.writes++;
+    if (dirty_rows & (1UL << row)) {
+        update_stats.coalesced++; // the pending redraw of this row picks the new text up
+    }
+    dirty_rows |= 1UL << row;
+    TRACE(TRACE_EVENT_TEXT, row);
+
+    const uint8_t pending = __builtin_popcount(dirty_rows & ~CLEAR_REQUEST_BIT);
+    if (pending > update_stats.max_pending_rows) {
+        update_stats.max_pending_rows = pending;
+    }
+    return true;
 }
 
 void send_text_at(const char *text, const uint8_t column, const uint8_t row) {
     if (row >= 8 || column != 0) return;
 
+    taskENTER_CRITICAL(&buffer_mux);
+    const bool changed = store_row(text, row);
+    taskEXIT_CRITICAL(&buffer_mux);
+
+    if (changed) {
+        wake_display_task();
+    }
+}
+
+void clear_frame(DisplayFrame_t *frame) {
+    for (int row = 0; row < TEXT_ROWS; row++) {
+        memset(frame->rows[row], ' ', 20);
+        frame->rows[row][20] = '\0';
+    }
+}
+
+void send_frame(DisplayFrame_t *frame) {
+    // pad rows a view terminated early, so nothing of the previous frame survives
+    for (int row = 0; row < TEXT_ROWS; row++) {
+        const size_t length = strnlen(frame->rows[row], 20);
+        memset(frame->rows[row] + length, ' ', 20 - length);
+        frame->rows[row][20] = '\0';
+    }
+
     bool changed = false;
 
+    // all rows are published together, display_task never renders half of a frame
     taskENTER_CRITICAL(&buffer_mux);
-    if (strncmp(latest_text_buffer[row], text, 20) != 0) {
-        strncpy(latest_text_buffer[row], text, 20);
-        latest_text_buffer[row][20] = '\0';
-        changed = true;
+    for (uint8_t row = 0; row < TEXT_ROWS; row++) {
+        changed |= store_row(frame->rows[row], row);
     }
     taskEXIT_CRITICAL(&buffer_mux);
 
     if (changed) {
-        const TextMessage_t message = create_display_message(text, column, row);
-        xQueueSend(message_queue, &message, 0);
+        wake_display_task();
     }
 }
 
-
 void send_text_at_row(const char *text, const uint8_t row) {
     send_text_at(text, 0, row);
 }
 
-void process_display_message(const TextMessage_t *message) {
-    if (!is_display_update_needed(message)) return;
-    set_cursor(message->column, message->row);
+// renders only the glyph cells which differ from the displayed row, returns the legacy bus cost of the update
+uint32_t process_display_message(const TextMessage_t *message) {
+    const char *shown = current_displayed_lines[message->row];
+    bool shown_ended = false;
+    uint8_t changed_cells = 0;
+    int length = 0;
+
+    for (; message->text[length] != '\0'; length++) {
+        if (shown[length] == '\0') shown_ended = true;
+        if (!shown_ended && shown[length] == message->text[length]) continue;
 
-    for (int i = 0; message->text[i] != '\0'; i++) {
-        set_cursor(message->column + i, message->row);
-        send_char(message->text[i]);
+        if (render_char(message->text[length], message->column + length, message->row)) {
+            changed_cells++;
+        }
     }
     update_display_cache(message);
+
+    if (changed_cells == 0) return 0;
+
+    taskENTER_CRITICAL(&stats_mux);
+    delta_stats.row_updates++;
+    delta_stats.cells_changed += changed_cells;
+    taskEXIT_CRITICAL(&stats_mux);
+
+    return length * LEGACY_BYTES_PER_CHAR;
 }
 
-void display_task() {
-    TextMessage_t message;
+// renders all rows written since the last call, returns the legacy bus cost of the update
+static uint32_t render_dirty_rows(void) {
+    TextMessage_t rows[TEXT_ROWS];
+
+    taskENTER_CRITICAL(&buffer_mux);
+    const uint32_t pending = dirty_rows;
+    dirty_rows = 0;
+    for (uint8_t row = 0; row < TEXT_ROWS; row++) {
+        if (pending & (1UL << row)) {
+            memcpy(rows[row].text, latest_text_buffer[row], sizeof(rows[row].text));
+        }
+    }
+    if (pending) update_stats.redraws++;
+    taskEXIT_CRITICAL(&buffer_mux);
+
+    if (pending) TRACE(TRACE_EVENT_RENDER, pending);
+
+    if (pending & CLEAR_REQUEST_BIT) {
+        clear_framebuffer();
+    }
 
+    uint32_t legacy_bytes = 0;
+    for (uint8_t row = 0; row < TEXT_ROWS; row++) {
+        if ((pending & (1UL << row)) == 0) continue;
+
+        rows[row].column = 0;
+        rows[row].row = row;
+        legacy_bytes += process_display_message(&rows[row]);
+    }
+
+    return legacy_bytes;
+}
+
+static bool has_unflushed_cells(void) {
+    for (uint8_t page = 0; page < OLED_PAGES; page++) {
+        if (dirty_cells[page] != 0) return true;
+    }
+    return false;
+}
+
+void display_task() {
     // ReSharper disable once CppDFAEndlessLoop
     for (;;) {
-        if (xQueueReceive(message_queue, &message, portMAX_DELAY) == pdPASS) {
-            taskENTER_CRITICAL(&buffer_mux);
-            strncpy(message.text, latest_text_buffer[message.row], sizeof(message.text));
-            taskEXIT_CRITICAL(&buffer_mux);
-            process_display_message(&message);
+        // any number of writes since the last wake-up cost one redraw per row
+        flush_framebuffer(render_dirty_rows());
+
+        // spans the bus task could not take yet are retried without waiting for new text
+        const bool retry = has_unflushed_cells();
+        if (ulTaskNotifyTake(pdTRUE, retry ? pdMS_TO_TICKS(FLUSH_RETRY_MS) : portMAX_DELAY) == 0 && retry) {
+            taskENTER_CRITICAL(&stats_mux);
+            delta_stats.retries++;
+            taskEXIT_CRITICAL(&stats_mux);
         }
     }
 }
 
+void get_display_update_stats(DisplayUpdateStats_t *stats) {
+    taskENTER_CRITICAL(&buffer_mux);
+    *stats = update_stats;
+    taskEXIT_CRITICAL(&buffer_mux);
+}
+
+void get_display_delta_stats(DisplayDeltaStats_t *stats) {
+    taskENTER_CRITICAL(&stats_mux);
+    *stats = delta_stats;
+    taskEXIT_CRITICAL(&stats_mux);
+}
+
 
 void send_page_20x8(const char *full_text_page[]) {
     if (!full_text_page) return;
-    char line[21];
+    DisplayFrame_t frame;
 
     for (int i = 0; i < 8; i++) {
-        strncpy(line, full_text_page[i], 20);
-        line[20] = '\0';
-        send_text_at_row(line, i);
+        strncpy(frame.rows[i], full_text_page[i], 20);
+        frame.rows[i][20] = '\0';
     }
+
+    send_frame(&frame);
+}
+
+static void send_display_commands(const uint8_t *commands, const uint8_t length) {
+    OledBusOp_t op = {.type = OLED_BUS_OP_COMMAND, .length = length};
+    memcpy(op.data, commands, length);
+    oled_bus_submit(&op, 1, NULL);
+}
+
+void set_display_contrast(const uint8_t contrast) {
+    const uint8_t commands[] = {SET_CONTRAST_COMMAND, contrast};
+    send_display_commands(commands, sizeof(commands));
+}
+
+void set_display_enabled(const bool enabled) {
+    // GDDRAM keeps its content while the panel is off, so the framebuffer stays valid
+    const uint8_t command = enabled ? DISPLAY_ON_COMMAND : DISPLAY_OFF_COMMAND;
+    send_display_commands(&command, 1);
 }
 
 void init_oled(void) {
-    const i2c_config_t conf = {
-        .mode = I2C_MODE_MASTER,
-        .sda_io_num = I2C_MASTER_SDA_IO,
-        .sda_pullup_en = GPIO_PULLUP_ENABLE,
-        .scl_io_num = I2C_MASTER_SCL_IO,
-        .scl_pullup_en = GPIO_PULLUP_ENABLE,
-        .master.clk_speed = I2C_MASTER_FREQ_HZ,
-    };
+    ESP_ERROR_CHECK(init_oled_bus(&OLED_TRANSPORT, OLED_BUS_PRIORITY));
 
-    ESP_ERROR_CHECK(i2c_param_config(I2C_MASTER_NUM, &conf));
-    ESP_ERROR_CHECK(
-        i2c_driver_install(I2C_MASTER_NUM, conf.mode, I2C_MASTER_RX_BUF_DISABLE, I2C_MASTER_TX_BUF_DISABLE, 0));
-    ESP_ERROR_CHECK(ssd1306_send_init_sequence());
+    const OledBusOp_t init = {.type = OLED_BUS_OP_INIT};
+    if (!oled_bus_submit(&init, 1, xTaskGetCurrentTaskHandle())) {
+        ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+    }
 
-    message_queue = xQueueCreate(MSG_QUEUE_LEN, sizeof(TextMessage_t));
+    // without a panel the device keeps tracking, the console shows the bus errors
+    const esp_err_t result = oled_bus_wait(pdMS_TO_TICKS(OLED_INIT_TIMEOUT_MS));
+    if (result != ESP_OK) {
+        ESP_LOGE("OLED", "panel init failed: %s", esp_err_to_name(result));
+    }
 
     clear_display();
 
-    xTaskCreate(display_task, "display_task", 4096, NULL, 1, NULL);
+    xTaskCreate(display_task, "display_task", 4096, NULL, 1, &display_task_handle);
 }
@@ -2,6 +2,7 @@
 #define OLEDHANDLER_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef struct {
     uint8_t column;
@@ -9,16 +10,54 @@ typedef struct {
     char text[21];
 } TextMessage_t;
 
+// full screen of text, committed at once with send_frame
+typedef struct {
+    char rows[8][21];
+} DisplayFrame_t;
+
+// counters of the delta engine, legacy_bytes is what the per-glyph path would have sent,
+// retries are wake-ups for spans the full bus queue did not take
+typedef struct {
+    uint32_t row_updates;
+    uint32_t cells_changed;
+    uint32_t flushes;
+    uint32_t bytes_on_bus;
+    uint32_t legacy_bytes;
+    uint32_t retries;
+} DisplayDeltaStats_t;
+
+// counters of the coalescing row updates, coalesced writes found their row still waiting for a redraw
+typedef struct {
+    uint32_t writes;
+    uint32_t coalesced;
+    uint32_t redraws;
+    uint8_t max_pending_rows;
+} DisplayUpdateStats_t;
+
 void init_oled(void);
 
 void send_pixel(uint8_t column, uint8_t page, uint8_t pixel_bit);
 
-void set_cursor(uint8_t column, uint8_t row);
-
 void clear_display();
 
+// panel brightness, DEFAULT_CONTRAST after init
+void set_display_contrast(uint8_t contrast);
+
+// switch the panel off (sleep mode) or back on
+void set_display_enabled(bool enabled);
+
 void send_page_20x8(const char *full_text_page[]);
 
 void send_text_at_row(const char *text, uint8_t row);
 
+// fill all rows with blanks
+void clear_frame(DisplayFrame_t *frame);
+
+// publish all rows of the frame in one step, rows shorter than 20 chars get padded with blanks
+void send_frame(DisplayFrame_t *frame);
+
+void get_display_delta_stats(DisplayDeltaStats_t *stats);
+
+void get_display_update_stats(DisplayUpdateStats_t *stats);
+
 #endif
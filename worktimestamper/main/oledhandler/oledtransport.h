@@ -0,0 +1,24 @@
+#ifndef OLEDTRANSPORT_H
+#define OLEDTRANSPORT_H
+
+#include <esp_err.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Wire protocol below the oled bus task. write_commands/write_data stage one transaction,
+// flush puts it on the wire. Staged buffers must stay valid until flush returns.
+typedef struct {
+    const char *name;
+    esp_err_t (*init)(void);
+    esp_err_t (*write_commands)(const uint8_t *commands, size_t length);
+    esp_err_t (*write_data)(const uint8_t *data, size_t length);
+    esp_err_t (*flush)(void);
+} OledTransport_t;
+
+// SSD1306 on I2C_NUM_0, clock probed at init (1 MHz, 400 kHz, 100 kHz)
+extern const OledTransport_t oled_transport_i2c;
+
+// SSD1306 in 4-wire SPI mode, data written by DMA
+extern const OledTransport_t oled_transport_spi;
+
+#endif
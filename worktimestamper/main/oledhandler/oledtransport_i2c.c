@@ -0,0 +1,154 @@
+#include "oledtransport.h"
+#include "commands.h"
+#include "tracehandler.h"
+
+#include "esp_log.h"
+#include <string.h>
+#include "driver/i2c.h"
+
+#define I2C_MASTER_NUM I2C_NUM_0
+#define I2C_MASTER_SCL_IO GPIO_NUM_19
+#define I2C_MASTER_SDA_IO GPIO_NUM_21
+#define I2C_MASTER_TX_BUF_DISABLE 0
+#define I2C_MASTER_RX_BUF_DISABLE 0
+#define I2C_TIMEOUT_MS 1000
+
+#define MAX_COMMANDS 32
+#define MAX_DATA_SEGMENTS 4
+
+static const char *TAG = "OLED_I2C";
+
+// fastest first, the first clock the panel acknowledges is kept
+static const uint32_t probe_frequencies[] = {1000000, 400000, 100000};
+
+static uint8_t staged_commands[1 + 2 * MAX_COMMANDS]; // room for the Co=1 pair encoding
+static size_t staged_command_count;
+
+typedef struct {
+    const uint8_t *data;
+    size_t length;
+} DataSegment_t;
+
+static DataSegment_t staged_data[MAX_DATA_SEGMENTS];
+static size_t staged_data_count;
+
+static uint8_t link_buffer[I2C_LINK_RECOMMENDED_SIZE(4 + MAX_DATA_SEGMENTS)];
+static uint32_t active_frequency;
+
+static esp_err_t install_driver(const uint32_t frequency) {
+    const i2c_config_t conf = {
+        .mode = I2C_MODE_MASTER,
+        .sda_io_num = I2C_MASTER_SDA_IO,
+        .sda_pullup_en = GPIO_PULLUP_ENABLE,
+        .scl_io_num = I2C_MASTER_SCL_IO,
+        .scl_pullup_en = GPIO_PULLUP_ENABLE,
+        .master.clk_speed = frequency,
+    };
+
+    esp_err_t result = i2c_param_config(I2C_MASTER_NUM, &conf);
+    if (result != ESP_OK) return result;
+
+    return i2c_driver_install(I2C_MASTER_NUM, conf.mode, I2C_MASTER_RX_BUF_DISABLE, I2C_MASTER_TX_BUF_DISABLE, 0);
+}
+
+static esp_err_t probe_panel(void) {
+    const uint8_t nop[] = {COMMAND_CONTROL_BYTE, NOP_COMMAND};
+
+    TRACE_I2C_BEGIN(1 + sizeof(nop));
+    const esp_err_t result = i2c_master_write_to_device(I2C_MASTER_NUM, SSD1306_ADDR, nop, sizeof(nop),
+                                                        pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+    TRACE_I2C_END(result);
+    return result;
+}
+
+static esp_err_t i2c_transport_init(void) {
+    esp_err_t result = ESP_FAIL;
+
+    for (size_t i = 0; i < sizeof(probe_frequencies) / sizeof(probe_frequencies[0]); i++) {
+        result = install_driver(probe_frequencies[i]);
+        if (result != ESP_OK) return result;
+
+        result = probe_panel();
+        if (result == ESP_OK) {
+            active_frequency = probe_frequencies[i];
+            ESP_LOGI(TAG, "panel answers at %lu Hz", (unsigned long) active_frequency);
+            return ESP_OK;
+        }
+
+        i2c_driver_delete(I2C_MASTER_NUM);
+    }
+
+    // keep the slowest clock installed so a panel attached later still works
+    install_driver(probe_frequencies[sizeof(probe_frequencies) / sizeof(probe_frequencies[0]) - 1]);
+    return result;
+}
+
+static esp_err_t i2c_transport_write_commands(const uint8_t *commands, const size_t length) {
+    if (staged_command_count + length > MAX_COMMANDS) return ESP_ERR_INVALID_SIZE;
+
+    memcpy(staged_commands + 1 + staged_command_count, commands, length);
+    staged_command_count += length;
+    return ESP_OK;
+}
+
+static esp_err_t i2c_transport_write_data(const uint8_t *data, const size_t length) {
+    if (staged_data_count >= MAX_DATA_SEGMENTS) return ESP_ERR_INVALID_SIZE;
+
+    staged_data[staged_data_count++] = (DataSegment_t){.data = data, .length = length};
+    return ESP_OK;
+}
+
+// commands in front of data need one control byte each, commands alone share a single one
+static size_t encode_commands(const bool followed_by_data) {
+    if (!followed_by_data) {
+        staged_commands[0] = COMMAND_CONTROL_BYTE;
+        return 1 + staged_command_count;
+    }
+
+    for (size_t i = staged_command_count; i > 0; i--) {
+        staged_commands[2 * i - 1] = staged_commands[i];
+        staged_commands[2 * i - 2] = SINGLE_COMMAND_CONTROL_BYTE;
+    }
+    return 2 * staged_command_count;
+}
+
+static esp_err_t i2c_transport_flush(void) {
+    if (staged_command_count == 0 && staged_data_count == 0) return ESP_OK;
+
+    const size_t command_length = staged_command_count > 0 ? encode_commands(staged_data_count > 0) : 0;
+
+    size_t bytes = 1 + command_length; // address byte first
+
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link_buffer, sizeof(link_buffer));
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (SSD1306_ADDR << 1) | I2C_MASTER_WRITE, true);
+    if (command_length > 0) {
+        i2c_master_write(cmd, staged_commands, command_length, true);
+    }
+    if (staged_data_count > 0) {
+        i2c_master_write_byte(cmd, DATA_CONTROL_BYTE, true);
+        bytes++;
+        for (size_t i = 0; i < staged_data_count; i++) {
+            i2c_master_write(cmd, staged_data[i].data, staged_data[i].length, true);
+            bytes += staged_data[i].length;
+        }
+    }
+    i2c_master_stop(cmd);
+
+    TRACE_I2C_BEGIN(bytes);
+    const esp_err_t result = i2c_master_cmd_begin(I2C_MASTER_NUM, cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+    TRACE_I2C_END(result);
+    i2c_cmd_link_delete_static(cmd);
+
+    staged_command_count = 0;
+    staged_data_count = 0;
+    return result;
+}
+
+const OledTransport_t oled_transport_i2c = {
+    .name = "i2c",
+    .init = i2c_transport_init,
+    .write_commands = i2c_transport_write_commands,
+    .write_data = i2c_transport_write_data,
+    .flush = i2c_transport_flush,
+};
@@ -0,0 +1,143 @@
+#include "oledtransport.h"
+#include "commands.h"
+
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include <string.h>
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+#include "freertos/FreeRTOS.h"
+
+#define SPI_HOST_ID SPI2_HOST
+#define SPI_SCLK_IO GPIO_NUM_14
+#define SPI_MOSI_IO GPIO_NUM_13
+#define SPI_CS_IO GPIO_NUM_15
+#define SPI_DC_IO GPIO_NUM_27
+#define SPI_RST_IO GPIO_NUM_26
+
+// SSD1306 serial clock limit, a full 1 KB frame takes ~0.8 ms
+#define SPI_CLOCK_HZ SPI_MASTER_FREQ_10M
+#define SPI_MAX_TRANSFER (128 * 8)
+
+// RES# low pulse (datasheet minimum 3 us) and the wait before the first command
+#define RESET_LOW_US 10
+#define RESET_SETTLE_US 10
+
+#define MAX_COMMANDS 32
+#define MAX_DATA_SEGMENTS 4
+
+static const char *TAG = "OLED_SPI";
+
+static spi_device_handle_t spi_device;
+
+static uint8_t staged_commands[MAX_COMMANDS];
+static size_t staged_command_count;
+
+static spi_transaction_t data_transactions[MAX_DATA_SEGMENTS];
+static size_t staged_data_count;
+
+// D/C level travels in the transaction user field and is applied right before the transfer
+static void IRAM_ATTR set_dc_line(spi_transaction_t *transaction) {
+    gpio_set_level(SPI_DC_IO, (uint32_t) transaction->user);
+}
+
+static void reset_panel(void) {
+    // a 1 ms tick delay is 0 ticks at 100 Hz, the pulse would be as short as the GPIO writes
+    gpio_set_level(SPI_RST_IO, 0);
+    esp_rom_delay_us(RESET_LOW_US);
+    gpio_set_level(SPI_RST_IO, 1);
+    esp_rom_delay_us(RESET_SETTLE_US);
+}
+
+static esp_err_t spi_transport_init(void) {
+    const gpio_config_t control_pins = {
+        .intr_type = GPIO_INTR_DISABLE,
+        .mode = GPIO_MODE_OUTPUT,
+        .pin_bit_mask = (1ULL << SPI_DC_IO) | (1ULL << SPI_RST_IO),
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+    };
+    esp_err_t result = gpio_config(&control_pins);
+    if (result != ESP_OK) return result;
+
+    const spi_bus_config_t bus = {
+        .mosi_io_num = SPI_MOSI_IO,
+        .miso_io_num = -1,
+        .sclk_io_num = SPI_SCLK_IO,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = SPI_MAX_TRANSFER,
+    };
+    result = spi_bus_initialize(SPI_HOST_ID, &bus, SPI_DMA_CH_AUTO);
+    if (result != ESP_OK) return result;
+
+    const spi_device_interface_config_t device = {
+        .clock_speed_hz = SPI_CLOCK_HZ,
+        .mode = 0,
+        .spics_io_num = SPI_CS_IO,
+        .queue_size = MAX_DATA_SEGMENTS,
+        .pre_cb = set_dc_line,
+    };
+    result = spi_bus_add_device(SPI_HOST_ID, &device, &spi_device);
+    if (result != ESP_OK) return result;
+
+    reset_panel();
+    ESP_LOGI(TAG, "panel on SPI at %d Hz", SPI_CLOCK_HZ);
+    return ESP_OK;
+}
+
+static esp_err_t spi_transport_write_commands(const uint8_t *commands, const size_t length) {
+    if (staged_command_count + length > MAX_COMMANDS) return ESP_ERR_INVALID_SIZE;
+
+    memcpy(staged_commands + staged_command_count, commands, length);
+    staged_command_count += length;
+    return ESP_OK;
+}
+
+static esp_err_t spi_transport_write_data(const uint8_t *data, const size_t length) {
+    if (staged_data_count >= MAX_DATA_SEGMENTS) return ESP_ERR_INVALID_SIZE;
+
+    data_transactions[staged_data_count++] = (spi_transaction_t){
+        .length = length * 8,
+        .tx_buffer = data,
+        .user = (void *) 1,
+    };
+    return ESP_OK;
+}
+
+static esp_err_t spi_transport_flush(void) {
+    esp_err_t result = ESP_OK;
+
+    // commands are a few bytes, polling is cheaper than setting up DMA for them
+    if (staged_command_count > 0) {
+        spi_transaction_t commands = {
+            .length = staged_command_count * 8,
+            .tx_buffer = staged_commands,
+            .user = (void *) 0,
+        };
+        result = spi_device_polling_transmit(spi_device, &commands);
+    }
+
+    // queue all data segments back to back, the DMA streams them while this task sleeps
+    size_t queued = 0;
+    for (; result == ESP_OK && queued < staged_data_count; queued++) {
+        result = spi_device_queue_trans(spi_device, &data_transactions[queued], portMAX_DELAY);
+    }
+    for (size_t i = 0; i < queued; i++) {
+        spi_transaction_t *done;
+        const esp_err_t collected = spi_device_get_trans_result(spi_device, &done, portMAX_DELAY);
+        if (result == ESP_OK) result = collected;
+    }
+
+    staged_command_count = 0;
+    staged_data_count = 0;
+    return result;
+}
+
+const OledTransport_t oled_transport_spi = {
+    .name = "spi",
+    .init = spi_transport_init,
+    .write_commands = spi_transport_write_commands,
+    .write_data = spi_transport_write_data,
+    .flush = spi_transport_flush,
+};
@@ -0,0 +1,188 @@
+#include "powerhandler.h"
+#include "oledhandler.h"
+#include "commands.h"
+#include "systemeventhandler.h"
+
+#include <esp_log.h>
+#include <esp_pm.h>
+#include <esp_timer.h>
+#include <stdio.h>
+
+#define MAX_CPU_FREQ_MHZ 240
+#define MIN_CPU_FREQ_MHZ 40 // XTAL, drivers hold an APB lock while they need 80 MHz
+#define DIM_CONTRAST 0x10
+
+// CONFIG_POWER_MEASUREMENT (Kconfig.projbuild) has the owner log power_log_report this often
+#define MEASUREMENT_INTERVAL_S 60
+
+static const char *TAG = "POWER";
+
+static const char *state_names[DISPLAY_POWER_STATE_COUNT] = {"on", "dim", "off"};
+
+static esp_timer_handle_t inactivity_timer;
+static uint64_t dim_after_us;
+static uint64_t off_after_us;
+static TaskHandle_t owner_task;
+static uint32_t owner_notify_bits;
+static int64_t idle_at_us; // end of the running countdown, 0 while none runs, only touched by the owner
+#if CONFIG_POWER_MEASUREMENT
+static volatile bool report_due;
+#endif
+
+static DisplayPowerState display_state = DISPLAY_POWER_ON;
+static int64_t state_since_us;
+static int64_t time_in_state_us[DISPLAY_POWER_STATE_COUNT];
+static portMUX_TYPE state_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// returns the previous state
+static DisplayPowerState enter_state(const DisplayPowerState state) {
+    const int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&state_mux);
+    const DisplayPowerState previous = display_state;
+    time_in_state_us[previous] += now - state_since_us;
+    state_since_us = now;
+    display_state = state;
+    taskEXIT_CRITICAL(&state_mux);
+
+    if (previous == state) return previous;
+
+    switch (state) {
+        case DISPLAY_POWER_ON:
+            if (previous == DISPLAY_POWER_OFF) {
+                set_display_enabled(true);
+                clear_event_bit(EVENT_BIT_DISPLAY_OFF);
+            }
+            set_display_contrast(DEFAULT_CONTRAST);
+            break;
+        case DISPLAY_POWER_DIM:
+            set_display_contrast(DIM_CONTRAST);
+            break;
+        case DISPLAY_POWER_OFF:
+            // stops the clock ticks, nothing wakes the CPU until a button is pressed
+            set_event_bit(EVENT_BIT_DISPLAY_OFF);
+            set_display_enabled(false);
+            break;
+        default:
+            break;
+    }
+
+    ESP_LOGI(TAG, "display %s", state_names[state]);
+    return previous;
+}
+
+// the panel calls can wait on the bus mutex, they would hold up every other esp_timer callback
+static void inactivity_timer_callback(void *arg) {
+    if (owner_task != NULL) {
+        xTaskNotify(owner_task, owner_notify_bits, eSetBits);
+    }
+}
+
+static void start_countdown(const uint64_t timeout_us) {
+    idle_at_us = esp_timer_get_time() + (int64_t) timeout_us;
+    esp_timer_start_once(inactivity_timer, timeout_us);
+}
+
+void power_set_owner(const TaskHandle_t owner, const uint32_t notify_bits) {
+    owner_task = owner;
+    owner_notify_bits = notify_bits;
+}
+
+bool power_report_activity(const bool is_working) {
+    esp_timer_stop(inactivity_timer);
+    idle_at_us = 0;
+
+    const DisplayPowerState previous = enter_state(DISPLAY_POWER_ON);
+
+    if (!is_working) {
+        start_countdown(dim_after_us);
+    }
+
+    return previous == DISPLAY_POWER_OFF;
+}
+
+void power_handle_idle(void) {
+#if CONFIG_POWER_MEASUREMENT
+    if (report_due) {
+        report_due = false;
+        power_log_report();
+    }
+#endif
+
+    if (idle_at_us == 0 || esp_timer_get_time() < idle_at_us) return;
+    idle_at_us = 0;
+
+    if (display_state == DISPLAY_POWER_ON) {
+        enter_state(DISPLAY_POWER_DIM);
+        start_countdown(off_after_us - dim_after_us);
+    } else if (display_state == DISPLAY_POWER_DIM) {
+        enter_state(DISPLAY_POWER_OFF);
+    }
+}
+
+void power_log_report(void) {
+    int64_t snapshot[DISPLAY_POWER_STATE_COUNT];
+    const int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&state_mux);
+    for (int i = 0; i < DISPLAY_POWER_STATE_COUNT; i++) {
+        snapshot[i] = time_in_state_us[i];
+    }
+    snapshot[display_state] += now - state_since_us;
+    taskEXIT_CRITICAL(&state_mux);
+
+    for (int i = 0; i < DISPLAY_POWER_STATE_COUNT; i++) {
+        ESP_LOGI(TAG, "display %-3s %8lld s (%lld%%)", state_names[i], (long long) (snapshot[i] / 1000000),
+                 (long long) (now > 0 ? snapshot[i] * 100 / now : 0));
+    }
+
+#if CONFIG_PM_PROFILING
+    // time per CPU mode: CPU_FREQ_MAX, APB_MAX, APB_MIN and LIGHT_SLEEP
+    esp_pm_dump_locks(stdout);
+#endif
+}
+
+#if CONFIG_POWER_MEASUREMENT
+// the report logs several lines and dumps the PM locks, the owner does that, not the esp_timer task
+static void measurement_timer_callback(void *arg) {
+    report_due = true;
+    if (owner_task != NULL) {
+        xTaskNotify(owner_task, owner_notify_bits, eSetBits);
+    }
+}
+#endif
+
+void init_power_handler(const uint32_t dim_after_s, const uint32_t off_after_s) {
+    dim_after_us = (uint64_t) dim_after_s * 1000000;
+    off_after_us = (uint64_t) (off_after_s > dim_after_s ? off_after_s : dim_after_s) * 1000000;
+    state_since_us = esp_timer_get_time();
+
+#if CONFIG_PM_ENABLE
+    const esp_pm_config_t pm_config = {
+        .max_freq_mhz = MAX_CPU_FREQ_MHZ,
+        .min_freq_mhz = MIN_CPU_FREQ_MHZ,
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        .light_sleep_enable = true,
+#endif
+    };
+    ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+#else
+    ESP_LOGW(TAG, "CONFIG_PM_ENABLE is off, running at full clock");
+#endif
+
+    const esp_timer_create_args_t inactivity_args = {
+        .callback = inactivity_timer_callback,
+        .name = "display_idle",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&inactivity_args, &inactivity_timer));
+
+#if CONFIG_POWER_MEASUREMENT
+    static esp_timer_handle_t measurement_timer;
+    const esp_timer_create_args_t measurement_args = {
+        .callback = measurement_timer_callback,
+        .name = "power_report",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&measurement_args, &measurement_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(measurement_timer, (uint64_t) MEASUREMENT_INTERVAL_S * 1000000));
+#endif
+}
@@ -0,0 +1,36 @@
+#ifndef POWERHANDLER_H
+#define POWERHANDLER_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+    DISPLAY_POWER_ON,
+    DISPLAY_POWER_DIM,
+    DISPLAY_POWER_OFF,
+    DISPLAY_POWER_STATE_COUNT,
+} DisplayPowerState;
+
+// enable DFS + tickless light sleep and set the display inactivity timeouts while pausing
+void init_power_handler(uint32_t dim_after_s, uint32_t off_after_s);
+
+// The countdown only notifies owner with notify_bits (eSetBits), the panel is dimmed and switched off
+// by owner calling power_handle_idle, never from the esp_timer task. All calls below are owner only.
+void power_set_owner(TaskHandle_t owner, uint32_t notify_bits);
+
+// a button was used, wakes the display and restarts the countdown (only runs while pausing)
+// returns true if the display was off, the caller has to restart its clock ticks
+bool power_report_activity(bool is_working);
+
+// the countdown ran out: dim, or switch off if already dimmed. Ignores notifications made stale
+// by activity reported after the countdown fired. With CONFIG_POWER_MEASUREMENT the owner is also
+// notified once a minute, the report that is due then is logged here.
+void power_handle_idle(void);
+
+// log time spent per display power state and, with CONFIG_PM_PROFILING, per CPU power mode.
+// Any task, the console power command calls it.
+void power_log_report(void);
+
+#endif
@@ -0,0 +1,54 @@
+#include "timetracker_clock.h"
+
+#define HOUR_TENS 0
+#define HOUR_ONES 1
+#define MINUTE_TENS 3
+#define MINUTE_ONES 4
+#define SECOND_TENS 6
+#define SECOND_ONES 7
+
+char *put_two_digits(char *dst, const uint32_t value) {
+    dst[0] = (char) ('0' + value / 10 % 10);
+    dst[1] = (char) ('0' + value % 10);
+    return dst + 2;
+}
+
+void time_register_set(TimeRegister_t *reg, const uint32_t hours, const uint32_t minutes, const uint32_t seconds) {
+    char *pos = put_two_digits(reg->text, hours % reg->hour_modulo);
+    *pos++ = ':';
+    pos = put_two_digits(pos, minutes);
+    *pos++ = ':';
+    pos = put_two_digits(pos, seconds);
+    *pos = '\0';
+}
+
+void time_register_set_seconds(TimeRegister_t *reg, const uint32_t total_seconds) {
+    time_register_set(reg, total_seconds / 3600, total_seconds % 3600 / 60, total_seconds % 60);
+}
+
+// increment a two digit field, returns true if it wrapped at limit
+static bool tick_field(char *tens, char *ones, const uint8_t limit) {
+    if (*ones != '9' && (*tens - '0') * 10 + (*ones - '0') + 1 < limit) {
+        (*ones)++;
+        return false;
+    }
+
+    if ((*tens - '0') * 10 + (*ones - '0') + 1 >= limit) {
+        *tens = '0';
+        *ones = '0';
+        return true;
+    }
+
+    *ones = '0';
+    (*tens)++;
+    return false;
+}
+
+bool time_register_tick(TimeRegister_t *reg) {
+    char *t = reg->text;
+
+    if (!tick_field(&t[SECOND_TENS], &t[SECOND_ONES], 60)) return false;
+    if (!tick_field(&t[MINUTE_TENS], &t[MINUTE_ONES], 60)) return true;
+    tick_field(&t[HOUR_TENS], &t[HOUR_ONES], reg->hour_modulo);
+    return true;
+}
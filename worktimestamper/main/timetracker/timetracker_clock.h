@@ -0,0 +1,27 @@
+#ifndef TIMETRACKER_CLOCK_H
+#define TIMETRACKER_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TIME_REGISTER_LENGTH 8
+
+// "HH:MM:SS" kept as digits, advanced in place without any formatting
+typedef struct {
+    char text[TIME_REGISTER_LENGTH + 1];
+    uint8_t hour_modulo; // 24 for the wall clock, 100 for durations
+} TimeRegister_t;
+
+// Load all digits, e.g. after a wall clock resync
+void time_register_set(TimeRegister_t *reg, uint32_t hours, uint32_t minutes, uint32_t seconds);
+
+// Load all digits from a duration in seconds
+void time_register_set_seconds(TimeRegister_t *reg, uint32_t total_seconds);
+
+// Advance by one second, returns true if the minute rolled over
+bool time_register_tick(TimeRegister_t *reg);
+
+// Write two decimal digits, returns the position behind them
+char *put_two_digits(char *dst, uint32_t value);
+
+#endif
@@ -1,96 +1,262 @@
 #include <oledhandler.h>
 #include "systemeventhandler.h"
+#include "buttonisrhandler.h"
 #include "timetracker_logic.h"
 #include "timetracker_display.h"
+#include "timetracker_journal.h"
+#include "timetracker_snapshot.h"
+#include "powerhandler.h"
+#include "tracehandler.h"
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <sys/time.h>
 #include <time.h>
 
-static void clock_task(void *arg);
+// wake up this much after the second boundary, so time() already reports the new second
+#define TICK_MARGIN_US 2000
 
-static void button1_task(void *arg);
+// work for the event loop, set bits are never lost and the input ring keeps every single press
+typedef enum {
+    TRACKER_NOTIFY_INPUT = BIT0,
+    TRACKER_NOTIFY_TICK = BIT1,
+    TRACKER_NOTIFY_TIME_SYNCED = BIT2,
+    TRACKER_NOTIFY_BOOT = BIT3,
+    TRACKER_NOTIFY_IDLE = BIT4, // the display inactivity countdown ran out
+} TrackerNotifyBit;
 
-static void button2_task(void *arg);
+typedef enum {
+    TRACKER_PHASE_STARTING, // until the journal is replayed
+    TRACKER_PHASE_TUTORIAL,
+    TRACKER_PHASE_TRACKING,
+} TrackerPhase;
 
-void timetracker_start(const uint8_t base_priority) {
-    static TimeTrackerState tracker_state = {0};
+static void event_loop_task(void *arg);
+
+// everything below is only touched by the event loop task
+static TaskHandle_t event_loop_handle;
+static esp_timer_handle_t clock_timer;
+static TimeTrackerState tracker_state;
+static TrackerPhase phase = TRACKER_PHASE_STARTING;
+static int64_t unsynced_clock_base_us; // wall clock minus esp_timer before SNTP set the clock
+
+static const ButtonConfig_t button_configs[BUTTON_COUNT] = {
+    [BUTTON_1] = BUTTON_CONFIG_DEFAULT(GPIO_BUTTON_1),
+    [BUTTON_2] = BUTTON_CONFIG_DEFAULT(GPIO_BUTTON_2),
+};
+
+static void clock_timer_callback(void *arg) {
+    xTaskNotify(event_loop_handle, TRACKER_NOTIFY_TICK, eSetBits);
+}
+
+// wall clock minus the monotonic esp_timer, only moves when the clock is set
+static int64_t clock_base_us(void) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_usec - esp_timer_get_time();
+}
+
+// wall clock time of an esp_timer timestamp, e.g. the capture time of a button edge
+static time_t wall_time_of(const int64_t at_us) {
+    return (time_t) ((clock_base_us() + at_us) / 1000000);
+}
+
+// The RTC keeps the time over a software reset. After a power loss the newest
+// journaled stamp is the best guess until SNTP answers.
+static void seed_clock(void) {
+    struct tm time_info;
+    const time_t now = time(NULL);
+    localtime_r(&now, &time_info);
+
+    time_t newest;
+    if (time_info.tm_year >= 2020 - 1900 || !journal_newest_stamp(&newest)) return;
+
+    const struct timeval seeded = {.tv_sec = newest};
+    settimeofday(&seeded, NULL);
+}
+
+// called by the Wi-Fi sync task once SNTP has set the clock
+void timetracker_time_synced(void) {
+    xTaskNotify(event_loop_handle, TRACKER_NOTIFY_TIME_SYNCED, eSetBits);
+}
+
+void timetracker_start(const uint8_t priority) {
     init_timetracker_state(&tracker_state);
+    init_state_snapshot();
 
-    // Wait for the system to be ready (e.g., Wi-Fi sync complete)
-    wait_for_state(EVENT_BIT_WIFI_HANDLER_DONE);
-    vTaskDelay(pdMS_TO_TICKS(1000));
+    const esp_timer_create_args_t timer_args = {
+        .callback = clock_timer_callback,
+        .name = "clock_tick",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &clock_timer));
 
-    clear_display();
-    vTaskDelay(pdMS_TO_TICKS(100));
+    // nothing waits for Wi-Fi, the time sync arrives later through timetracker_time_synced
+    xTaskCreate(event_loop_task, "tracker_loop", 4096, NULL, priority, &event_loop_handle);
+    xTaskNotify(event_loop_handle, TRACKER_NOTIFY_BOOT, eSetBits);
+    power_set_owner(event_loop_handle, TRACKER_NOTIFY_IDLE);
+    init_button_isr_handler(button_configs, event_loop_handle, TRACKER_NOTIFY_INPUT);
+}
+
+static void schedule_next_tick(void) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    esp_timer_start_once(clock_timer, 1000000 - now.tv_usec + TICK_MARGIN_US);
+}
+
+static void on_tick(void) {
+    // no timer is armed while another view owns the screen or the panel is off,
+    // resume_clock_ticks restarts the chain
+    if (phase != TRACKER_PHASE_TRACKING || event_bit_is_set(EVENT_BIT_DISPLAY_OFF)) return;
+
+    TimeTrackerSnapshot snapshot;
+    state_read(&snapshot);
 
-    display_tutorial();
+    const time_t now = time(NULL);
+    if (snapshot.is_working && now >= snapshot.totals.day_end) {
+        state_write_begin();
+        roll_over_day(&tracker_state, now);
+        state_write_end(&tracker_state);
+        state_read(&snapshot);
+    }
 
-    // Start core tasks
-    xTaskCreate(clock_task, "clock_task", 4096, &tracker_state, base_priority, NULL);
-    xTaskCreate(button1_task, "button1_task", 4096, &tracker_state, base_priority + 1, NULL);
-    xTaskCreate(button2_task, "button2_task", 4096, &tracker_state, base_priority + 2, NULL);
+    display_refresh(&snapshot);
+    schedule_next_tick();
 }
 
-static void clock_task(void *arg) {
-    const TimeTrackerState *state = arg;
-    int last_second = -1;
+// render right away and re-arm the second-aligned tick
+static void resume_clock_ticks(void) {
+    esp_timer_stop(clock_timer);
+    on_tick();
+}
 
-    // ReSharper disable once CppDFAEndlessLoop
-    while (1) {
-        if (event_bit_is_set(EVENT_BIT_TUTORIAL_ACTIVE)) {
-            vTaskDelay(pdMS_TO_TICKS(100));
-            continue;
-        }
+static void start_tracking(void) {
+    phase = TRACKER_PHASE_TRACKING;
+    power_report_activity(tracker_state.is_working);
+    resume_clock_ticks();
+}
 
-        time_t now;
-        struct tm time_info;
-        time(&now);
-        localtime_r(&now, &time_info);
+static void on_boot(void) {
+    // rebuild the session history after a brownout, panic or watchdog reset
+    init_journal();
+    seed_clock();
+    unsynced_clock_base_us = clock_base_us();
 
-        if (time_info.tm_sec != last_second) {
-            last_second = time_info.tm_sec;
-            display_clock(&time_info, state->is_working);
+    state_write_begin();
+    const bool restored = journal_replay(&tracker_state) > 0;
+    state_write_end(&tracker_state);
 
-            if (!state->is_summary_mode) {
-                display_working(state);
-            }
-        }
+    clear_display();
 
-        vTaskDelay(pdMS_TO_TICKS(100));
+    if (restored) {
+        start_tracking();
+    } else {
+        display_tutorial();
+        phase = TRACKER_PHASE_TUTORIAL;
     }
 }
 
-static void button1_task(void *arg) {
-    TimeTrackerState *state = arg;
+// stamps taken so far carry the unsynced clock, the journal gets one correction and the state is rebuilt
+static void on_time_synced(void) {
+    const int64_t offset_us = clock_base_us() - unsynced_clock_base_us;
+    const int32_t offset = (int32_t) ((offset_us + (offset_us >= 0 ? 500000 : -500000)) / 1000000);
 
-    // ReSharper disable once CppDFAEndlessLoop
-    while (1) {
-        wait_for_state(EVENT_BIT_BUTTON_1_PRESSED);
+    state_write_begin();
+    const esp_err_t corrected = journal_append_correction(offset);
+    if (corrected == ESP_OK) {
+        // the rebuild only replaces what the journal holds, view and overtime target stay
+        const bool summary_mode = tracker_state.is_summary_mode;
+        const uint32_t daily_target = tracker_state.totals.daily_target;
+        init_timetracker_state(&tracker_state);
+        tracker_state.totals.daily_target = daily_target;
+        journal_replay(&tracker_state);
+        tracker_state.is_summary_mode = summary_mode;
+    } else if (corrected != ESP_ERR_NOT_FOUND) {
+        ESP_LOGW("TIMETRACKER", "unsynced stamps not corrected: %s", esp_err_to_name(corrected));
+    }
+    tracker_state.time_synced = true;
+    state_write_end(&tracker_state);
 
-        if (!state->is_summary_mode && handle_stamp(state)) {
-            display_working(state);
-        }
+    ESP_LOGI("TIMETRACKER", "clock synced, offset %ld s", (long) offset);
+
+    if (phase == TRACKER_PHASE_TRACKING) {
+        resume_clock_ticks();
+    }
+}
+
+static void on_button_pressed(const Button button, const time_t pressed_at) {
+    if (phase == TRACKER_PHASE_TUTORIAL) {
+        if (button != BUTTON_1) return;
+
+        clear_display();
+        start_tracking();
+        return;
+    }
+
+    bool changed = true;
+    state_write_begin();
+    if (button == BUTTON_1) {
+        changed = !tracker_state.is_summary_mode && handle_stamp(&tracker_state, pressed_at);
+        TRACE(TRACE_EVENT_STAMP, changed);
+    } else {
+        tracker_state.is_summary_mode = !tracker_state.is_summary_mode;
+    }
+    state_write_end(&tracker_state);
+
+    if (power_report_activity(tracker_state.is_working)) {
+        resume_clock_ticks();
+    } else if (changed) {
+        TimeTrackerSnapshot snapshot;
+        state_read(&snapshot);
+        display_refresh(&snapshot);
+    }
+}
+
+static void on_button_event(const ButtonEvent_t *event) {
+    TRACE(TRACE_EVENT_BUTTON, event->button << 8 | event->type);
+
+    // stamps and view switches act on the press itself, the other gestures are not bound yet
+    if (event->type != BUTTON_EVENT_PRESS) {
+        ESP_LOGD("TIMETRACKER", "button %d gesture %d", event->button, event->type);
+        return;
+    }
+
+    button_record_latency(event);
+
+    if (phase != TRACKER_PHASE_STARTING) {
+        TRACE_PRESS_BEGIN(event->edge_us);
+        on_button_pressed(event->button, wall_time_of(event->edge_us));
+        TRACE_PRESS_END();
     }
 }
 
-static void button2_task(void *arg) {
-    TimeTrackerState *state = arg;
+// Pending work is handled in a fixed order: boot, sync, then every queued input, the display
+// countdown, then the tick. A stamp pressed before a tick is always applied before that tick renders,
+// a press in the same round as the countdown keeps the display on.
+static void event_loop_task(void *arg) {
+    uint32_t pending;
+    ButtonEvent_t event;
 
     // ReSharper disable once CppDFAEndlessLoop
     while (1) {
-        wait_for_state(EVENT_BIT_BUTTON_2_PRESSED);
+        xTaskNotifyWait(0, UINT32_MAX, &pending, portMAX_DELAY);
 
-        if (event_bit_is_set(EVENT_BIT_TUTORIAL_ACTIVE)) {
-            vTaskDelay(pdMS_TO_TICKS(100));
-            continue;
+        if (pending & TRACKER_NOTIFY_BOOT) {
+            on_boot();
         }
-
-        state->is_summary_mode = !state->is_summary_mode;
-
-        if (state->is_summary_mode) {
-            display_summary(state);
-        } else {
-            display_working(state);
+        if (pending & TRACKER_NOTIFY_TIME_SYNCED) {
+            on_time_synced();
+        }
+        if (pending & TRACKER_NOTIFY_INPUT) {
+            while (button_read_event(&event)) {
+                on_button_event(&event);
+            }
+        }
+        if (pending & TRACKER_NOTIFY_IDLE) {
+            power_handle_idle();
+        }
+        if (pending & TRACKER_NOTIFY_TICK) {
+            on_tick();
         }
     }
 }
@@ -2,140 +2,156 @@
 
 #include <esp_log.h>
 
-#include "timetracker_logic.h"
+#include "timetracker_totals.h"
+#include "timetracker_clock.h"
 #include "oledhandler.h"
 
-#include <stdio.h>
+#include <assert.h>
 #include <string.h>
-#include <systemeventhandler.h>
 
 #define HEADER_ROW 0
 #define LATEST_CHECKOUT_ROW 6
 #define NET_WORK_TIME_OW 7
 #define SUMMARY_HEADER_ROW 1
+#define FIRST_SESSION_ROW 2
+#define TOTALS_ROW 7
+
+#define HEADER_STATUS_COLUMN 13
+#define HEADER_UNSYNCED_COLUMN 9
+#define NET_WORK_LABEL "net work: "
+#define SESSION_TEMPLATE "--:-- | --:-- |--:--"
+#define TOTALS_TEMPLATE "wk ---:--  mo ---:--"
 
 #define TIME_STRING_SIZE (sizeof("00:00:00"))
-#define NET_WORK_STRING_SIZE (sizeof("net work: 00:00:00"))
-#define EMPTY_TIME_STRING_SIZE (sizeof("--:-- | --:-- |--:--"))
+#define NET_WORK_STRING_SIZE (sizeof(NET_WORK_LABEL "00:00:00"))
+#define EMPTY_TIME_STRING_SIZE (sizeof(SESSION_TEMPLATE))
 
-static_assert(TIME_STRING_SIZE == 9, "Buffer size must be 19 bytes");
+static_assert(TIME_STRING_SIZE == TIME_REGISTER_LENGTH + 1, "Buffer size must be 9 bytes");
 static_assert(NET_WORK_STRING_SIZE == 19, "Buffer size must be 19 bytes");
-static_assert(EMPTY_TIME_STRING_SIZE == 21, "Buffer size must be 19 bytes");
-
-void display_clock(const struct tm *time_info, const bool is_working) {
-    char time_buf[21];
-    snprintf(time_buf, sizeof(time_buf), "%02d:%02d:%02d     %s",
-             time_info->tm_hour,
-             time_info->tm_min,
-             time_info->tm_sec,
-             is_working ? "working" : "pausing");
+static_assert(EMPTY_TIME_STRING_SIZE == 21, "Buffer size must be 21 bytes");
+static_assert(sizeof(TOTALS_TEMPLATE) == 21, "Buffer size must be 21 bytes");
+static_assert(FIRST_SESSION_ROW + SNAPSHOT_SESSIONS <= TOTALS_ROW, "shown sessions must fit above the totals");
 
-    send_text_at_row(time_buf, HEADER_ROW);
-}
+// digits shown on screen, advanced once per second and resynced on minute boundaries
+static TimeRegister_t clock_register = {.hour_modulo = 24};
+static TimeRegister_t work_register = {.hour_modulo = 100};
+static time_t rendered_second;
+static bool rendered_working;
 
-void display_working(const TimeTrackerState *state) {
-    time_t now;
+static void resync_registers(const TimeTrackerSnapshot *state, const time_t now) {
     struct tm time_info;
-    time(&now);
     localtime_r(&now, &time_info);
+    time_register_set(&clock_register, time_info.tm_hour, time_info.tm_min, time_info.tm_sec);
+    time_register_set_seconds(&work_register, (uint32_t) totals_day_seconds(&state->totals, state->is_working, now));
+}
 
-    char time_buf[21];
-    snprintf(time_buf, sizeof(time_buf), "%02d:%02d:%02d     %s",
-             time_info.tm_hour,
-             time_info.tm_min,
-             time_info.tm_sec,
-             state->is_working ? "working" : "pausing");
+// the wall clock goes back to localtime_r once a minute, which also picks up DST switches
+static void advance_registers(const TimeTrackerSnapshot *state, const time_t now) {
+    if (now == rendered_second && state->is_working == rendered_working) return;
 
-    send_text_at_row(time_buf, HEADER_ROW);
+    if (now == rendered_second + 1 && state->is_working == rendered_working) {
+        const bool minute_passed = time_register_tick(&clock_register);
+        if (state->is_working) {
+            time_register_tick(&work_register);
+        }
+        if (minute_passed) {
+            resync_registers(state, now);
+        }
+    } else {
+        resync_registers(state, now);
+    }
 
-    const time_t work_time = calculate_work_time(state);
-    const int h = (int) work_time / 3600;
-    const int m = (int) (work_time % 3600) / 60;
-    const int s = (int) work_time % 60;
+    rendered_second = now;
+    rendered_working = state->is_working;
+}
 
-    char temp[64];
-    const int len = snprintf(temp, sizeof(temp), "net work: %02d:%02d:%02d", h, m, s);
+static void render_header(DisplayFrame_t *frame, const TimeTrackerSnapshot *state, const char *status) {
+    char *row = frame->rows[HEADER_ROW];
+    memcpy(row, clock_register.text, TIME_REGISTER_LENGTH);
+    memcpy(row + HEADER_STATUS_COLUMN, status, strlen(status));
 
-    char buffer[NET_WORK_STRING_SIZE];
-    if (len >= sizeof(buffer)) {
-        memcpy(buffer, temp, sizeof(buffer) - 1);
-        buffer[sizeof(buffer) - 1] = '\0';
-    } else {
-        strcpy(buffer, temp);
+    // the clock still runs from the RTC or the last journaled stamp
+    if (!state->time_synced) {
+        row[HEADER_UNSYNCED_COLUMN] = '?';
     }
+}
 
-    send_text_at_row(buffer, NET_WORK_TIME_OW);
+static void render_working(DisplayFrame_t *frame, const TimeTrackerSnapshot *state) {
+    render_header(frame, state, state->is_working ? "working" : "pausing");
 
-    // Clear summary rows (only needed in this view)
-    for (int i = 0; i < 5; i++) {
-        send_text_at_row("                    ", SUMMARY_HEADER_ROW + i);
-    }
+    char *row = frame->rows[NET_WORK_TIME_OW];
+    memcpy(row, NET_WORK_LABEL, sizeof(NET_WORK_LABEL) - 1);
+    memcpy(row + sizeof(NET_WORK_LABEL) - 1, work_register.text, TIME_REGISTER_LENGTH);
 }
 
-void display_summary(const TimeTrackerState *state) {
-    time_t now;
+static void render_hour_minute(char *dst, const time_t timestamp) {
     struct tm time_info;
-    time(&now);
-    localtime_r(&now, &time_info);
+    localtime_r(&timestamp, &time_info);
+    put_two_digits(dst, time_info.tm_hour);
+    put_two_digits(dst + 3, time_info.tm_min);
+}
+
+// "HHH:MM", up to 999 hours
+static void render_hours_minutes(char *dst, const uint32_t seconds) {
+    const uint32_t hours = seconds / 3600;
+    dst[0] = (char) ('0' + hours / 100 % 10);
+    put_two_digits(dst + 1, hours);
+    dst[3] = ':';
+    put_two_digits(dst + 4, seconds % 3600 / 60);
+}
 
-    char time_buf[21];
-    snprintf(time_buf, sizeof(time_buf), "%02d:%02d:%02d     summary",
-             time_info.tm_hour,
-             time_info.tm_min,
-             time_info.tm_sec);
+static void render_summary(DisplayFrame_t *frame, const TimeTrackerSnapshot *state, const time_t now) {
+    render_header(frame, state, "summary");
+    strcpy(frame->rows[SUMMARY_HEADER_ROW], "start |  end  | net ");
 
-    send_text_at_row(time_buf, HEADER_ROW);
-    send_text_at_row("start |  end  | net ", SUMMARY_HEADER_ROW);
+    // the snapshot holds the latest sessions of its day, after midnight they belong to yesterday
+    const int count = now < state->totals.day_end ? state->session_count : 0;
 
-    for (int i = 0; i < MAX_SESSIONS; i++) {
+    for (int i = 0; i < count; i++) {
         const WorkTimeSession *s = &state->sessions[i];
-        if (s->start_time == 0) continue;
-
-        char buffer[EMPTY_TIME_STRING_SIZE];
 
-        struct tm start_tm;
-        localtime_r(&s->start_time, &start_tm);
+        // "HH:MM | HH:MM |HH:MM", end and duration stay dashed while the session is open
+        char *row = frame->rows[FIRST_SESSION_ROW + i];
+        memcpy(row, SESSION_TEMPLATE, sizeof(SESSION_TEMPLATE));
+        render_hour_minute(row, s->start_time);
 
-        if (s->end_time == 0) {
-            snprintf(buffer, sizeof(buffer), "%02d:%02d | --:-- |--:--",
-                     start_tm.tm_hour, start_tm.tm_min);
-        } else {
-            struct tm end_tm;
-            localtime_r(&s->end_time, &end_tm);
+        if (s->end_time != 0) {
             const time_t dur = s->end_time - s->start_time;
-            const int dh = (int) (dur / 3600);
-            const int dm = (int) ((dur % 3600) / 60);
-
-            char temp[64];
-            const int len = snprintf(temp, sizeof(temp),
-                                     "%02d:%02d | %02d:%02d |%02d:%02d",
-                                     start_tm.tm_hour,
-                                     start_tm.tm_min,
-                                     end_tm.tm_hour,
-                                     end_tm.tm_min,
-                                     dh,
-                                     dm);
-
-            if (len >= sizeof(buffer)) {
-                memcpy(buffer, temp, sizeof(buffer) - 1);
-                buffer[sizeof(buffer) - 1] = '\0';
-            } else {
-                strcpy(buffer, temp);
-            }
+            render_hour_minute(row + 8, s->end_time);
+            put_two_digits(row + 15, (uint32_t) (dur / 3600));
+            put_two_digits(row + 18, (uint32_t) (dur % 3600 / 60));
         }
+    }
+
+    WorkTotalsReport totals;
+    totals_report(&state->totals, state->is_working, now, &totals);
+
+    char *row = frame->rows[TOTALS_ROW];
+    memcpy(row, TOTALS_TEMPLATE, sizeof(TOTALS_TEMPLATE));
+    render_hours_minutes(row + 3, totals.week);
+    render_hours_minutes(row + 14, totals.month);
+}
 
-        send_text_at_row(buffer, i + 2);
+void display_refresh(const TimeTrackerSnapshot *state) {
+    time_t now;
+    time(&now);
+    advance_registers(state, now);
+
+    DisplayFrame_t frame;
+    clear_frame(&frame);
+
+    if (state->is_summary_mode) {
+        render_summary(&frame, state, now);
+    } else {
+        render_working(&frame, state);
     }
 
-    // Clear net row
-    send_text_at_row("                    ", NET_WORK_TIME_OW);
+    send_frame(&frame);
 }
 
 void display_tutorial(void) {
-    set_event_bit(EVENT_BIT_TUTORIAL_ACTIVE);
-
     const char *page[] = {
-        "----time synched----",
+        "---- timetracker ---",
         "--main program rdy--",
         "                    ",
         " left btn:   stamp  ",
@@ -146,10 +162,4 @@ void display_tutorial(void) {
     };
 
     send_page_20x8(page);
-
-    wait_for_state(EVENT_BIT_BUTTON_1_PRESSED);
-
-    clear_event_bit(EVENT_BIT_TUTORIAL_ACTIVE);
-    clear_display();
-    vTaskDelay(pdMS_TO_TICKS(300));
 }
@@ -1,17 +1,11 @@
 #ifndef TIMETRACKER_DISPLAY_H
 #define TIMETRACKER_DISPLAY_H
 
-#include "timetracker_state.h"
+#include "timetracker_snapshot.h"
 
-// Show header and net work time
-void display_working(const TimeTrackerState *state);
+// Compose the view of the current mode (header + net work time or session table) and commit it as one frame
+void display_refresh(const TimeTrackerSnapshot *state);
 
-// Show table summary of all sessions
-void display_summary(const TimeTrackerState *state);
-
-// Show current time (HH:MM:SS) at top row
-void display_clock(const struct tm *time_info, bool is_working);
-
-// show tutorial
+// show tutorial, it stays until the next frame replaces it
 void display_tutorial(void);
 #endif
\ No newline at end of file
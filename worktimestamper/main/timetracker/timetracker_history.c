@@ -0,0 +1,157 @@
+#include "timetracker_history.h"
+
+#include <string.h>
+
+#define DAY_HEADER_SIZE 3
+#define BOUNDARY_SIZE 3
+
+// proleptic gregorian date <-> days since 1970-01-01
+static int32_t days_from_civil(int32_t year, const uint32_t month, const uint32_t mday) {
+    year -= month <= 2;
+    const int32_t era = (year >= 0 ? year : year - 399) / 400;
+    const uint32_t yoe = (uint32_t) (year - era * 400);
+    const uint32_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + mday - 1;
+    const uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int32_t) doe - 719468;
+}
+
+static void civil_from_days(int32_t days, struct tm *date) {
+    days += 719468;
+    const int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const uint32_t doe = (uint32_t) (days - era * 146097);
+    const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const uint32_t mp = (5 * doy + 2) / 153;
+    const uint32_t month = mp < 10 ? mp + 3 : mp - 9;
+
+    date->tm_year = (int) yoe + era * 400 + (month <= 2) - 1900;
+    date->tm_mon = (int) month - 1;
+    date->tm_mday = (int) (doy - (153 * mp + 2) / 5 + 1);
+}
+
+uint16_t history_day_of(const time_t timestamp) {
+    struct tm time_info;
+    localtime_r(&timestamp, &time_info);
+    return (uint16_t) days_from_civil(time_info.tm_year + 1900, time_info.tm_mon + 1, time_info.tm_mday);
+}
+
+time_t history_day_start(const uint16_t day) {
+    struct tm midnight = {.tm_isdst = -1};
+    civil_from_days(day, &midnight);
+    return mktime(&midnight);
+}
+
+static uint16_t read_day(const uint8_t *header) {
+    return header[0] | header[1] << 8;
+}
+
+static uint32_t read_boundary(const uint8_t *boundary) {
+    return boundary[0] | boundary[1] << 8 | (uint32_t) boundary[2] << 16;
+}
+
+static void write_boundary(uint8_t *boundary, const uint32_t seconds) {
+    boundary[0] = seconds & 0xFF;
+    boundary[1] = seconds >> 8 & 0xFF;
+    boundary[2] = seconds >> 16 & 0xFF;
+}
+
+static uint16_t day_size(const uint8_t *header) {
+    return DAY_HEADER_SIZE + header[2] * BOUNDARY_SIZE;
+}
+
+void history_init(SessionHistory *history) {
+    history->used = 0;
+    history->last_day_offset = 0;
+}
+
+// drop the oldest days until size bytes are free, the newest day is never dropped
+static bool make_room(SessionHistory *history, const uint16_t size) {
+    while (history->used + size > HISTORY_CAPACITY) {
+        if (history->used == 0 || history->last_day_offset == 0) return false;
+
+        const uint16_t oldest = day_size(history->data);
+        memmove(history->data, history->data + oldest, history->used - oldest);
+        history->used -= oldest;
+        history->last_day_offset -= oldest;
+    }
+    return true;
+}
+
+static void fill_day(const SessionHistory *history, const uint16_t offset, HistoryDay *day) {
+    const uint8_t *header = history->data + offset;
+    day->day = read_day(header);
+    day->count = header[2];
+    day->start = history_day_start(day->day);
+    day->boundaries = header + DAY_HEADER_SIZE;
+}
+
+static bool append_to_last_day(SessionHistory *history, const uint32_t seconds) {
+    uint8_t *header = history->data + history->last_day_offset;
+    if (header[2] == HISTORY_MAX_BOUNDARIES) return false;
+    if (header[2] > 0 && read_boundary(header + day_size(header) - BOUNDARY_SIZE) > seconds) return false;
+    if (!make_room(history, BOUNDARY_SIZE)) return false;
+
+    // make_room may have moved the day
+    header = history->data + history->last_day_offset;
+    write_boundary(history->data + history->used, seconds);
+    history->used += BOUNDARY_SIZE;
+    header[2]++;
+    return true;
+}
+
+bool history_add_boundary(SessionHistory *history, const time_t timestamp) {
+    const uint16_t day = history_day_of(timestamp);
+    const uint32_t seconds = (uint32_t) (timestamp - history_day_start(day));
+
+    if (history->used > 0) {
+        const uint16_t last = read_day(history->data + history->last_day_offset);
+        if (day < last) return false;
+        if (day == last) return append_to_last_day(history, seconds);
+    }
+
+    if (!make_room(history, DAY_HEADER_SIZE + BOUNDARY_SIZE)) return false;
+
+    uint8_t *header = history->data + history->used;
+    header[0] = day & 0xFF;
+    header[1] = day >> 8;
+    header[2] = 1;
+    write_boundary(header + DAY_HEADER_SIZE, seconds);
+
+    history->last_day_offset = history->used;
+    history->used += DAY_HEADER_SIZE + BOUNDARY_SIZE;
+    return true;
+}
+
+bool history_close_day(SessionHistory *history) {
+    HistoryDay last;
+    if (!history_last_day(history, &last) || last.count % 2 == 0) return false;
+
+    // 23, 24 or 25 hours depending on DST
+    const time_t length = history_day_start(last.day + 1) - last.start;
+    return append_to_last_day(history, (uint32_t) length);
+}
+
+bool history_next_day(const SessionHistory *history, uint16_t *cursor, HistoryDay *day) {
+    if (*cursor >= history->used) return false;
+
+    fill_day(history, *cursor, day);
+    *cursor += day_size(history->data + *cursor);
+    return true;
+}
+
+bool history_last_day(const SessionHistory *history, HistoryDay *day) {
+    if (history->used == 0) return false;
+
+    fill_day(history, history->last_day_offset, day);
+    return true;
+}
+
+time_t history_newest_boundary(const SessionHistory *history) {
+    HistoryDay last;
+    if (!history_last_day(history, &last)) return 0;
+    return last.start + history_boundary(&last, last.count - 1);
+}
+
+uint32_t history_boundary(const HistoryDay *day, const int index) {
+    return read_boundary(day->boundaries + index * BOUNDARY_SIZE);
+}
@@ -0,0 +1,55 @@
+#ifndef TIMETRACKER_HISTORY_H
+#define TIMETRACKER_HISTORY_H
+
+#include <time.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// a normal day (header + 2 sessions) takes 15 bytes, so this holds roughly nine months
+#define HISTORY_CAPACITY 4096
+#define HISTORY_MAX_BOUNDARIES 255
+
+// Days are stored back to back: [day:2][count:1] followed by count boundaries of 3 bytes,
+// each the seconds since local midnight of that day. Boundaries alternate start/end,
+// an odd count means the last session is still open. When full, the oldest day is dropped.
+typedef struct {
+    uint8_t data[HISTORY_CAPACITY];
+    uint16_t used;
+    uint16_t last_day_offset; // header of the newest day, valid if used > 0
+} SessionHistory;
+
+typedef struct {
+    uint16_t day; // local days since 1970-01-01
+    uint8_t count;
+    time_t start; // local midnight
+    const uint8_t *boundaries;
+} HistoryDay;
+
+void history_init(SessionHistory *history);
+
+// local day number of timestamp
+uint16_t history_day_of(time_t timestamp);
+
+// local midnight of day, DST aware
+time_t history_day_start(uint16_t day);
+
+// Append a session boundary, starts a new day record on the first boundary of a day.
+// Returns false for timestamps before the newest stored boundary.
+bool history_add_boundary(SessionHistory *history, time_t timestamp);
+
+// End the open session of the newest day at its midnight, returns false if none is open
+bool history_close_day(SessionHistory *history);
+
+// Iterate days from oldest to newest, start with *cursor = 0
+bool history_next_day(const SessionHistory *history, uint16_t *cursor, HistoryDay *day);
+
+// Newest stored day, false if the history is empty
+bool history_last_day(const SessionHistory *history, HistoryDay *day);
+
+// Time of the newest stored boundary, 0 if the history is empty
+time_t history_newest_boundary(const SessionHistory *history);
+
+// Seconds since day->start of boundary index
+uint32_t history_boundary(const HistoryDay *day, int index);
+
+#endif
@@ -0,0 +1,368 @@
+#include "timetracker_journal.h"
+#include "timetracker_logic.h"
+
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+#include <assert.h>
+#include <string.h>
+
+#define JOURNAL_PARTITION_LABEL "journal"
+#define JOURNAL_SECTOR_SIZE 4096
+#define JOURNAL_MAX_SECTORS 16
+#define RECORD_MAGIC 0x4A53
+#define RECORD_TYPE_START 2
+#define RECORD_TYPE_END 3
+#define RECORD_TYPE_START_UNSYNCED 4 // taken before SNTP answered, waits for a correction
+#define RECORD_TYPE_END_UNSYNCED 5
+#define RECORD_TYPE_CORRECTION 6
+#define REPLAY_CHUNK 32
+#define REPLAY_MAX_PENDING 64
+
+// 16 bytes: aligned to the flash write granularity, so a record is one program operation
+typedef struct {
+    uint16_t magic;
+    uint8_t type;
+    uint8_t crc; // crc8 over the record with this field zeroed, a torn record never validates
+    uint32_t sequence;
+    union {
+        int64_t timestamp;
+        struct {
+            int32_t offset; // seconds to add to the unsynced stamps
+            uint32_t first_sequence; // oldest unsynced record covered
+        } correction;
+    };
+} JournalRecord_t;
+
+// an unsynced stamp during replay, held back until its correction shows up
+typedef struct {
+    uint32_t sequence;
+    time_t timestamp;
+    bool is_start;
+} PendingStamp_t;
+
+#define RECORDS_PER_SECTOR (JOURNAL_SECTOR_SIZE / sizeof(JournalRecord_t))
+
+static_assert(sizeof(JournalRecord_t) == 16, "journal records must stay 16 bytes");
+
+static const char *TAG = "JOURNAL";
+
+static const esp_partition_t *partition;
+static uint32_t sector_count;
+static uint32_t head_sector; // sector records are appended to
+static uint32_t head_slot; // next free slot in head_sector
+static uint32_t next_sequence; // written by the appender only, aligned 32 bit reads are atomic
+static uint32_t first_unsynced_sequence; // 0 while no unsynced record waits for a correction
+static time_t newest_stamp;
+
+static uint8_t record_crc(const JournalRecord_t *record) {
+    JournalRecord_t copy = *record;
+    copy.crc = 0;
+    return esp_rom_crc8_le(0, (const uint8_t *) &copy, sizeof(copy));
+}
+
+static bool is_valid(const JournalRecord_t *record) {
+    return record->magic == RECORD_MAGIC && record->crc == record_crc(record);
+}
+
+static bool is_stamp(const JournalRecord_t *record) {
+    return record->type >= RECORD_TYPE_START && record->type <= RECORD_TYPE_END_UNSYNCED;
+}
+
+static bool is_erased(const JournalRecord_t *record) {
+    const uint8_t *bytes = (const uint8_t *) record;
+    for (size_t i = 0; i < sizeof(*record); i++) {
+        if (bytes[i] != 0xFF) return false;
+    }
+    return true;
+}
+
+static esp_err_t read_record(const uint32_t sector, const uint32_t slot, JournalRecord_t *record) {
+    const size_t offset = sector * JOURNAL_SECTOR_SIZE + slot * sizeof(JournalRecord_t);
+    return esp_partition_read(partition, offset, record, sizeof(*record));
+}
+
+// sequence of the first valid record of a sector, 0 if it holds none. A torn or failed write in
+// front of it does not hide the records behind, the ring would erase them as an empty sector.
+static uint32_t first_sequence(const uint32_t sector) {
+    JournalRecord_t record;
+    for (uint32_t slot = 0; slot < RECORDS_PER_SECTOR; slot++) {
+        if (read_record(sector, slot, &record) != ESP_OK || is_erased(&record)) return 0;
+        if (is_valid(&record)) return record.sequence;
+    }
+    return 0;
+}
+
+// sectors ordered from oldest to newest
+static uint32_t sorted_sectors(uint32_t order[JOURNAL_MAX_SECTORS]) {
+    uint32_t sequences[JOURNAL_MAX_SECTORS];
+    uint32_t used = 0;
+
+    for (uint32_t sector = 0; sector < sector_count; sector++) {
+        const uint32_t sequence = first_sequence(sector);
+        if (sequence == 0) continue;
+
+        uint32_t pos = used++;
+        while (pos > 0 && sequences[pos - 1] > sequence) {
+            sequences[pos] = sequences[pos - 1];
+            order[pos] = order[pos - 1];
+            pos--;
+        }
+        sequences[pos] = sequence;
+        order[pos] = sector;
+    }
+
+    return used;
+}
+
+esp_err_t init_journal(void) {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, JOURNAL_PARTITION_LABEL);
+    if (partition == NULL) {
+        ESP_LOGW(TAG, "no '%s' partition, stamps are not persisted", JOURNAL_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    sector_count = partition->size / JOURNAL_SECTOR_SIZE;
+    if (sector_count > JOURNAL_MAX_SECTORS) sector_count = JOURNAL_MAX_SECTORS;
+
+    uint32_t order[JOURNAL_MAX_SECTORS];
+    const uint32_t used = sorted_sectors(order);
+
+    head_sector = used > 0 ? order[used - 1] : 0;
+    head_slot = 0;
+    next_sequence = 1;
+
+    // the append position is the first erased slot, a torn record is skipped, not overwritten
+    JournalRecord_t record;
+    for (uint32_t slot = 0; slot < RECORDS_PER_SECTOR; slot++) {
+        if (read_record(head_sector, slot, &record) != ESP_OK) return ESP_FAIL;
+        if (is_erased(&record)) break;
+        if (is_valid(&record)) {
+            next_sequence = record.sequence + 1;
+            if (is_stamp(&record)) newest_stamp = (time_t) record.timestamp;
+        }
+        head_slot = slot + 1;
+    }
+
+    ESP_LOGI(TAG, "sector %lu slot %lu, next sequence %lu",
+             (unsigned long) head_sector, (unsigned long) head_slot, (unsigned long) next_sequence);
+    return ESP_OK;
+}
+
+// move to the next sector of the ring, erasing its oldest records
+static esp_err_t start_next_sector(void) {
+    head_sector = (head_sector + 1) % sector_count;
+    head_slot = 0;
+    return esp_partition_erase_range(partition, head_sector * JOURNAL_SECTOR_SIZE, JOURNAL_SECTOR_SIZE);
+}
+
+static esp_err_t append_record(JournalRecord_t *record) {
+    if (partition == NULL) return ESP_ERR_INVALID_STATE;
+
+    if (head_slot >= RECORDS_PER_SECTOR) {
+        const esp_err_t erased = start_next_sector();
+        if (erased != ESP_OK) return erased;
+    }
+
+    record->magic = RECORD_MAGIC;
+    record->sequence = next_sequence;
+    record->crc = 0;
+    record->crc = record_crc(record);
+
+    const size_t offset = head_sector * JOURNAL_SECTOR_SIZE + head_slot * sizeof(*record);
+    const esp_err_t result = esp_partition_write(partition, offset, record, sizeof(*record));
+
+    // a failed program still consumed the slot
+    head_slot++;
+    if (result == ESP_OK) next_sequence++;
+    return result;
+}
+
+esp_err_t journal_append_stamp(const time_t timestamp, const bool is_start, const bool synced) {
+    const uint8_t start_type = synced ? RECORD_TYPE_START : RECORD_TYPE_START_UNSYNCED;
+    const uint8_t end_type = synced ? RECORD_TYPE_END : RECORD_TYPE_END_UNSYNCED;
+
+    JournalRecord_t record = {
+        .type = is_start ? start_type : end_type,
+        .timestamp = timestamp,
+    };
+
+    const uint32_t sequence = next_sequence;
+    const esp_err_t result = append_record(&record);
+    if (result != ESP_OK) return result;
+
+    newest_stamp = timestamp;
+    if (!synced && first_unsynced_sequence == 0) {
+        first_unsynced_sequence = sequence;
+    }
+    return ESP_OK;
+}
+
+esp_err_t journal_append_correction(const int32_t offset) {
+    if (partition == NULL) return ESP_ERR_INVALID_STATE;
+    if (first_unsynced_sequence == 0) return ESP_ERR_NOT_FOUND;
+
+    JournalRecord_t record = {
+        .type = RECORD_TYPE_CORRECTION,
+        .correction = {.offset = offset, .first_sequence = first_unsynced_sequence},
+    };
+
+    const esp_err_t result = append_record(&record);
+    if (result == ESP_OK) first_unsynced_sequence = 0;
+    return result;
+}
+
+bool journal_newest_stamp(time_t *timestamp) {
+    if (newest_stamp == 0) return false;
+    *timestamp = newest_stamp;
+    return true;
+}
+
+uint32_t journal_next_sequence(void) {
+    return next_sequence;
+}
+
+static void to_entry(const JournalRecord_t *record, JournalEntry_t *entry) {
+    entry->sequence = record->sequence;
+    if (record->type == RECORD_TYPE_CORRECTION) {
+        entry->type = JOURNAL_ENTRY_CORRECTION;
+        entry->synced = true;
+        entry->correction.offset = record->correction.offset;
+        entry->correction.first_sequence = record->correction.first_sequence;
+        return;
+    }
+
+    entry->type = record->type == RECORD_TYPE_START || record->type == RECORD_TYPE_START_UNSYNCED
+                      ? JOURNAL_ENTRY_START
+                      : JOURNAL_ENTRY_END;
+    entry->synced = record->type == RECORD_TYPE_START || record->type == RECORD_TYPE_END;
+    entry->timestamp = (time_t) record->timestamp;
+}
+
+int journal_read_since(const uint32_t after, JournalEntry_t *entries, const int max) {
+    if (partition == NULL) return 0;
+
+    // a record being programmed right now has this sequence and is left for the next call
+    const uint32_t limit = next_sequence;
+
+    uint32_t order[JOURNAL_MAX_SECTORS];
+    const uint32_t used = sorted_sectors(order);
+    int count = 0;
+
+    for (uint32_t i = 0; i < used && count < max; i++) {
+        // every record of this sector lies below the first one of the next
+        if (i + 1 < used && first_sequence(order[i + 1]) <= after + 1) continue;
+
+        for (uint32_t slot = 0; slot < RECORDS_PER_SECTOR && count < max; slot += REPLAY_CHUNK) {
+            JournalRecord_t records[REPLAY_CHUNK];
+            const size_t offset = order[i] * JOURNAL_SECTOR_SIZE + slot * sizeof(JournalRecord_t);
+            if (esp_partition_read(partition, offset, records, sizeof(records)) != ESP_OK) return count;
+
+            for (uint32_t r = 0; r < REPLAY_CHUNK && count < max; r++) {
+                if (is_erased(&records[r])) {
+                    slot = RECORDS_PER_SECTOR;
+                    break;
+                }
+                if (!is_valid(&records[r]) || records[r].sequence <= after || records[r].sequence >= limit) continue;
+                if (!is_stamp(&records[r]) && records[r].type != RECORD_TYPE_CORRECTION) continue;
+
+                to_entry(&records[r], &entries[count++]);
+            }
+        }
+    }
+
+    return count;
+}
+
+// unsynced stamps of the replay in progress, only used by journal_replay
+static PendingStamp_t pending[REPLAY_MAX_PENDING];
+static int pending_count;
+
+// records carry their direction, so a stamp lost to a failed write can not invert all later ones
+static int replay_stamp(TimeTrackerState *state, time_t timestamp, const bool is_start) {
+    if (is_start == state->is_working) return 0;
+
+    // a correction can move stamps behind ones which are already in the history
+    const time_t newest = history_newest_boundary(&state->history);
+    if (timestamp < newest) timestamp = newest;
+
+    roll_over_day(state, timestamp);
+    return apply_stamp(state, timestamp) ? 1 : 0;
+}
+
+// apply held back stamps, shifting those from first_sequence on by offset
+static int flush_pending(TimeTrackerState *state, const int32_t offset, const uint32_t first_sequence) {
+    int replayed = 0;
+    for (int i = 0; i < pending_count; i++) {
+        const PendingStamp_t *stamp = &pending[i];
+        const time_t shift = first_sequence != 0 && stamp->sequence >= first_sequence ? offset : 0;
+        replayed += replay_stamp(state, stamp->timestamp + shift, stamp->is_start);
+    }
+    pending_count = 0;
+    return replayed;
+}
+
+static int replay_record(TimeTrackerState *state, const JournalRecord_t *record) {
+    if (!is_valid(record)) return 0;
+
+    switch (record->type) {
+        case RECORD_TYPE_START:
+        case RECORD_TYPE_END: {
+            // unsynced stamps followed by synced ones never got a correction, e.g. a boot without Wi-Fi
+            const int replayed = flush_pending(state, 0, 0);
+            return replayed + replay_stamp(state, (time_t) record->timestamp, record->type == RECORD_TYPE_START);
+        }
+        case RECORD_TYPE_START_UNSYNCED:
+        case RECORD_TYPE_END_UNSYNCED: {
+            int replayed = 0;
+            if (pending_count == REPLAY_MAX_PENDING) replayed = flush_pending(state, 0, 0);
+            pending[pending_count++] = (PendingStamp_t){
+                .sequence = record->sequence,
+                .timestamp = (time_t) record->timestamp,
+                .is_start = record->type == RECORD_TYPE_START_UNSYNCED,
+            };
+            return replayed;
+        }
+        case RECORD_TYPE_CORRECTION:
+            return flush_pending(state, record->correction.offset, record->correction.first_sequence);
+        default:
+            return 0;
+    }
+}
+
+int journal_replay(TimeTrackerState *state) {
+    if (partition == NULL) return 0;
+
+    uint32_t order[JOURNAL_MAX_SECTORS];
+    const uint32_t used = sorted_sectors(order);
+    int replayed = 0;
+    pending_count = 0;
+
+    for (uint32_t i = 0; i < used; i++) {
+        bool sector_end = false;
+
+        for (uint32_t slot = 0; slot < RECORDS_PER_SECTOR && !sector_end; slot += REPLAY_CHUNK) {
+            JournalRecord_t records[REPLAY_CHUNK];
+            const size_t offset = order[i] * JOURNAL_SECTOR_SIZE + slot * sizeof(JournalRecord_t);
+            if (esp_partition_read(partition, offset, records, sizeof(records)) != ESP_OK) break;
+
+            for (uint32_t r = 0; r < REPLAY_CHUNK; r++) {
+                if (is_erased(&records[r])) {
+                    sector_end = true;
+                    break;
+                }
+                replayed += replay_record(state, &records[r]);
+            }
+        }
+    }
+
+    // stamps of this boot (or an earlier one which never synced) keep their unsynced times
+    replayed += flush_pending(state, 0, 0);
+
+    time_t now;
+    time(&now);
+    roll_over_day(state, now);
+
+    ESP_LOGI(TAG, "replayed %d stamps, %u bytes of history", replayed, state->history.used);
+    return replayed;
+}
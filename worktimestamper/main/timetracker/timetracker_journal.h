@@ -0,0 +1,48 @@
+#ifndef TIMETRACKER_JOURNAL_H
+#define TIMETRACKER_JOURNAL_H
+
+#include "timetracker_state.h"
+#include <esp_err.h>
+
+typedef enum {
+    JOURNAL_ENTRY_START,
+    JOURNAL_ENTRY_END,
+    JOURNAL_ENTRY_CORRECTION,
+} JournalEntryType;
+
+// a journal record as seen by readers outside the journal, e.g. the upload queue
+typedef struct {
+    uint32_t sequence;
+    JournalEntryType type;
+    bool synced; // false for stamps taken before the clock was set, a later correction shifts them
+    union {
+        time_t timestamp;
+        struct {
+            int32_t offset;
+            uint32_t first_sequence;
+        } correction;
+    };
+} JournalEntry_t;
+
+// Locate the journal partition and the append position
+esp_err_t init_journal(void);
+
+// Append one stamp record, costs a single flash program (erase only when a new sector is started)
+esp_err_t journal_append_stamp(time_t timestamp, bool is_start, bool synced);
+
+// Shift every unsynced stamp appended since init_journal by offset seconds, ESP_ERR_NOT_FOUND if there are none
+esp_err_t journal_append_correction(int32_t offset);
+
+// Timestamp of the newest journaled stamp, a fallback clock after a power loss
+bool journal_newest_stamp(time_t *timestamp);
+
+// Sequence the next appended record gets, every record below it is completely written
+uint32_t journal_next_sequence(void);
+
+// Up to max records with a sequence above after, oldest first. Safe from tasks other than the appender.
+int journal_read_since(uint32_t after, JournalEntry_t *entries, int max);
+
+// Rebuild the session history of state from all journaled stamps, returns the number of replayed stamps
+int journal_replay(TimeTrackerState *state);
+
+#endif
@@ -1,45 +1,80 @@
 #include "timetracker_logic.h"
+#include "timetracker_journal.h"
+#include <esp_log.h>
 #include <time.h>
 
-bool handle_stamp(TimeTrackerState *state) {
-    time_t now;
-    time(&now);
+bool handle_stamp(TimeTrackerState *state, time_t timestamp) {
+    // a press captured before a midnight rollover which got handled first counts at that midnight
+    const time_t newest = history_newest_boundary(&state->history);
+    if (timestamp < newest) timestamp = newest;
 
-    if (state->session_index >= MAX_SESSIONS) {
-        return false;
+    roll_over_day(state, timestamp);
+
+    // write-ahead: the stamp is on flash before the state changes
+    const esp_err_t journaled = journal_append_stamp(timestamp, !state->is_working, state->time_synced);
+    if (journaled != ESP_OK && journaled != ESP_ERR_INVALID_STATE) {
+        ESP_LOGW("TIMETRACKER", "stamp not journaled: %s", esp_err_to_name(journaled));
     }
 
-    WorkTimeSession *session = &state->sessions[state->session_index];
+    return apply_stamp(state, timestamp);
+}
+
+bool apply_stamp(TimeTrackerState *state, const time_t timestamp) {
+    if (!history_add_boundary(&state->history, timestamp)) {
+        return false;
+    }
 
     if (state->is_working) {
-        session->end_time = now;
-        state->session_index++;
+        totals_close(&state->totals, timestamp);
     } else {
-        session->start_time = now;
-        session->end_time = 0;
+        totals_open(&state->totals, timestamp);
     }
 
     state->is_working = !state->is_working;
     return true;
 }
 
+bool roll_over_day(TimeTrackerState *state, const time_t now) {
+    bool rolled = false;
+
+    // the open session ends at midnight and goes on at 00:00 of the next day,
+    // day_end of the totals is the midnight of the newest history day
+    while (state->is_working && now >= state->totals.day_end) {
+        const time_t next_day = state->totals.day_end;
+
+        history_close_day(&state->history);
+        totals_close(&state->totals, next_day);
+        history_add_boundary(&state->history, next_day);
+        totals_open(&state->totals, next_day);
+        rolled = true;
+    }
+
+    return rolled;
+}
+
 time_t calculate_work_time(const TimeTrackerState *state) {
-    time_t total = 0;
+    return totals_day_seconds(&state->totals, state->is_working, time(NULL));
+}
+
+void get_work_totals(const TimeTrackerState *state, WorkTotalsReport *report) {
+    totals_report(&state->totals, state->is_working, time(NULL), report);
+}
+
+int get_today_sessions(const TimeTrackerState *state, WorkTimeSession *sessions, const int max_sessions) {
+    time_t now;
+    time(&now);
 
-    for (int i = 0; i < MAX_SESSIONS; i++) {
-        const time_t start = state->sessions[i].start_time;
-        const time_t end = state->sessions[i].end_time;
+    HistoryDay today;
+    if (!history_last_day(&state->history, &today) || today.day != history_day_of(now)) return 0;
 
-        if (start == 0) continue;
+    const int total = (today.count + 1) / 2;
+    const int first = total > max_sessions ? total - max_sessions : 0;
 
-        if (end == 0) {
-            time_t now;
-            time(&now);
-            total += now - start;
-        } else {
-            total += end - start;
-        }
+    for (int i = first; i < total; i++) {
+        WorkTimeSession *session = &sessions[i - first];
+        session->start_time = today.start + history_boundary(&today, 2 * i);
+        session->end_time = 2 * i + 1 < today.count ? today.start + history_boundary(&today, 2 * i + 1) : 0;
     }
 
-    return total;
+    return total - first;
 }
@@ -4,10 +4,22 @@
 #include "timetracker_state.h"
 #include <stdbool.h>
 
-// Called when user presses "stamp" button
-bool handle_stamp(TimeTrackerState *state);
+// Called when user presses "stamp" button, timestamp is the time of the press
+bool handle_stamp(TimeTrackerState *state, time_t timestamp);
 
-// Calculates total worked time in seconds
+// Toggle working/pausing at timestamp without journaling, used for replay
+bool apply_stamp(TimeTrackerState *state, time_t timestamp);
+
+// Split a session running over midnight into one part per day, returns true if a day was closed
+bool roll_over_day(TimeTrackerState *state, time_t now);
+
+// Calculates worked time of the current day in seconds
 time_t calculate_work_time(const TimeTrackerState *state);
 
+// Day, week and month totals with overtime, O(1)
+void get_work_totals(const TimeTrackerState *state, WorkTotalsReport *report);
+
+// Copy the latest max_sessions sessions of the current day, oldest first, returns how many were copied
+int get_today_sessions(const TimeTrackerState *state, WorkTimeSession *sessions, int max_sessions);
+
 #endif
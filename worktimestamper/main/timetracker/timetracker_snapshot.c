@@ -0,0 +1,45 @@
+#include "timetracker_snapshot.h"
+#include "timetracker_logic.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stdatomic.h>
+
+// Two buffers: the writer fills the one readers are not pointed at, then bumps the version.
+// A reader retries only if a new version was published while it copied, it never waits
+// for a writer which got preempted halfway through.
+static TimeTrackerSnapshot buffers[2];
+static atomic_uint version;
+
+static SemaphoreHandle_t writer_mutex;
+
+void init_state_snapshot(void) {
+    writer_mutex = xSemaphoreCreateMutex();
+}
+
+void state_write_begin(void) {
+    xSemaphoreTake(writer_mutex, portMAX_DELAY);
+}
+
+void state_write_end(const TimeTrackerState *state) {
+    const unsigned current = atomic_load_explicit(&version, memory_order_relaxed);
+    TimeTrackerSnapshot *next = &buffers[(current + 1) & 1];
+
+    next->is_working = state->is_working;
+    next->is_summary_mode = state->is_summary_mode;
+    next->time_synced = state->time_synced;
+    next->totals = state->totals;
+    next->session_count = (uint8_t) get_today_sessions(state, next->sessions, SNAPSHOT_SESSIONS);
+
+    atomic_store_explicit(&version, current + 1, memory_order_release);
+    xSemaphoreGive(writer_mutex);
+}
+
+void state_read(TimeTrackerSnapshot *snapshot) {
+    unsigned seen;
+    do {
+        seen = atomic_load_explicit(&version, memory_order_acquire);
+        *snapshot = buffers[seen & 1];
+        atomic_thread_fence(memory_order_acquire);
+    } while (atomic_load_explicit(&version, memory_order_relaxed) != seen);
+}
@@ -0,0 +1,30 @@
+#ifndef TIMETRACKER_SNAPSHOT_H
+#define TIMETRACKER_SNAPSHOT_H
+
+#include "timetracker_state.h"
+
+// sessions of the current day carried in a snapshot, as many as the summary page shows
+#define SNAPSHOT_SESSIONS 5
+
+// everything the views need, small enough to be copied every second
+typedef struct {
+    bool is_working;
+    bool is_summary_mode;
+    bool time_synced;
+    WorkTotals totals;
+    uint8_t session_count;
+    WorkTimeSession sessions[SNAPSHOT_SESSIONS]; // latest sessions of the current day, oldest first
+} TimeTrackerSnapshot;
+
+void init_state_snapshot(void);
+
+// Take the writer lock, every change of TimeTrackerState goes between begin and end
+void state_write_begin(void);
+
+// Publish state to readers and release the writer lock
+void state_write_end(const TimeTrackerState *state);
+
+// Copy the latest published state, lock-free and safe from any task or core
+void state_read(TimeTrackerSnapshot *snapshot);
+
+#endif
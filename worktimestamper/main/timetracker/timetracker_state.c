@@ -1,9 +1,9 @@
 #include "timetracker_state.h"
-#include <string.h>
 
 void init_timetracker_state(TimeTrackerState *state) {
     state->is_working = false;
     state->is_summary_mode = false;
-    state->session_index = 0;
-    memset(state->sessions, 0, sizeof(state->sessions));
+    state->time_synced = false;
+    history_init(&state->history);
+    totals_init(&state->totals, DEFAULT_DAILY_TARGET_S);
 }
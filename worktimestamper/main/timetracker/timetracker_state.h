@@ -1,22 +1,24 @@
 #ifndef TIMETRACKER_STATE_H
 #define TIMETRACKER_STATE_H
 
+#include "timetracker_history.h"
+#include "timetracker_totals.h"
+
 #include <time.h>
 #include <stdint.h>
 #include <stdbool.h>
 
-#define MAX_SESSIONS 6
-
 typedef struct {
     time_t start_time;
-    time_t end_time;
+    time_t end_time; // 0 while the session is open
 } WorkTimeSession;
 
 typedef struct {
     bool is_working;
     bool is_summary_mode;
-    uint8_t session_index;
-    WorkTimeSession sessions[MAX_SESSIONS];
+    bool time_synced; // false until SNTP answered, stamps taken before get corrected afterwards
+    SessionHistory history;
+    WorkTotals totals;
 } TimeTrackerState;
 
 // init new timetracker state
@@ -0,0 +1,78 @@
+#include "timetracker_totals.h"
+#include "timetracker_history.h"
+
+void totals_init(WorkTotals *totals, const uint32_t daily_target) {
+    *totals = (WorkTotals){.daily_target = daily_target};
+}
+
+// switch the sums to the day of timestamp, only called once per day
+static void enter_day(WorkTotals *totals, const time_t timestamp) {
+    struct tm time_info;
+    localtime_r(&timestamp, &time_info);
+
+    const uint16_t day = history_day_of(timestamp);
+    const uint32_t week = (day + 3) / 7; // 1970-01-01 was a thursday
+    const uint32_t month = (uint32_t) (time_info.tm_year * 12 + time_info.tm_mon);
+
+    if (week != totals->week) {
+        totals->week = week;
+        totals->week_closed = 0;
+        totals->week_days = 0;
+    }
+    if (month != totals->month) {
+        totals->month = month;
+        totals->month_closed = 0;
+        totals->month_days = 0;
+    }
+
+    totals->day_end = history_day_start(day + 1);
+    totals->day_closed = 0;
+    totals->day_counted = false;
+}
+
+void totals_open(WorkTotals *totals, const time_t timestamp) {
+    if (timestamp >= totals->day_end) enter_day(totals, timestamp);
+
+    if (!totals->day_counted) {
+        totals->week_days++;
+        totals->month_days++;
+        totals->day_counted = true;
+    }
+    totals->open_start = timestamp;
+}
+
+void totals_close(WorkTotals *totals, const time_t timestamp) {
+    const uint32_t duration = (uint32_t) (timestamp - totals->open_start);
+    totals->day_closed += duration;
+    totals->week_closed += duration;
+    totals->month_closed += duration;
+}
+
+time_t totals_day_seconds(const WorkTotals *totals, const bool is_working, const time_t now) {
+    // midnight passed but the session was not rolled over yet
+    if (now >= totals->day_end) {
+        return is_working ? now - history_day_start(history_day_of(now)) : 0;
+    }
+    return totals->day_closed + (is_working ? now - totals->open_start : 0);
+}
+
+void totals_report(const WorkTotals *totals, const bool is_working, const time_t now, WorkTotalsReport *report) {
+    // catch up on a pending rollover without touching the shared sums
+    WorkTotals current = *totals;
+    while (is_working && now >= current.day_end) {
+        const time_t midnight = current.day_end;
+        totals_close(&current, midnight);
+        totals_open(&current, midnight);
+    }
+    if (now >= current.day_end) enter_day(&current, now);
+
+    const uint32_t open = is_working ? (uint32_t) (now - current.open_start) : 0;
+    report->day = current.day_closed + open;
+    report->week = current.week_closed + open;
+    report->month = current.month_closed + open;
+
+    const int32_t target = (int32_t) current.daily_target;
+    report->day_overtime = (int32_t) report->day - (current.day_counted ? target : 0);
+    report->week_overtime = (int32_t) report->week - target * current.week_days;
+    report->month_overtime = (int32_t) report->month - target * current.month_days;
+}
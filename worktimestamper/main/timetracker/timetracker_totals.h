@@ -0,0 +1,49 @@
+#ifndef TIMETRACKER_TOTALS_H
+#define TIMETRACKER_TOTALS_H
+
+#include <time.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DEFAULT_DAILY_TARGET_S (8 * 3600)
+
+// Running sums of closed sessions, updated once per stamp. Sessions never span midnight
+// (roll_over_day splits them), so every closed session belongs to exactly one day.
+typedef struct {
+    time_t day_end; // next local midnight, the sums are stale from here on
+    time_t open_start; // start of the open session
+    uint32_t week; // monday based week index of the current day
+    uint32_t month; // year * 12 + month of the current day
+    uint32_t day_closed;
+    uint32_t week_closed;
+    uint32_t month_closed;
+    uint16_t week_days; // days with at least one session, the overtime base
+    uint16_t month_days;
+    bool day_counted;
+    uint32_t daily_target; // worked seconds per day the overtime is measured against
+} WorkTotals;
+
+typedef struct {
+    uint32_t day;
+    uint32_t week;
+    uint32_t month;
+    int32_t day_overtime;
+    int32_t week_overtime;
+    int32_t month_overtime;
+} WorkTotalsReport;
+
+void totals_init(WorkTotals *totals, uint32_t daily_target);
+
+// A session starts at timestamp, resets the day/week/month sums when it is in a new period
+void totals_open(WorkTotals *totals, time_t timestamp);
+
+// The open session ends at timestamp
+void totals_close(WorkTotals *totals, time_t timestamp);
+
+// Worked seconds of the current day including the open session
+time_t totals_day_seconds(const WorkTotals *totals, bool is_working, time_t now);
+
+// All sums including the open session, with overtime against the daily target per worked day
+void totals_report(const WorkTotals *totals, bool is_working, time_t now, WorkTotalsReport *report);
+
+#endif
@@ -0,0 +1,257 @@
+#include "tracehandler.h"
+
+#if HOT_PATH_TRACE
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <assert.h>
+#include <stdbool.h>
+
+#define RING_MASK (TRACE_RING_SIZE - 1)
+#define DUMP_INTERVAL_S 60
+
+static_assert((TRACE_RING_SIZE & RING_MASK) == 0, "TRACE_RING_SIZE must be a power of two");
+
+static const char *TAG = "TRACE";
+
+static const char *event_names[TRACE_EVENT_COUNT] = {
+    "button_edge", "button", "stamp", "text", "render", "i2c_begin", "i2c_end", "i2c_fail", "pixels",
+};
+
+static const char *histogram_names[TRACE_HISTOGRAM_COUNT] = {
+    "edge to pixel us", "i2c transaction us", "bus queue depth",
+};
+
+typedef struct {
+    uint32_t time_us; // low half of esp_timer, wraps after 71 minutes
+    uint16_t arg;
+    uint8_t event;
+} TraceEntry_t;
+
+typedef enum {
+    PRESS_IDLE,
+    PRESS_HANDLING, // the event loop handles the press
+    PRESS_RENDERING, // the press changed text, display_task did not queue the redraw yet
+    PRESS_ON_WIRE, // waiting for the bus to write every op queued up to the redraw
+} PressState;
+
+static TraceEntry_t ring[TRACE_RING_SIZE];
+static uint32_t head; // events recorded so far, the newest TRACE_RING_SIZE of them are kept
+static uint32_t dumped; // events before this one were dumped or overwritten
+static TraceHistogram_t histograms[TRACE_HISTOGRAM_COUNT];
+
+// latency of one press at a time, presses while it is measured are covered by it
+static PressState press_state;
+static int64_t press_edge_us;
+static bool press_changed_text;
+static uint32_t press_last_op;
+
+static uint32_t ops_submitted;
+static uint32_t ops_written;
+static uint32_t ops_in_transaction; // only touched by the bus task
+static int64_t transaction_start_us;
+
+static portMUX_TYPE trace_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint16_t saturate(const int64_t value) {
+    if (value < 0) return 0;
+    return value > UINT16_MAX ? UINT16_MAX : (uint16_t) value;
+}
+
+// caller holds trace_mux
+static void IRAM_ATTR store(const TraceEvent event, const uint16_t arg, const int64_t at_us) {
+    ring[head & RING_MASK] = (TraceEntry_t){.time_us = (uint32_t) at_us, .arg = arg, .event = (uint8_t) event};
+    head++;
+}
+
+// caller holds trace_mux
+static void add_sample(TraceHistogram_t *histogram, const uint32_t value) {
+    uint32_t bucket = value == 0 ? 0 : 32 - __builtin_clz(value);
+    if (bucket >= TRACE_HISTOGRAM_BUCKETS) bucket = TRACE_HISTOGRAM_BUCKETS - 1;
+
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->total += value;
+    if (value > histogram->max) histogram->max = value;
+}
+
+void IRAM_ATTR trace_record(const TraceEvent event, const uint16_t arg) {
+    const int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL_SAFE(&trace_mux);
+    store(event, arg, now);
+    if (event == TRACE_EVENT_TEXT && press_state == PRESS_HANDLING) {
+        press_changed_text = true;
+    }
+    portEXIT_CRITICAL_SAFE(&trace_mux);
+}
+
+void trace_press_begin(const int64_t edge_us) {
+    taskENTER_CRITICAL(&trace_mux);
+    if (press_state == PRESS_IDLE) {
+        press_state = PRESS_HANDLING;
+        press_edge_us = edge_us;
+        press_changed_text = false;
+    }
+    taskEXIT_CRITICAL(&trace_mux);
+}
+
+void trace_press_end(void) {
+    taskENTER_CRITICAL(&trace_mux);
+    if (press_state == PRESS_HANDLING) {
+        press_state = press_changed_text ? PRESS_RENDERING : PRESS_IDLE;
+    }
+    taskEXIT_CRITICAL(&trace_mux);
+}
+
+void trace_redraw_queued(void) {
+    taskENTER_CRITICAL(&trace_mux);
+    // on the other core display_task may queue the redraw before the event loop is done with the press
+    if (press_state == PRESS_RENDERING || (press_state == PRESS_HANDLING && press_changed_text)) {
+        press_state = PRESS_ON_WIRE;
+        press_last_op = ops_submitted;
+    }
+    taskEXIT_CRITICAL(&trace_mux);
+}
+
+void trace_bus_submit(const uint32_t ops) {
+    taskENTER_CRITICAL(&trace_mux);
+    ops_submitted += ops;
+    taskEXIT_CRITICAL(&trace_mux);
+}
+
+void trace_bus_dequeue(const uint32_t depth) {
+    taskENTER_CRITICAL(&trace_mux);
+    add_sample(&histograms[TRACE_HISTOGRAM_BUS_QUEUE_DEPTH], depth);
+    taskEXIT_CRITICAL(&trace_mux);
+}
+
+void trace_bus_op(void) {
+    ops_in_transaction++;
+}
+
+void trace_bus_written(const esp_err_t result) {
+    const int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&trace_mux);
+    ops_written += ops_in_transaction;
+    ops_in_transaction = 0;
+
+    // a write failing its retry leaves old pixels on the glass, the next redraw of a press is measured instead
+    if (press_state == PRESS_ON_WIRE && (int32_t) (ops_written - press_last_op) >= 0) {
+        if (result == ESP_OK) {
+            const int64_t latency_us = now - press_edge_us;
+            add_sample(&histograms[TRACE_HISTOGRAM_PIXEL_LATENCY], (uint32_t) latency_us);
+            store(TRACE_EVENT_PIXELS, saturate(latency_us / 1000), now);
+        }
+        press_state = PRESS_IDLE;
+    }
+    taskEXIT_CRITICAL(&trace_mux);
+}
+
+void trace_i2c_begin(const uint32_t bytes) {
+    const int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&trace_mux);
+    transaction_start_us = now;
+    store(TRACE_EVENT_I2C_BEGIN, saturate(bytes), now);
+    taskEXIT_CRITICAL(&trace_mux);
+}
+
+void trace_i2c_end(const esp_err_t result) {
+    const int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&trace_mux);
+    const int64_t duration_us = now - transaction_start_us;
+    add_sample(&histograms[TRACE_HISTOGRAM_I2C_DURATION], (uint32_t) duration_us);
+    store(result == ESP_OK ? TRACE_EVENT_I2C_END : TRACE_EVENT_I2C_FAIL, saturate(duration_us), now);
+    taskEXIT_CRITICAL(&trace_mux);
+}
+
+void get_trace_histogram(const TraceHistogram histogram, TraceHistogram_t *out) {
+    taskENTER_CRITICAL(&trace_mux);
+    *out = histograms[histogram];
+    taskEXIT_CRITICAL(&trace_mux);
+}
+
+static void dump_histogram(const TraceHistogram histogram) {
+    TraceHistogram_t snapshot;
+    get_trace_histogram(histogram, &snapshot);
+
+    ESP_LOGI(TAG, "%s: %lu samples, mean %llu, max %lu", histogram_names[histogram],
+             (unsigned long) snapshot.count,
+             (unsigned long long) (snapshot.count > 0 ? snapshot.total / snapshot.count : 0),
+             (unsigned long) snapshot.max);
+
+    for (int bucket = 0; bucket < TRACE_HISTOGRAM_BUCKETS; bucket++) {
+        if (snapshot.buckets[bucket] == 0) continue;
+
+        if (bucket == 0) {
+            ESP_LOGI(TAG, "  %10s %10s %8lu", "0", "", (unsigned long) snapshot.buckets[bucket]);
+        } else if (bucket == TRACE_HISTOGRAM_BUCKETS - 1) {
+            ESP_LOGI(TAG, "  %10lu %10s %8lu", 1UL << (bucket - 1), "and more", (unsigned long) snapshot.buckets[bucket]);
+        } else {
+            ESP_LOGI(TAG, "  %10lu %10lu %8lu", 1UL << (bucket - 1), (1UL << bucket) - 1,
+                     (unsigned long) snapshot.buckets[bucket]);
+        }
+    }
+}
+
+void trace_dump(void) {
+    taskENTER_CRITICAL(&trace_mux);
+    const uint32_t newest = head;
+    const uint32_t lost = newest - dumped > TRACE_RING_SIZE ? newest - dumped - TRACE_RING_SIZE : 0;
+    uint32_t next = dumped + lost;
+    dumped = newest;
+    taskEXIT_CRITICAL(&trace_mux);
+
+    ESP_LOGI(TAG, "%lu new events, %lu lost", (unsigned long) (newest - next), (unsigned long) lost);
+
+    // recording goes on while the console prints, entries overwritten meanwhile are skipped
+    uint32_t overwritten = 0;
+    uint32_t previous_us = 0;
+    bool first = true;
+    for (; next != newest; next++) {
+        taskENTER_CRITICAL(&trace_mux);
+        const bool valid = head - next <= TRACE_RING_SIZE;
+        const TraceEntry_t entry = ring[next & RING_MASK];
+        taskEXIT_CRITICAL(&trace_mux);
+
+        if (!valid) {
+            overwritten++;
+            continue;
+        }
+
+        const uint32_t delta_us = first ? 0 : entry.time_us - previous_us;
+        previous_us = entry.time_us;
+        first = false;
+        ESP_LOGI(TAG, "%10lu +%8lu %-11s %u", (unsigned long) entry.time_us, (unsigned long) delta_us,
+                 entry.event < TRACE_EVENT_COUNT ? event_names[entry.event] : "?", entry.arg);
+    }
+
+    if (overwritten > 0) {
+        ESP_LOGW(TAG, "%lu events overwritten while dumping", (unsigned long) overwritten);
+    }
+
+    for (int i = 0; i < TRACE_HISTOGRAM_COUNT; i++) {
+        dump_histogram((TraceHistogram) i);
+    }
+}
+
+// wakes the CPU once per interval, only part of images built with HOT_PATH_TRACE
+static void dump_task(void *arg) {
+    // ReSharper disable once CppDFAEndlessLoop
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(DUMP_INTERVAL_S * 1000));
+        trace_dump();
+    }
+}
+
+void init_trace(const int priority) {
+    xTaskCreate(dump_task, "trace_dump", 3072, NULL, priority, NULL);
+}
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef TRACEHANDLER_H
+#define TRACEHANDLER_H
+
+#include <esp_err.h>
+#include <stdint.h>
+
+// 1 compiles the hot path hooks in, with 0 they expand to nothing
+#ifndef HOT_PATH_TRACE
+#define HOT_PATH_TRACE 0
+#endif
+
+#define TRACE_RING_SIZE 256 // power of two
+#define TRACE_HISTOGRAM_BUCKETS 24 // bucket b > 0 counts values in [2^(b-1), 2^b), the last one everything above
+
+typedef enum {
+    TRACE_EVENT_BUTTON_EDGE, // button_isr_handler, arg: button << 1 | pressed
+    TRACE_EVENT_BUTTON, // event loop took a button event, arg: button << 8 | type
+    TRACE_EVENT_STAMP, // handle_stamp done, arg: 1 if it changed the state
+    TRACE_EVENT_TEXT, // send_text_at/send_frame stored a changed row, arg: row
+    TRACE_EVENT_RENDER, // display_task woke up with work, arg: pending row bits
+    TRACE_EVENT_I2C_BEGIN, // arg: bytes of the transaction
+    TRACE_EVENT_I2C_END, // arg: duration in us, saturated
+    TRACE_EVENT_I2C_FAIL, // arg: duration in us, saturated
+    TRACE_EVENT_PIXELS, // the redraw of a press is on the wire, arg: edge-to-pixel latency in ms, saturated
+    TRACE_EVENT_COUNT,
+} TraceEvent;
+
+typedef struct {
+    uint32_t buckets[TRACE_HISTOGRAM_BUCKETS];
+    uint32_t count;
+    uint32_t max;
+    uint64_t total;
+} TraceHistogram_t;
+
+typedef enum {
+    TRACE_HISTOGRAM_PIXEL_LATENCY, // us from the button edge until the bus wrote the last op of its redraw
+    TRACE_HISTOGRAM_I2C_DURATION, // us per transaction
+    TRACE_HISTOGRAM_BUS_QUEUE_DEPTH, // ops in the bus queue at each dequeue
+    TRACE_HISTOGRAM_COUNT,
+} TraceHistogram;
+
+#if HOT_PATH_TRACE
+
+#define TRACE(event, arg) trace_record((event), (uint16_t) (arg))
+#define TRACE_PRESS_BEGIN(edge_us) trace_press_begin(edge_us)
+#define TRACE_PRESS_END() trace_press_end()
+#define TRACE_REDRAW_QUEUED() trace_redraw_queued()
+#define TRACE_BUS_SUBMIT(ops) trace_bus_submit(ops)
+#define TRACE_BUS_DEQUEUE(depth) trace_bus_dequeue(depth)
+#define TRACE_BUS_OP() trace_bus_op()
+#define TRACE_BUS_WRITTEN(result) trace_bus_written(result)
+#define TRACE_I2C_BEGIN(bytes) trace_i2c_begin(bytes)
+#define TRACE_I2C_END(result) trace_i2c_end(result)
+
+// starts the task dumping new events and the histograms to the console every minute
+void init_trace(int priority);
+
+// any context, including interrupts
+void trace_record(TraceEvent event, uint16_t arg);
+
+// The event loop handles a press. If it changed displayed text, the latency runs until the bus
+// wrote every op queued up to the moment display_task had queued the redraw.
+void trace_press_begin(int64_t edge_us);
+void trace_press_end(void);
+void trace_redraw_queued(void);
+
+// ops queued by oled_bus_submit, called before they are sent to the queue
+void trace_bus_submit(uint32_t ops);
+
+// only the bus task: an op was taken with depth ops in the queue, an op went into the open
+// transaction, the transaction with all ops since the last call was written
+void trace_bus_dequeue(uint32_t depth);
+void trace_bus_op(void);
+void trace_bus_written(esp_err_t result);
+
+// only the bus task, one transaction at a time
+void trace_i2c_begin(uint32_t bytes);
+void trace_i2c_end(esp_err_t result);
+
+// events since the last dump and all histograms, copies one entry at a time
+void trace_dump(void);
+
+void get_trace_histogram(TraceHistogram histogram, TraceHistogram_t *out);
+
+#else
+
+#define TRACE(event, arg) ((void) 0)
+#define TRACE_PRESS_BEGIN(edge_us) ((void) 0)
+#define TRACE_PRESS_END() ((void) 0)
+#define TRACE_REDRAW_QUEUED() ((void) 0)
+#define TRACE_BUS_SUBMIT(ops) ((void) 0)
+#define TRACE_BUS_DEQUEUE(depth) ((void) 0)
+#define TRACE_BUS_OP() ((void) 0)
+#define TRACE_BUS_WRITTEN(result) ((void) 0)
+#define TRACE_I2C_BEGIN(bytes) ((void) 0)
+#define TRACE_I2C_END(result) ((void) 0)
+
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+#include "stampframe.h"
+#include <esp_rom_crc.h>
+#include <string.h>
+
+static uint8_t *put_u32(uint8_t *dst, const uint32_t value) {
+    dst[0] = (uint8_t) value;
+    dst[1] = (uint8_t) (value >> 8);
+    dst[2] = (uint8_t) (value >> 16);
+    dst[3] = (uint8_t) (value >> 24);
+    return dst + 4;
+}
+
+static uint8_t *put_varint(uint8_t *dst, uint64_t value) {
+    while (value >= 0x80) {
+        *dst++ = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    *dst++ = (uint8_t) value;
+    return dst;
+}
+
+// small negative numbers stay short: 0, -1, 1, -2 ... become 0, 1, 2, 3 ...
+static uint8_t *put_zigzag(uint8_t *dst, const int64_t value) {
+    return put_varint(dst, ((uint64_t) value << 1) ^ (uint64_t) (value >> 63));
+}
+
+static uint8_t kind_of(const JournalEntry_t *entry) {
+    switch (entry->type) {
+        case JOURNAL_ENTRY_START:
+            return STAMP_FRAME_START | (entry->synced ? 0 : STAMP_FRAME_UNSYNCED);
+        case JOURNAL_ENTRY_END:
+            return STAMP_FRAME_END | (entry->synced ? 0 : STAMP_FRAME_UNSYNCED);
+        default:
+            return STAMP_FRAME_CORRECTION;
+    }
+}
+
+size_t stamp_frame_encode(const uint8_t device[6], const JournalEntry_t *entries, int count,
+                          uint8_t frame[STAMP_FRAME_MAX_SIZE]) {
+    if (count > STAMP_FRAME_MAX_ENTRIES) count = STAMP_FRAME_MAX_ENTRIES;
+    const uint32_t first_sequence = count > 0 ? entries[0].sequence : 0;
+
+    uint8_t *pos = frame;
+    *pos++ = STAMP_FRAME_MAGIC_0;
+    *pos++ = STAMP_FRAME_MAGIC_1;
+    *pos++ = STAMP_FRAME_VERSION;
+    *pos++ = (uint8_t) count;
+    memcpy(pos, device, 6);
+    pos = put_u32(pos + 6, first_sequence);
+
+    uint32_t previous_sequence = first_sequence;
+    int64_t previous_time = 0;
+
+    for (int i = 0; i < count; i++) {
+        const JournalEntry_t *entry = &entries[i];
+        *pos++ = kind_of(entry);
+        pos = put_varint(pos, entry->sequence - previous_sequence);
+        previous_sequence = entry->sequence;
+
+        if (entry->type == JOURNAL_ENTRY_CORRECTION) {
+            pos = put_zigzag(pos, entry->correction.offset);
+            pos = put_varint(pos, entry->correction.first_sequence);
+        } else {
+            pos = put_zigzag(pos, (int64_t) entry->timestamp - previous_time);
+            previous_time = (int64_t) entry->timestamp;
+        }
+    }
+
+    const uint32_t crc = esp_rom_crc32_le(0, frame, (uint32_t) (pos - frame));
+    pos = put_u32(pos, crc);
+    return (size_t) (pos - frame);
+}
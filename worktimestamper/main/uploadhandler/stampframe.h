@@ -0,0 +1,37 @@
+#ifndef STAMPFRAME_H
+#define STAMPFRAME_H
+
+#include "timetracker_journal.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact binary batch of journal entries, all numbers little endian:
+//
+//   [magic "WT":2][version:1][count:1][device:6][first sequence:4]
+//   count entries: [kind:1][sequence delta:varint] followed by
+//     stamp:      [time delta:zigzag varint]   seconds to the previous stamp, the first one to 0
+//     correction: [offset:zigzag varint][first sequence:varint]
+//   [crc32:4] over everything before it
+//
+// kind is STAMP_FRAME_START, _END or _CORRECTION, stamps taken before the clock was set carry
+// STAMP_FRAME_UNSYNCED. The sequence delta counts from the previous entry, the first from the header.
+// A day with two sessions packs into roughly 20 bytes.
+
+#define STAMP_FRAME_MAGIC_0 'W'
+#define STAMP_FRAME_MAGIC_1 'T'
+#define STAMP_FRAME_VERSION 1
+#define STAMP_FRAME_HEADER_SIZE 14
+#define STAMP_FRAME_MAX_ENTRIES 64
+#define STAMP_FRAME_MAX_ENTRY_SIZE 16
+#define STAMP_FRAME_MAX_SIZE (STAMP_FRAME_HEADER_SIZE + STAMP_FRAME_MAX_ENTRIES * STAMP_FRAME_MAX_ENTRY_SIZE + 4)
+
+#define STAMP_FRAME_START 0
+#define STAMP_FRAME_END 1
+#define STAMP_FRAME_CORRECTION 2
+#define STAMP_FRAME_UNSYNCED 0x80
+
+// Encode up to STAMP_FRAME_MAX_ENTRIES entries into frame, returns its length
+size_t stamp_frame_encode(const uint8_t device[6], const JournalEntry_t *entries, int count,
+                          uint8_t frame[STAMP_FRAME_MAX_SIZE]);
+
+#endif
@@ -0,0 +1,162 @@
+#include "uploadhandler.h"
+#include "stampframe.h"
+#include "timetracker_journal.h"
+#include "credentials.h"
+
+#include "freertos/FreeRTOS.h"
+#include <esp_http_client.h>
+#include <esp_log.h>
+#include <esp_mac.h>
+#include <esp_timer.h>
+#include <nvs.h>
+#include <stdlib.h>
+
+#define UPLOAD_NAMESPACE "upload"
+#define UPLOAD_ACKED_KEY "acked"
+#define UPLOAD_TIMEOUT_MS 3000
+// with at most one radio window every 15 minutes this caps the upload time per day
+#define UPLOAD_MAX_FRAMES_PER_WINDOW 8
+
+static const char *TAG = "UPLOAD";
+
+// written by the Wi-Fi sync task only, under stats_mux for get_upload_stats
+static UploadStats_t stats;
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+#ifdef UPLOAD_URL
+static bool acked_loaded;
+static JournalEntry_t entries[STAMP_FRAME_MAX_ENTRIES];
+static uint8_t frame[STAMP_FRAME_MAX_SIZE];
+
+static void set_acked(const uint32_t sequence) {
+    taskENTER_CRITICAL(&stats_mux);
+    stats.acked_sequence = sequence;
+    taskEXIT_CRITICAL(&stats_mux);
+}
+
+static void load_acked(void) {
+    acked_loaded = true;
+
+    nvs_handle_t handle;
+    if (nvs_open(UPLOAD_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return;
+    uint32_t acked;
+    if (nvs_get_u32(handle, UPLOAD_ACKED_KEY, &acked) == ESP_OK) set_acked(acked);
+    nvs_close(handle);
+}
+
+static void store_acked(void) {
+    nvs_handle_t handle;
+    esp_err_t result = nvs_open(UPLOAD_NAMESPACE, NVS_READWRITE, &handle);
+    if (result == ESP_OK) {
+        result = nvs_set_u32(handle, UPLOAD_ACKED_KEY, stats.acked_sequence);
+        if (result == ESP_OK) result = nvs_commit(handle);
+        nvs_close(handle);
+    }
+
+    if (result != ESP_OK) {
+        ESP_LOGW(TAG, "offset not stored: %s", esp_err_to_name(result));
+    }
+}
+
+// One request on the kept-alive connection, false without a valid acknowledgement. The connection
+// is only opened by the first request of a window, the rest of the body is drained so the next
+// request starts on a clean stream. After a failure the connection is closed, the next open reconnects.
+static bool post_frame(esp_http_client_handle_t client, const size_t length, uint32_t *acked) {
+    bool ok = false;
+    if (esp_http_client_open(client, (int) length) == ESP_OK
+        && esp_http_client_write(client, (const char *) frame, (int) length) == (int) length
+        && esp_http_client_fetch_headers(client) >= 0
+        && esp_http_client_get_status_code(client) == 200) {
+        char body[16];
+        const int read = esp_http_client_read(client, body, sizeof(body) - 1);
+        if (read > 0) {
+            body[read] = '\0';
+            char *end;
+            *acked = strtoul(body, &end, 10);
+            ok = end != body && esp_http_client_flush_response(client, NULL) == ESP_OK;
+        }
+    }
+
+    if (!ok) esp_http_client_close(client);
+    return ok;
+}
+#endif
+
+void upload_pending_records(const uint32_t budget_ms) {
+#ifndef UPLOAD_URL
+    (void) budget_ms;
+#else
+    if (!acked_loaded) load_acked();
+
+    // sequences start over after the journal partition was erased
+    const uint32_t next_sequence = journal_next_sequence();
+    if (stats.acked_sequence >= next_sequence) {
+        set_acked(0);
+        store_acked();
+    }
+    if (stats.acked_sequence + 1 >= next_sequence) return;
+
+    uint8_t device[6];
+    esp_read_mac(device, ESP_MAC_WIFI_STA);
+
+    const esp_http_client_config_t config = {
+        .url = UPLOAD_URL,
+        .method = HTTP_METHOD_POST,
+        .timeout_ms = UPLOAD_TIMEOUT_MS,
+        .keep_alive_enable = true,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) return;
+    esp_http_client_set_header(client, "Content-Type", "application/octet-stream");
+
+    const int64_t started_us = esp_timer_get_time();
+    const int64_t deadline_us = started_us + (int64_t) budget_ms * 1000;
+
+    for (int sent = 0; sent < UPLOAD_MAX_FRAMES_PER_WINDOW && esp_timer_get_time() < deadline_us; sent++) {
+        const int count = journal_read_since(stats.acked_sequence, entries, STAMP_FRAME_MAX_ENTRIES);
+        if (count == 0) break;
+
+        const size_t length = stamp_frame_encode(device, entries, count, frame);
+        const uint32_t last_sequence = entries[count - 1].sequence;
+
+        // A lost acknowledgement resends the frame, the collector drops sequences it already has.
+        // The collector may have dropped the kept-alive connection since the last frame, that
+        // costs one retry on a new connection.
+        uint32_t acked;
+        bool posted = post_frame(client, length, &acked);
+        if (!posted && sent > 0) posted = post_frame(client, length, &acked);
+
+        if (!posted || acked <= stats.acked_sequence) {
+            ESP_LOGW(TAG, "frame %lu..%lu not acknowledged",
+                     (unsigned long) entries[0].sequence, (unsigned long) last_sequence);
+            taskENTER_CRITICAL(&stats_mux);
+            stats.failures++;
+            taskEXIT_CRITICAL(&stats_mux);
+            break;
+        }
+
+        taskENTER_CRITICAL(&stats_mux);
+        stats.acked_sequence = acked < last_sequence ? acked : last_sequence;
+        stats.frames++;
+        stats.records += (uint32_t) count;
+        stats.bytes += (uint32_t) length;
+        taskEXIT_CRITICAL(&stats_mux);
+        store_acked();
+    }
+
+    // the only place the connection of the window is torn down
+    esp_http_client_cleanup(client);
+    const uint32_t upload_ms = (uint32_t) ((esp_timer_get_time() - started_us) / 1000);
+    taskENTER_CRITICAL(&stats_mux);
+    stats.last_upload_ms = upload_ms;
+    taskEXIT_CRITICAL(&stats_mux);
+    ESP_LOGI(TAG, "acked up to %lu in %lu ms",
+             (unsigned long) stats.acked_sequence, (unsigned long) stats.last_upload_ms);
+#endif
+}
+
+void get_upload_stats(UploadStats_t *out) {
+    taskENTER_CRITICAL(&stats_mux);
+    *out = stats;
+    taskEXIT_CRITICAL(&stats_mux);
+}
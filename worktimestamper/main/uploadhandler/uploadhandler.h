@@ -0,0 +1,24 @@
+#ifndef UPLOADHANDLER_H
+#define UPLOADHANDLER_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t acked_sequence; // newest journal record the collector confirmed
+    uint32_t frames;
+    uint32_t records;
+    uint32_t bytes;
+    uint32_t failures;
+    uint32_t last_upload_ms; // time spent in the last radio window
+} UploadStats_t;
+
+// POSTs the journal records the collector has not acknowledged yet to UPLOAD_URL (credentials.h),
+// in stamp frames of up to STAMP_FRAME_MAX_ENTRIES. The collector answers 200 with the newest
+// sequence it stored as decimal text, which is persisted and the next frame resumes behind.
+// Runs inside the radio window of the time sync and gives up after budget_ms.
+// Does nothing if UPLOAD_URL is not defined.
+void upload_pending_records(uint32_t budget_ms);
+
+void get_upload_stats(UploadStats_t *stats);
+
+#endif
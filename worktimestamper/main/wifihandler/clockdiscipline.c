@@ -0,0 +1,147 @@
+#include "clockdiscipline.h"
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <nvs.h>
+#include <stdlib.h>
+
+#define DRIFT_NAMESPACE "clock"
+#define DRIFT_KEY "drift_ppb"
+
+// assumed until a rate is learned, the RTC slow clock used in light sleep is far worse than the crystal
+#define DEFAULT_DRIFT_PPB 100000
+// shorter intervals measure SNTP jitter rather than drift
+#define MIN_DRIFT_INTERVAL_US (10LL * 60 * 1000000)
+// a new sample moves the estimate by 1/DRIFT_SMOOTHING
+#define DRIFT_SMOOTHING 4
+// adjtime slews roughly 1/64 s per second, larger errors would take hours and are stepped
+#define MAX_SLEW_US (10LL * 1000000)
+
+#define MIN_RESYNC_S (15 * 60)
+#define MAX_RESYNC_S (24 * 60 * 60)
+
+static const char *TAG = "CLOCK";
+
+// written by the sync task, read by diagnostics
+static portMUX_TYPE discipline_mux = portMUX_INITIALIZER_UNLOCKED;
+static int32_t drift_ppb = DEFAULT_DRIFT_PPB;
+static bool drift_learned;
+static bool synced;
+static int64_t last_sync_us; // esp_timer time of the last applied answer
+static int64_t last_offset_us;
+
+static void store_drift(const int32_t ppb) {
+    nvs_handle_t handle;
+    esp_err_t result = nvs_open(DRIFT_NAMESPACE, NVS_READWRITE, &handle);
+    if (result == ESP_OK) {
+        result = nvs_set_i32(handle, DRIFT_KEY, ppb);
+        if (result == ESP_OK) result = nvs_commit(handle);
+        nvs_close(handle);
+    }
+
+    if (result != ESP_OK) {
+        ESP_LOGW(TAG, "drift not stored: %s", esp_err_to_name(result));
+    }
+}
+
+void clock_discipline_init(void) {
+    nvs_handle_t handle;
+    if (nvs_open(DRIFT_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return;
+
+    int32_t stored;
+    if (nvs_get_i32(handle, DRIFT_KEY, &stored) == ESP_OK) {
+        drift_ppb = stored;
+        drift_learned = true;
+        ESP_LOGI(TAG, "drift %ld ppb", (long) stored);
+    }
+    nvs_close(handle);
+}
+
+// error_us accumulated over interval_us since the clock was last set right, returns the new rate
+static int32_t learn_drift(const int64_t error_us, const int64_t interval_us) {
+    // the clock ran fast if the server is behind it
+    const int32_t sample = (int32_t) (-error_us * 1000000000LL / interval_us);
+
+    taskENTER_CRITICAL(&discipline_mux);
+    drift_ppb = drift_learned ? drift_ppb + (sample - drift_ppb) / DRIFT_SMOOTHING : sample;
+    drift_learned = true;
+    const int32_t learned = drift_ppb;
+    taskEXIT_CRITICAL(&discipline_mux);
+
+    return learned;
+}
+
+void clock_discipline_apply(const int64_t offset_us) {
+    const int64_t now_us = esp_timer_get_time();
+
+    // a slew still running belongs to the last correction, it is not new drift
+    struct timeval pending;
+    adjtime(NULL, &pending);
+    const int64_t pending_us = (int64_t) pending.tv_sec * 1000000 + pending.tv_usec;
+
+    const bool step = !synced || llabs(offset_us) > MAX_SLEW_US;
+    if (step) {
+        const struct timeval no_slew = {0};
+        adjtime(&no_slew, NULL);
+
+        struct timeval local;
+        gettimeofday(&local, NULL);
+        const int64_t server_us = (int64_t) local.tv_sec * 1000000 + local.tv_usec + offset_us;
+        const struct timeval server_time = {.tv_sec = server_us / 1000000, .tv_usec = server_us % 1000000};
+        settimeofday(&server_time, NULL);
+    } else {
+        const struct timeval delta = {.tv_sec = offset_us / 1000000, .tv_usec = offset_us % 1000000};
+        adjtime(&delta, NULL);
+    }
+
+    const int64_t interval_us = now_us - last_sync_us;
+    const bool learns = !step && interval_us >= MIN_DRIFT_INTERVAL_US;
+
+    taskENTER_CRITICAL(&discipline_mux);
+    const bool was_synced = synced;
+    synced = true;
+    last_sync_us = now_us;
+    last_offset_us = offset_us;
+    taskEXIT_CRITICAL(&discipline_mux);
+
+    if (step && was_synced) {
+        ESP_LOGW(TAG, "stepped by %lld ms", (long long) (offset_us / 1000));
+    }
+    if (learns) {
+        store_drift(learn_drift(offset_us - pending_us, interval_us));
+    }
+}
+
+uint32_t clock_discipline_next_sync_s(const uint32_t max_error_ms) {
+    taskENTER_CRITICAL(&discipline_mux);
+    const int64_t drift = llabs(drift_ppb);
+    taskEXIT_CRITICAL(&discipline_mux);
+
+    if (drift == 0) return MAX_RESYNC_S;
+
+    // error_us = drift_ppb * t_us / 1e9
+    const int64_t seconds = (int64_t) max_error_ms * 1000000 / drift;
+    if (seconds < MIN_RESYNC_S) return MIN_RESYNC_S;
+    if (seconds > MAX_RESYNC_S) return MAX_RESYNC_S;
+    return (uint32_t) seconds;
+}
+
+void get_clock_discipline_status(ClockDisciplineStatus_t *status) {
+    struct timeval pending;
+    adjtime(NULL, &pending);
+    const int64_t now_us = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&discipline_mux);
+    status->synced = synced;
+    status->drift_learned = drift_learned;
+    status->drift_ppb = drift_ppb;
+    status->last_offset_us = last_offset_us;
+    const int64_t since_us = synced ? now_us - last_sync_us : 0;
+    taskEXIT_CRITICAL(&discipline_mux);
+
+    status->since_sync_s = (uint32_t) (since_us / 1000000);
+    status->estimated_error_us = !status->synced
+                                     ? -1
+                                     : since_us / 1000 * llabs(status->drift_ppb) / 1000000
+                                       + llabs((int64_t) pending.tv_sec * 1000000 + pending.tv_usec);
+}
@@ -0,0 +1,30 @@
+#ifndef CLOCKDISCIPLINE_H
+#define CLOCKDISCIPLINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+typedef struct {
+    bool synced; // at least one SNTP answer was applied since boot
+    bool drift_learned; // drift_ppb was measured, not assumed
+    int32_t drift_ppb; // positive if the local clock runs fast
+    int64_t last_offset_us; // server minus local clock at the last answer
+    int64_t estimated_error_us; // expected distance to the real time right now, -1 before the first sync
+    uint32_t since_sync_s;
+} ClockDisciplineStatus_t;
+
+// loads the persisted drift rate, needs nvs_flash_init
+void clock_discipline_init(void);
+
+// Apply an SNTP answer, offset_us is server minus local clock. The first one after boot and large
+// errors step the clock, everything else is slewed with adjtime so open sessions never jump.
+// Slewed answers teach the drift rate.
+void clock_discipline_apply(int64_t offset_us);
+
+// Seconds until the estimated error reaches max_error_ms
+uint32_t clock_discipline_next_sync_s(uint32_t max_error_ms);
+
+void get_clock_discipline_status(ClockDisciplineStatus_t *status);
+
+#endif
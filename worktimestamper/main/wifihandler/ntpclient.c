@@ -0,0 +1,172 @@
+#include "ntpclient.h"
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <lwip/netdb.h>
+#include <lwip/sockets.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define NTP_PACKET_SIZE 48
+#define NTP_VERSION 4
+#define NTP_MODE_CLIENT 3
+#define NTP_MODE_SERVER 4
+#define NTP_LEAP_UNSYNCED 3
+
+// offsets into the packet
+#define NTP_STRATUM 1
+#define NTP_ORIGINATE 24
+#define NTP_RECEIVE 32
+#define NTP_TRANSMIT 40
+
+// seconds from 1900-01-01 to 1970-01-01
+#define NTP_UNIX_OFFSET 2208988800ULL
+
+static const char *TAG = "NTP";
+
+typedef struct {
+    struct sockaddr_in address;
+    bool asked;
+    uint8_t transmit[8]; // echoed back as originate, tells the answers apart
+    int64_t sent_wall_us;
+    int64_t sent_us; // esp_timer, the round trip must not depend on a clock being set
+} NtpRequest_t;
+
+static uint32_t read_u32(const uint8_t *src) {
+    return (uint32_t) src[0] << 24 | (uint32_t) src[1] << 16 | (uint32_t) src[2] << 8 | src[3];
+}
+
+static void write_u32(uint8_t *dst, const uint32_t value) {
+    dst[0] = (uint8_t) (value >> 24);
+    dst[1] = (uint8_t) (value >> 16);
+    dst[2] = (uint8_t) (value >> 8);
+    dst[3] = (uint8_t) value;
+}
+
+static int64_t ntp_to_unix_us(const uint8_t *timestamp) {
+    uint64_t seconds = read_u32(timestamp);
+    // era 1 starts in 2036, seconds which would lie before 1968 belong to it
+    if (seconds < 0x80000000u) seconds += 0x100000000ULL;
+
+    const int64_t fraction_us = (int64_t) (((uint64_t) read_u32(timestamp + 4) * 1000000) >> 32);
+    return (int64_t) (seconds - NTP_UNIX_OFFSET) * 1000000 + fraction_us;
+}
+
+static void unix_us_to_ntp(const int64_t unix_us, uint8_t *timestamp) {
+    const uint64_t seconds = (uint64_t) (unix_us / 1000000) + NTP_UNIX_OFFSET;
+    write_u32(timestamp, (uint32_t) seconds);
+    write_u32(timestamp + 4, (uint32_t) (((uint64_t) (unix_us % 1000000) << 32) / 1000000));
+}
+
+static int64_t wall_us(void) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_usec;
+}
+
+static bool resolve(const NtpServer_t *server, struct sockaddr_in *address) {
+    const struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_DGRAM};
+    struct addrinfo *found = NULL;
+    if (getaddrinfo(server->host, NULL, &hints, &found) != 0 || found == NULL) return false;
+
+    memcpy(address, found->ai_addr, sizeof(*address));
+    address->sin_port = htons(server->port);
+    freeaddrinfo(found);
+    return true;
+}
+
+// index of the request reply answers, -1 for anything malformed, unsynced or unasked
+static int match_reply(const uint8_t *reply, const int length, const NtpRequest_t *requests, const int count) {
+    if (length < NTP_PACKET_SIZE) return -1;
+    if ((reply[0] & 0x07) != NTP_MODE_SERVER || reply[0] >> 6 == NTP_LEAP_UNSYNCED) return -1;
+    if (reply[NTP_STRATUM] == 0 || reply[NTP_STRATUM] > 15) return -1;
+    if (read_u32(reply + NTP_TRANSMIT) == 0) return -1;
+
+    for (int i = 0; i < count; i++) {
+        if (requests[i].asked && memcmp(reply + NTP_ORIGINATE, requests[i].transmit, 8) == 0) return i;
+    }
+    return -1;
+}
+
+static void send_requests(const int sock, NtpRequest_t *requests, const int count) {
+    for (int i = 0; i < count; i++) {
+        if (!requests[i].asked) continue;
+
+        uint8_t request[NTP_PACKET_SIZE] = {0};
+        request[0] = NTP_VERSION << 3 | NTP_MODE_CLIENT;
+
+        requests[i].sent_wall_us = wall_us();
+        unix_us_to_ntp(requests[i].sent_wall_us, request + NTP_TRANSMIT);
+        request[NTP_TRANSMIT + 7] ^= (uint8_t) (i + 1); // requests sent in the same microsecond stay distinct
+        memcpy(requests[i].transmit, request + NTP_TRANSMIT, 8);
+
+        requests[i].sent_us = esp_timer_get_time();
+        const int sent = sendto(sock, request, sizeof(request), 0,
+                                (const struct sockaddr *) &requests[i].address, sizeof(requests[i].address));
+        requests[i].asked = sent == NTP_PACKET_SIZE;
+    }
+}
+
+bool ntp_query(const NtpServer_t *servers, int count, const uint32_t timeout_ms, const uint32_t grace_ms,
+               NtpResult_t *result) {
+    if (count > NTP_MAX_SERVERS) count = NTP_MAX_SERVERS;
+
+    // resolve everything first so the requests leave back to back
+    NtpRequest_t requests[NTP_MAX_SERVERS] = {0};
+    for (int i = 0; i < count; i++) {
+        requests[i].asked = resolve(&servers[i], &requests[i].address);
+        if (!requests[i].asked) ESP_LOGW(TAG, "%s not resolved", servers[i].host);
+    }
+
+    const int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) return false;
+
+    const int64_t started_us = esp_timer_get_time();
+    send_requests(sock, requests, count);
+
+    bool accepted = false;
+    int64_t deadline_us = started_us + (int64_t) timeout_ms * 1000;
+    result->answers = 0;
+
+    // select wakes on every reply, nothing is polled
+    while (1) {
+        const int64_t wait_us = deadline_us - esp_timer_get_time();
+        if (wait_us <= 0) break;
+
+        struct timeval wait = {.tv_sec = wait_us / 1000000, .tv_usec = wait_us % 1000000};
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(sock, &readable);
+        if (select(sock + 1, &readable, NULL, NULL, &wait) <= 0) break;
+
+        uint8_t reply[NTP_PACKET_SIZE];
+        const int length = recv(sock, reply, sizeof(reply), 0);
+        const int64_t received_us = esp_timer_get_time();
+        const int64_t received_wall_us = wall_us();
+
+        const int server = match_reply(reply, length, requests, count);
+        if (server < 0) continue;
+
+        const NtpRequest_t *request = &requests[server];
+        const int64_t server_received_us = ntp_to_unix_us(reply + NTP_RECEIVE);
+        const int64_t server_sent_us = ntp_to_unix_us(reply + NTP_TRANSMIT);
+        const int64_t rtt_us = received_us - request->sent_us - (server_sent_us - server_received_us);
+        result->answers++;
+
+        if (accepted && rtt_us >= result->rtt_us) continue;
+
+        result->server = server;
+        result->rtt_us = (uint32_t) (rtt_us > 0 ? rtt_us : 0);
+        result->offset_us = ((server_received_us - request->sent_wall_us) + (server_sent_us - received_wall_us)) / 2;
+        result->latency_us = (uint32_t) (received_us - started_us);
+
+        if (!accepted) {
+            accepted = true;
+            const int64_t grace_end_us = received_us + (int64_t) grace_ms * 1000;
+            if (grace_end_us < deadline_us) deadline_us = grace_end_us;
+        }
+    }
+
+    close(sock);
+    return accepted;
+}
@@ -0,0 +1,27 @@
+#ifndef NTPCLIENT_H
+#define NTPCLIENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define NTP_PORT 123
+#define NTP_MAX_SERVERS 4
+
+typedef struct {
+    const char *host; // name or IPv4 literal
+    uint16_t port;
+} NtpServer_t;
+
+typedef struct {
+    int server; // index of the accepted answer
+    int answers; // valid answers that arrived in time
+    int64_t offset_us; // server minus local clock
+    uint32_t rtt_us; // network round trip of the accepted answer, server processing excluded
+    uint32_t latency_us; // first request sent until the accepted answer arrived
+} NtpResult_t;
+
+// Send one request to every server at once. After the first valid answer the others get
+// grace_ms to beat its round trip, the lowest one wins. False if nothing valid arrived in timeout_ms.
+bool ntp_query(const NtpServer_t *servers, int count, uint32_t timeout_ms, uint32_t grace_ms, NtpResult_t *result);
+
+#endif
@@ -0,0 +1,45 @@
+#include "wificache.h"
+#include <esp_log.h>
+#include <nvs.h>
+#include <string.h>
+
+#define CACHE_NAMESPACE "wifi_cache"
+#define CACHE_KEY "ap_v1" // bump when WifiCache_t changes, old blobs then fail the size check
+
+static const char *TAG = "WIFI_CACHE";
+
+bool wifi_cache_load(WifiCache_t *cache) {
+    nvs_handle_t handle;
+    if (nvs_open(CACHE_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return false;
+
+    size_t size = sizeof(*cache);
+    const esp_err_t result = nvs_get_blob(handle, CACHE_KEY, cache, &size);
+    nvs_close(handle);
+
+    return result == ESP_OK && size == sizeof(*cache) && cache->channel != 0 && cache->ip_info.ip.addr != 0;
+}
+
+void wifi_cache_store(const WifiCache_t *cache) {
+    WifiCache_t stored;
+    if (wifi_cache_load(&stored) && memcmp(&stored, cache, sizeof(stored)) == 0) return;
+
+    nvs_handle_t handle;
+    esp_err_t result = nvs_open(CACHE_NAMESPACE, NVS_READWRITE, &handle);
+    if (result == ESP_OK) {
+        result = nvs_set_blob(handle, CACHE_KEY, cache, sizeof(*cache));
+        if (result == ESP_OK) result = nvs_commit(handle);
+        nvs_close(handle);
+    }
+
+    if (result != ESP_OK) {
+        ESP_LOGW(TAG, "store failed: %s", esp_err_to_name(result));
+    }
+}
+
+void wifi_cache_clear(void) {
+    nvs_handle_t handle;
+    if (nvs_open(CACHE_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) return;
+
+    if (nvs_erase_key(handle, CACHE_KEY) == ESP_OK) nvs_commit(handle);
+    nvs_close(handle);
+}
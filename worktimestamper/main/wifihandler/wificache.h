@@ -0,0 +1,25 @@
+#ifndef WIFICACHE_H
+#define WIFICACHE_H
+
+#include <esp_netif.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// everything the last successful connect learned, enough to skip the scan and DHCP next time
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+    esp_netif_ip_info_t ip_info; // lease reused as a static IP
+    esp_netif_dns_info_t dns;
+} WifiCache_t;
+
+// needs nvs_flash_init, false if nothing usable is stored
+bool wifi_cache_load(WifiCache_t *cache);
+
+// only writes the flash if the cache changed
+void wifi_cache_store(const WifiCache_t *cache);
+
+// the cached AP or lease failed, the next connect scans and asks DHCP again
+void wifi_cache_clear(void);
+
+#endif
@@ -1,41 +1,75 @@
 #include "systemeventhandler.h"
 #include "wifisynchandler.h"
+#include "wificache.h"
+#include "clockdiscipline.h"
+#include "ntpclient.h"
+#include "uploadhandler.h"
 #include "credentials.h"
-#include "oledhandler.h"
 
 #include "freertos/FreeRTOS.h"
 #include <freertos/task.h>
 #include <esp_event.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <esp_wifi.h>
 #include <esp_wifi_default.h>
 #include <nvs_flash.h>
 #include <portmacro.h>
 #include <stdint.h>
+#include <string.h>
 #include <driver/gpio.h>
-#include <lwip/apps/sntp.h>
 #include <rom/ets_sys.h>
 
 #define WIFI_CONNECTED_BIT BIT0
 
-enum {
-    WIFI_CONNECT_INFO = 0,
-    WIFI_CONNECTION_STATE = 1,
-    INIT_TIME_SYNC = 3,
-    CLOCK_INFO = 4,
-    WIFI_DISCONNECTED_INFO = 5,
-    CONTROLLER_READY = 7,
-} WIFI_OLED_OUTPUT;
+// the cached AP answers within a few hundred ms, a full scan over all channels takes seconds
+#define FAST_CONNECT_TIMEOUT_MS 2000
+#define SCAN_CONNECT_TIMEOUT_MS 10000
+#define SCAN_CONNECT_ATTEMPTS 3
+#define SNTP_TIMEOUT_MS 3000
+// after the first answer the other servers get this long to beat its round trip
+#define SNTP_GRACE_MS 100
+// radio time the stamp upload may add to a sync window
+#define UPLOAD_BUDGET_MS 2000
+
+// after a failed sync, doubled on every further failure
+#define RETRY_MIN_S 60
+#define RETRY_MAX_S (60 * 60)
+
+static const char *TAG = "WIFI_SYNC";
+
+// asked all at once, a LAN server (e.g. the router) usually answers first and with the lowest round trip
+static const NtpServer_t ntp_servers[] = {
+#ifdef NTP_LAN_SERVER
+    {NTP_LAN_SERVER, NTP_PORT},
+#endif
+    {"pool.ntp.org", NTP_PORT},
+    {"time.cloudflare.com", NTP_PORT},
+    {"time.google.com", NTP_PORT},
+};
 
 static bool is_connected;
 static bool should_reconnect = true;
+static time_sync_callback_t sync_callback;
+static uint32_t max_clock_error_ms;
+static esp_netif_t *sta_netif;
+
+// esp_timer times of the connect phases, written by the event handler
+static int64_t connect_started_us;
+static int64_t associated_us;
+static int64_t got_ip_us;
+static int64_t radio_started_us;
+
+// the run in progress is only touched by the sync task, readers get the last finished run from timings
+static WifiSyncTimings_t current_run;
+static WifiSyncTimings_t timings;
+static portMUX_TYPE timings_mux = portMUX_INITIALIZER_UNLOCKED;
 
 void wifi_log_status(const bool connected) {
     if (connected) {
-        send_text_at_row(" WIFI connected", WIFI_CONNECTION_STATE);
+        ESP_LOGI(TAG, "WIFI connected");
     } else {
-        send_text_at_row(" WIFI error", WIFI_CONNECTION_STATE);
-        send_text_at_row(" retry...", WIFI_CONNECTION_STATE + 1);
+        ESP_LOGW(TAG, "WIFI error, retry...");
     }
 }
 
@@ -47,8 +81,8 @@ static void wifi_event_handler(
 ) {
     if (event_base == WIFI_EVENT) {
         switch (event_id) {
-            case WIFI_EVENT_STA_START:
-                esp_wifi_connect();
+            case WIFI_EVENT_STA_CONNECTED:
+                associated_us = esp_timer_get_time();
                 break;
             case WIFI_EVENT_STA_DISCONNECTED:
                 ESP_LOGW("WIFI", "Disconnected, should_reconnect=%d", should_reconnect);
@@ -61,17 +95,75 @@ static void wifi_event_handler(
         }
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ESP_LOGI("WIFI", "Got IP");
+        got_ip_us = esp_timer_get_time();
         set_event_bit(EVENT_BIT_WIFI_CONNECTED);
     }
 }
 
-bool setup_wifi(int *retry_out) {
+static uint32_t elapsed_ms(const int64_t from_us, const int64_t to_us) {
+    return to_us > from_us ? (uint32_t) ((to_us - from_us) / 1000) : 0;
+}
+
+// With a cache the known AP is joined on its channel without a scan and the old lease is set
+// as static IP, so no DHCP round trip is needed. Without one the AP is scanned and DHCP asked.
+static bool connect_with(const WifiCache_t *cache, const int timeout_ms) {
+    wifi_config_t wifi_config = {
+        .sta = {
+            .ssid = WIFI_SSID,
+            .password = WIFI_PASS
+        }
+    };
+
+    if (cache) {
+        memcpy(wifi_config.sta.bssid, cache->bssid, sizeof(cache->bssid));
+        wifi_config.sta.bssid_set = true;
+        wifi_config.sta.channel = cache->channel;
+
+        esp_netif_dhcpc_stop(sta_netif);
+        esp_netif_set_ip_info(sta_netif, &cache->ip_info);
+        esp_netif_dns_info_t dns = cache->dns;
+        esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+    } else {
+        esp_netif_dhcpc_start(sta_netif);
+    }
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+
+    clear_event_bit(EVENT_BIT_WIFI_CONNECTED);
+    associated_us = 0;
+    connect_started_us = esp_timer_get_time();
+    should_reconnect = true;
+    esp_wifi_connect();
+
+    return wait_for_state_with_ms(EVENT_BIT_WIFI_CONNECTED, timeout_ms);
+}
+
+// stop the retries of a failed attempt before the config is changed
+static void abort_connect(void) {
+    should_reconnect = false;
+    esp_wifi_disconnect();
+}
+
+static void store_cache(void) {
+    WifiCache_t cache;
+    memset(&cache, 0, sizeof(cache)); // the padding is compared too
+
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) return;
+    if (esp_netif_get_ip_info(sta_netif, &cache.ip_info) != ESP_OK) return;
+    esp_netif_get_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &cache.dns);
+
+    memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+    cache.channel = ap.primary;
+    wifi_cache_store(&cache);
+}
+
+static void init_wifi(void) {
     esp_log_level_set("wifi", ESP_LOG_INFO);
 
     ESP_ERROR_CHECK(nvs_flash_init());
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
+    sta_netif = esp_netif_create_default_wifi_sta();
 
     const wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
@@ -81,83 +173,180 @@ bool setup_wifi(int *retry_out) {
     // register the event handler for listening to IP_EVENT_STA_GOT_IP event from WI-FI stack
     esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL);
     esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL);
+}
 
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = WIFI_SSID,
-            .password = WIFI_PASS
-        }
-    };
-    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config));
+bool setup_wifi(int *retry_out) {
+    current_run.fast_path = false;
+    current_run.assoc_ms = 0;
+    current_run.ip_ms = 0;
+    current_run.sntp_ms = 0;
+    current_run.ntp_latency_ms = 0;
+    current_run.ntp_rtt_ms = 0;
+    current_run.ntp_answers = 0;
+    current_run.ntp_server = NULL;
 
+    radio_started_us = esp_timer_get_time();
     ESP_ERROR_CHECK(esp_wifi_start());
-    ESP_ERROR_CHECK(esp_wifi_connect());
+
+    WifiCache_t cache;
+    if (wifi_cache_load(&cache)) {
+        current_run.fast_path = connect_with(&cache, FAST_CONNECT_TIMEOUT_MS);
+        if (!current_run.fast_path) {
+            ESP_LOGW(TAG, "cached AP not reachable, scanning");
+            abort_connect();
+            wifi_cache_clear();
+        }
+        is_connected = current_run.fast_path;
+    }
 
     int retry = 0;
-    while (retry < 5) {
-        if (wait_for_state(EVENT_BIT_WIFI_CONNECTED)) {
+    while (!is_connected && retry < SCAN_CONNECT_ATTEMPTS) {
+        if (connect_with(NULL, SCAN_CONNECT_TIMEOUT_MS)) {
             is_connected = true;
+            store_cache();
             break;
         }
 
+        abort_connect();
         retry++;
     }
 
+    if (is_connected) {
+        current_run.assoc_ms = elapsed_ms(connect_started_us, associated_us);
+        current_run.ip_ms = elapsed_ms(associated_us, got_ip_us);
+    }
+
     if (retry_out) *retry_out = retry;
     return is_connected;
 }
 
+// the radio stays off between syncs, the handlers stay registered for the next run
 void disconnect_wifi() {
     should_reconnect = false;
+    is_connected = false;
 
     esp_wifi_disconnect();
     esp_wifi_stop();
 
-    esp_event_handler_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler);
-    esp_event_handler_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler);
-}
+    current_run.radio_on_ms = elapsed_ms(radio_started_us, esp_timer_get_time());
+    current_run.radio_on_total_ms += current_run.radio_on_ms;
+    current_run.runs++;
 
-static void initTimeSync() {
-    sntp_setoperatingmode(SNTP_OPMODE_POLL);
-    sntp_setservername(0, "pool.ntp.org");
-    sntp_init();
-    setenv("TZ", "CET-1CEST,M3.5.0/2,M10.5.0/3", 1); // Central Europe
+    // published in one piece, the console never sees a run half updated
+    taskENTER_CRITICAL(&timings_mux);
+    timings = current_run;
+    taskEXIT_CRITICAL(&timings_mux);
 }
 
-static void waitForTime() {
+static bool sync_time(void) {
+    NtpResult_t result;
+    const int count = (int) (sizeof(ntp_servers) / sizeof(ntp_servers[0]));
+    if (!ntp_query(ntp_servers, count, SNTP_TIMEOUT_MS, SNTP_GRACE_MS, &result)) return false;
+
+    clock_discipline_apply(result.offset_us);
+    current_run.sntp_ms = elapsed_ms(got_ip_us, esp_timer_get_time());
+    current_run.ntp_latency_ms = result.latency_us / 1000;
+    current_run.ntp_rtt_ms = result.rtt_us / 1000;
+    current_run.ntp_answers = (uint8_t) result.answers;
+    current_run.ntp_server = ntp_servers[result.server].host;
+
     time_t now = 0;
     struct tm timeInfo = {0};
+    time(&now);
+    localtime_r(&now, &timeInfo);
+
+    ESP_LOGI(TAG, "clock: %02d:%02d from %s, rtt %lu ms, %d answers",
+             timeInfo.tm_hour, timeInfo.tm_min, current_run.ntp_server,
+             (unsigned long) current_run.ntp_rtt_ms, result.answers);
+    return true;
+}
 
-    while (timeInfo.tm_year < 2020 - 1900) {
-        vTaskDelay(pdMS_TO_TICKS(2000));
-        time(&now);
-        localtime_r(&now, &timeInfo);
+// one radio-on window: connect, wait for one SNTP answer, upload stamps, switch the radio off again
+static bool sync_once(void) {
+    ESP_LOGI(TAG, "Connecting to WIFI");
+    int retries = 0;
+    const bool success = setup_wifi(&retries);
+    wifi_log_status(success);
+
+    bool synced = false;
+    if (is_connected) {
+        synced = sync_time();
+        if (!synced) {
+            ESP_LOGW(TAG, "no SNTP answer");
+            // a stale static lease can associate fine but never route, scan and ask DHCP next time
+            if (current_run.fast_path) wifi_cache_clear();
+        }
+
+        // the radio is on anyway, unsynced stamps are sent too and the collector applies the correction
+        upload_pending_records(UPLOAD_BUDGET_MS);
     }
 
-    char buffer[50];
-    snprintf(buffer, sizeof(buffer), " clock: %02d:%02d", timeInfo.tm_hour, timeInfo.tm_min);
-    send_text_at_row(buffer, CLOCK_INFO);
+    disconnect_wifi();
+    ESP_LOGI(TAG, "WIFI disconnected");
+    ESP_LOGI(TAG, "%s connect: assoc %lu ms, ip %lu ms, sntp %lu ms, radio on %lu ms",
+             current_run.fast_path ? "fast" : "scan",
+             (unsigned long) current_run.assoc_ms, (unsigned long) current_run.ip_ms,
+             (unsigned long) current_run.sntp_ms, (unsigned long) current_run.radio_on_ms);
+
+    return synced;
+}
+
+static void log_clock_status(const uint32_t next_sync_s) {
+    ClockDisciplineStatus_t clock;
+    get_clock_discipline_status(&clock);
+    WifiSyncTimings_t radio;
+    get_wifi_sync_timings(&radio);
+
+    ESP_LOGI(TAG, "drift %ld ppb%s, offset %lld ms, error ~%lld ms, radio duty %lu ppm, next sync in %lu s",
+             (long) clock.drift_ppb, clock.drift_learned ? "" : " (assumed)",
+             (long long) (clock.last_offset_us / 1000), (long long) (clock.estimated_error_us / 1000),
+             (unsigned long) radio.radio_duty_ppm, (unsigned long) next_sync_s);
 }
 
+// Syncs at boot, then wakes the radio again once the drift estimate says the clock
+// error reached max_clock_error_ms. Failed syncs are retried with a growing delay.
 void wifi_sync_task(void *args) {
-    send_text_at_row("Connecting to WIFI", WIFI_CONNECT_INFO);
-    if (!is_connected) {
-        int retries = 0;
-        const bool success = setup_wifi(&retries);
-        wifi_log_status(success);
+    init_wifi();
+    clock_discipline_init();
+
+    bool notified = false;
+    uint32_t retry_s = RETRY_MIN_S;
+
+    // ReSharper disable once CppDFAEndlessLoop
+    while (1) {
+        uint32_t next_sync_s;
+        if (sync_once()) {
+            retry_s = RETRY_MIN_S;
+            next_sync_s = clock_discipline_next_sync_s(max_clock_error_ms);
+
+            // only the first sync after boot moves the clock by more than a slew
+            if (!notified) {
+                notified = true;
+                set_event_bit(EVENT_BIT_WIFI_HANDLER_DONE);
+                if (sync_callback) sync_callback();
+            }
+        } else {
+            next_sync_s = retry_s;
+            retry_s = retry_s * 2 > RETRY_MAX_S ? RETRY_MAX_S : retry_s * 2;
+        }
+
+        log_clock_status(next_sync_s);
+        vTaskDelay(pdMS_TO_TICKS((uint64_t) next_sync_s * 1000));
     }
+}
 
-    send_text_at_row("Init time sync", INIT_TIME_SYNC);
-    initTimeSync();
-    waitForTime();
-    disconnect_wifi();
-    send_text_at_row(" WIFI disconnected", WIFI_DISCONNECTED_INFO);
-    send_text_at_row("Controller ready", CONTROLLER_READY);
-    set_event_bit(EVENT_BIT_WIFI_HANDLER_DONE);
-    vTaskDelete(NULL);
+void get_wifi_sync_timings(WifiSyncTimings_t *out) {
+    taskENTER_CRITICAL(&timings_mux);
+    *out = timings;
+    taskEXIT_CRITICAL(&timings_mux);
+
+    const int64_t uptime_ms = esp_timer_get_time() / 1000;
+    out->radio_duty_ppm = uptime_ms > 0 ? (uint32_t) ((int64_t) out->radio_on_total_ms * 1000000 / uptime_ms) : 0;
 }
 
-void init_wifi_sync_handler(const int priority) {
-    clear_display();
+// runs in the background, the UI does not wait for it
+void init_wifi_sync_handler(const int priority, const uint32_t max_error_ms, const time_sync_callback_t on_synced) {
+    max_clock_error_ms = max_error_ms;
+    sync_callback = on_synced;
     xTaskCreate(wifi_sync_task, "wifi_sync_task", 8192, NULL, priority, NULL);
 }
@@ -1,6 +1,31 @@
 #ifndef WIFI_H
 #define WIFI_H
 
-void init_wifi_sync_handler(int priority);
+#include <stdbool.h>
+#include <stdint.h>
+
+// called from the sync task once SNTP has set the clock for the first time after boot
+typedef void (*time_sync_callback_t)(void);
+
+// phases of the last sync run, 0 for a phase that was not reached
+typedef struct {
+    bool fast_path; // joined the cached AP with the cached lease, no scan and no DHCP
+    uint32_t assoc_ms; // esp_wifi_connect until associated
+    uint32_t ip_ms; // associated until the IP was up
+    uint32_t sntp_ms; // IP up until the clock was set, name lookups included
+    uint32_t ntp_latency_ms; // requests sent until the accepted answer arrived
+    uint32_t ntp_rtt_ms; // round trip of the accepted answer
+    uint8_t ntp_answers; // valid answers within the race
+    const char *ntp_server; // host of the accepted answer
+    uint32_t radio_on_ms; // esp_wifi_start until esp_wifi_stop
+    uint32_t runs; // radio-on windows since boot
+    uint32_t radio_on_total_ms;
+    uint32_t radio_duty_ppm; // radio_on_total_ms per uptime
+} WifiSyncTimings_t;
+
+// Syncs right away and again whenever the estimated clock error reaches max_error_ms
+void init_wifi_sync_handler(int priority, uint32_t max_error_ms, time_sync_callback_t on_synced);
+
+void get_wifi_sync_timings(WifiSyncTimings_t *timings);
 
 #endif
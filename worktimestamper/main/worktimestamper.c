@@ -2,8 +2,13 @@
 #include "buttonisrhandler.h"
 #include "wifisynchandler.h"
 #include "systemeventhandler.h"
+#include "powerhandler.h"
+#include "exporthandler.h"
+#include "tracehandler.h"
+#include "consolehandler.h"
 #include "timetracker_controller.c"
 
+#include <stdlib.h>
 #include <string.h>
 #include <lwip/apps/sntp.h>
 #include "rom/ets_sys.h"
@@ -26,14 +31,28 @@ const char *reset_reason_str(const esp_reset_reason_t reason) {
 void app_main(void) {
     const esp_reset_reason_t reason = esp_reset_reason();
     ESP_LOGI("BOOT", "Reset Reason: %s", reset_reason_str(reason));
+    // local time is needed before SNTP answers, the journal and the day rollover depend on it
+    setenv("TZ", "CET-1CEST,M3.5.0/2,M10.5.0/3", 1);
+    tzset();
+
     init_system_event_group();
+    init_power_handler(60, 300);
     init_oled();
 
     send_text_at_row("   START CONTROLLER ", 1);
-    vTaskDelay(pdMS_TO_TICKS(1000));
 
-    init_button_isr_handler(3);
-    init_wifi_sync_handler(2);
+    // buttons, clock ticks and the time sync event share one event loop task,
+    // tracking starts on the RTC or journal time and SNTP corrects it in the background
+    timetracker_start(3);
+    init_wifi_sync_handler(2, 1000, timetracker_time_synced);
+
+    // journal dump over UART1 for tools/export_decoder.py
+    init_export_handler(1);
+
+    // diagnostics shell on the console UART
+    init_console_handler(1);
 
-    timetracker_start(1);
+#if HOT_PATH_TRACE
+    init_trace(1);
+#endif
 }
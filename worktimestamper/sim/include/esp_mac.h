@@ -0,0 +1,14 @@
+#ifndef SIM_ESP_MAC_H
+#define SIM_ESP_MAC_H
+
+#include "esp_err.h"
+#include <stdint.h>
+
+typedef enum {
+    ESP_MAC_WIFI_STA,
+} esp_mac_type_t;
+
+// a fixed made up address
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type);
+
+#endif
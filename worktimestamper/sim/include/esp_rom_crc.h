@@ -0,0 +1,10 @@
+#ifndef SIM_ESP_ROM_CRC_H
+#define SIM_ESP_ROM_CRC_H
+
+#include <stdint.h>
+
+// same results as the ROM functions, journal images are interchangeable with a device dump
+uint8_t esp_rom_crc8_le(uint8_t crc, const uint8_t *buf, uint32_t len);
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef SIM_ESP_SLEEP_H
+#define SIM_ESP_SLEEP_H
+
+#include "esp_err.h"
+
+// the simulator never sleeps, wake-up sources are accepted and ignored
+esp_err_t esp_sleep_enable_gpio_wakeup(void);
+esp_err_t esp_sleep_enable_uart_wakeup(int uart_num);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef SIM_FREERTOS_H
+#define SIM_FREERTOS_H
+
+// FreeRTOS API of the simulator, implemented on pthreads by simkernel.c
+
+// the IDF pulls assert.h in through esp_assert.h, the firmware relies on it for static_assert
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_attr.h"
+#include "freertos/projdefs.h"
+#include "portmacro.h"
+
+// CONFIG_FREERTOS_HZ is left at the IDF default
+#define configTICK_RATE_HZ 100
+#define configMAX_PRIORITIES 25
+#define tskIDLE_PRIORITY 0
+
+#define BIT0 0x00000001
+#define BIT1 0x00000002
+#define BIT2 0x00000004
+#define BIT3 0x00000008
+#define BIT4 0x00000010
+#define BIT5 0x00000020
+#define BIT6 0x00000040
+#define BIT7 0x00000080
+#define BIT8 0x00000100
+#define BIT9 0x00000200
+#define BIT10 0x00000400
+#define BIT11 0x00000800
+
+#endif
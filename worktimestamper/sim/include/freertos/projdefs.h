@@ -0,0 +1,12 @@
+#ifndef SIM_PROJDEFS_H
+#define SIM_PROJDEFS_H
+
+#define pdFALSE ((BaseType_t) 0)
+#define pdTRUE ((BaseType_t) 1)
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+
+#define pdMS_TO_TICKS(ms) ((TickType_t) (((uint64_t) (ms) * configTICK_RATE_HZ) / 1000))
+#define pdTICKS_TO_MS(ticks) ((TickType_t) (((uint64_t) (ticks) * 1000) / configTICK_RATE_HZ))
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef SIM_SNTP_H
+#define SIM_SNTP_H
+
+// the time sync is replaced by the script command "sync", see simwifi.c
+
+#endif
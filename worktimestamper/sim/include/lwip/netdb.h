@@ -0,0 +1,8 @@
+#ifndef SIM_LWIP_NETDB_H
+#define SIM_LWIP_NETDB_H
+
+// lwIP keeps the BSD resolver API, the host resolver stands in for it
+
+#include <netdb.h>
+
+#endif
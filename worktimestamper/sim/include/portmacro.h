@@ -0,0 +1,42 @@
+#ifndef SIM_PORTMACRO_H
+#define SIM_PORTMACRO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_system.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+
+#define portMAX_DELAY ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+
+// Only one simulated task runs at a time and it is only switched out inside API calls, a critical
+// section just holds back the switch a wake-up inside it would cause.
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+void sim_enter_critical(void);
+void sim_exit_critical(void);
+BaseType_t xPortInIsrContext(void);
+
+#define portENTER_CRITICAL(mux) ((void) (mux), sim_enter_critical())
+#define portEXIT_CRITICAL(mux) ((void) (mux), sim_exit_critical())
+#define portENTER_CRITICAL_ISR(mux) ((void) (mux), sim_enter_critical())
+#define portEXIT_CRITICAL_ISR(mux) ((void) (mux), sim_exit_critical())
+#define portENTER_CRITICAL_SAFE(mux) ((void) (mux), sim_enter_critical())
+#define portEXIT_CRITICAL_SAFE(mux) ((void) (mux), sim_exit_critical())
+#define taskENTER_CRITICAL(mux) ((void) (mux), sim_enter_critical())
+#define taskEXIT_CRITICAL(mux) ((void) (mux), sim_exit_critical())
+#define taskENTER_CRITICAL_ISR(mux) ((void) (mux), sim_enter_critical())
+#define taskEXIT_CRITICAL_ISR(mux) ((void) (mux), sim_exit_critical())
+
+// the woken task is scheduled as soon as the simulated interrupt returns
+#define portYIELD_FROM_ISR(...) do { } while (0)
+
+#endif
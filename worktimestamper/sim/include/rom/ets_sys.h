@@ -0,0 +1,4 @@
+#ifndef SIM_ETS_SYS_H
+#define SIM_ETS_SYS_H
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Interfaces between the simulator parts, the firmware only sees the IDF shims in include/
+
+#define SIM_FOREVER INT64_MAX
+
+// simkernel.c: tasks are pthreads, only the scheduled one runs and it runs in zero virtual time.
+// The virtual clock only moves while every task is blocked, to the next deadline or script step.
+typedef bool (*sim_ready_t)(void *arg);
+
+void sim_kernel_init(void);
+int64_t sim_now_us(void);
+
+// Script side, called by the main thread while no task runs
+void sim_run_until(int64_t until_us);
+void sim_isr_enter(void);
+void sim_isr_exit(void);
+void sim_print_tasks(FILE *out);
+
+// Task side: block until ready(arg) holds or the virtual clock reaches deadline_us,
+// false on timeout. Whoever changes what ready looks at calls sim_recheck.
+bool sim_block_until(sim_ready_t ready, void *arg, int64_t deadline_us);
+void sim_recheck(void);
+
+// simclock in simsystem.c: device wall clock and true time, both move with the virtual clock
+void sim_clock_init(int64_t true_time_us, bool rtc_kept);
+int64_t sim_true_time_us(void);
+int64_t sim_device_time_us(void);
+void sim_set_device_time_us(int64_t time_us);
+bool sim_rtc_kept(void);
+void sim_log_set_level(int level);
+
+// simgpio.c
+void sim_gpio_set_input(int gpio, int level);
+
+// simi2c.c, simssd1306.c
+typedef struct {
+    uint32_t transactions;
+    uint32_t nacks;
+    uint64_t bytes; // address, control and payload bytes
+    uint64_t bits; // SCL cycles including start and stop
+    uint64_t wire_ns;
+} SimI2cStats_t;
+
+void sim_i2c_init(uint32_t max_frequency);
+void sim_i2c_fail_next(uint32_t count);
+uint32_t sim_i2c_frequency(void);
+void sim_i2c_get_stats(SimI2cStats_t *stats);
+void sim_i2c_reset_stats(void);
+
+void ssd1306_reset(void);
+void ssd1306_write(bool is_data, uint8_t byte);
+bool ssd1306_pixel(int x, int y); // as seen on the glass, x to the right and y down
+uint8_t ssd1306_contrast(void);
+bool ssd1306_is_on(void);
+void ssd1306_write_pbm(FILE *out);
+void ssd1306_print(FILE *out);
+
+// simflash.c
+typedef struct {
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t bytes_written;
+    uint32_t sector_erases;
+} SimFlashStats_t;
+
+void sim_flash_init(const char *image_path);
+bool sim_flash_save(void);
+void sim_flash_get_stats(SimFlashStats_t *stats);
+
+// simwifi.c
+void sim_wifi_sync(void);
+
+// simconsole.c: runs a command the firmware registered with esp_console, false if there is none
+bool sim_console_run(const char *line);
+
+#endif
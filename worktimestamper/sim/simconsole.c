@@ -0,0 +1,90 @@
+#include "sim.h"
+
+#include "driver/uart.h"
+#include "esp_console.h"
+#include "esp_log.h"
+
+#include <string.h>
+
+#define MAX_COMMANDS 16
+#define MAX_ARGS 8
+
+// Commands registered by the firmware run on the script thread with the console script command,
+// while every task waits. They see the counters exactly as they are at that virtual time.
+
+static const char *TAG = "SIM_CONSOLE";
+
+struct SimConsoleRepl {
+    const char *prompt;
+};
+
+static struct SimConsoleRepl repl;
+static esp_console_cmd_t commands[MAX_COMMANDS];
+static int command_count;
+
+static int help_command(int argc, char **argv) {
+    (void) argc;
+    (void) argv;
+    for (int i = 0; i < command_count; i++) {
+        printf("%-10s %s\n", commands[i].command, commands[i].help ? commands[i].help : "");
+    }
+    return 0;
+}
+
+esp_err_t esp_console_new_repl_uart(const esp_console_dev_uart_config_t *dev_config,
+                                    const esp_console_repl_config_t *repl_config, esp_console_repl_t **ret_repl) {
+    (void) dev_config;
+    repl.prompt = repl_config->prompt;
+    *ret_repl = &repl;
+    return ESP_OK;
+}
+
+esp_err_t esp_console_cmd_register(const esp_console_cmd_t *cmd) {
+    if (command_count >= MAX_COMMANDS) return ESP_ERR_NO_MEM;
+
+    commands[command_count++] = *cmd;
+    return ESP_OK;
+}
+
+esp_err_t esp_console_register_help_command(void) {
+    const esp_console_cmd_t help = {
+        .command = "help",
+        .help = "list the commands",
+        .func = help_command,
+    };
+    return esp_console_cmd_register(&help);
+}
+
+esp_err_t esp_console_start_repl(esp_console_repl_t *console) {
+    (void) console;
+    ESP_LOGI(TAG, "%d commands, run them with the script command console", command_count);
+    return ESP_OK;
+}
+
+esp_err_t uart_set_wakeup_threshold(const uart_port_t uart_num, const int wakeup_threshold) {
+    (void) uart_num;
+    (void) wakeup_threshold;
+    return ESP_OK;
+}
+
+bool sim_console_run(const char *line) {
+    char copy[256];
+    char *argv[MAX_ARGS];
+    char *save = NULL;
+    int argc = 0;
+
+    snprintf(copy, sizeof(copy), "%s", line);
+    for (char *token = strtok_r(copy, " \t", &save); token && argc < MAX_ARGS; token = strtok_r(NULL, " \t", &save)) {
+        argv[argc++] = token;
+    }
+    if (argc == 0) return false;
+
+    for (int i = 0; i < command_count; i++) {
+        if (strcmp(commands[i].command, argv[0]) != 0) continue;
+
+        printf("%s%s\n", repl.prompt ? repl.prompt : "> ", line);
+        commands[i].func(argc, argv);
+        return true;
+    }
+    return false;
+}
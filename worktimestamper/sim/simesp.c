@@ -0,0 +1,46 @@
+#include "esp_err.h"
+#include "esp_rom_crc.h"
+
+// IDF functions without any state, shared by the simulator and the host tests in tests/
+
+const char *esp_err_to_name(const esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+        default: return "UNKNOWN ERROR";
+    }
+}
+
+// CRC-8 with the polynomial 0x07, bit reflected and inverted like in the ROM
+uint8_t esp_rom_crc8_le(uint8_t crc, const uint8_t *buf, const uint32_t len) {
+    crc = (uint8_t) ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (uint8_t) (crc >> 1 ^ 0xE0) : (uint8_t) (crc >> 1);
+        }
+    }
+    return (uint8_t) ~crc;
+}
+
+
+// CRC-32 (IEEE 802.3) bit reflected and inverted like in the ROM, the same as zlib.crc32
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, const uint32_t len) {
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? crc >> 1 ^ 0xEDB88320 : crc >> 1;
+        }
+    }
+    return ~crc;
+}
@@ -0,0 +1,95 @@
+#include "sim.h"
+
+#include "esp_partition.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// The data partitions of partitions.csv the simulated firmware uses. NVS is not needed,
+// only the radio side reads it.
+#define SECTOR_SIZE 4096
+#define JOURNAL_OFFSET 0x110000
+#define JOURNAL_SIZE (64 * 1024)
+
+static const esp_partition_t journal_partition = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .subtype = 0x40,
+    .address = JOURNAL_OFFSET,
+    .size = JOURNAL_SIZE,
+    .erase_size = SECTOR_SIZE,
+    .label = "journal",
+};
+
+static uint8_t journal_image[JOURNAL_SIZE];
+static const char *image_path;
+static SimFlashStats_t stats;
+
+// erased flash reads 0xFF, an image of an earlier run (or a device dump) continues where it stopped
+void sim_flash_init(const char *path) {
+    memset(journal_image, 0xFF, sizeof(journal_image));
+    image_path = path;
+    if (path == NULL) return;
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return;
+    const size_t read = fread(journal_image, 1, sizeof(journal_image), file);
+    fclose(file);
+    fprintf(stderr, "sim: journal image %s, %zu bytes\n", path, read);
+}
+
+bool sim_flash_save(void) {
+    if (image_path == NULL) return true;
+
+    FILE *file = fopen(image_path, "wb");
+    if (file == NULL) return false;
+    const bool written = fwrite(journal_image, 1, sizeof(journal_image), file) == sizeof(journal_image);
+    return fclose(file) == 0 && written;
+}
+
+void sim_flash_get_stats(SimFlashStats_t *out) {
+    *out = stats;
+}
+
+const esp_partition_t *esp_partition_find_first(const esp_partition_type_t type,
+                                                const esp_partition_subtype_t subtype, const char *label) {
+    const esp_partition_t *partition = &journal_partition;
+    if (type != ESP_PARTITION_TYPE_ANY && type != partition->type) return NULL;
+    if (subtype != ESP_PARTITION_SUBTYPE_ANY && subtype != partition->subtype) return NULL;
+    if (label && strcmp(label, partition->label) != 0) return NULL;
+    return partition;
+}
+
+static bool in_range(const esp_partition_t *partition, const size_t offset, const size_t size) {
+    return partition == &journal_partition && offset <= partition->size && size <= partition->size - offset;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, const size_t offset, void *dst, const size_t size) {
+    if (!in_range(partition, offset, size)) return ESP_ERR_INVALID_SIZE;
+
+    memcpy(dst, journal_image + offset, size);
+    stats.reads++;
+    return ESP_OK;
+}
+
+// NOR flash only clears bits, writing over data which was not erased yields the AND of both
+esp_err_t esp_partition_write(const esp_partition_t *partition, const size_t offset, const void *src,
+                              const size_t size) {
+    if (!in_range(partition, offset, size)) return ESP_ERR_INVALID_SIZE;
+
+    const uint8_t *bytes = src;
+    for (size_t i = 0; i < size; i++) {
+        journal_image[offset + i] &= bytes[i];
+    }
+    stats.writes++;
+    stats.bytes_written += (uint32_t) size;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, const size_t offset, const size_t size) {
+    if (!in_range(partition, offset, size)) return ESP_ERR_INVALID_SIZE;
+    if (offset % SECTOR_SIZE != 0 || size % SECTOR_SIZE != 0) return ESP_ERR_INVALID_ARG;
+
+    memset(journal_image + offset, 0xFF, size);
+    stats.sector_erases += (uint32_t) (size / SECTOR_SIZE);
+    return ESP_OK;
+}
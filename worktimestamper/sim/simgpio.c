@@ -0,0 +1,91 @@
+#include "sim.h"
+
+#include "driver/gpio.h"
+
+// Inputs with their pull-ups, driven by the script. Interrupts fire when a level change matches the
+// armed trigger, the handler runs right away in interrupt context on the script thread.
+
+typedef struct {
+    int level;
+    gpio_int_type_t intr_type;
+    gpio_isr_t handler;
+    void *arg;
+} SimPin_t;
+
+static SimPin_t pins[GPIO_NUM_MAX];
+static bool isr_service_installed;
+
+static bool is_valid(const int gpio) {
+    return gpio >= 0 && gpio < GPIO_NUM_MAX;
+}
+
+static bool triggers(const gpio_int_type_t type, const int old_level, const int new_level) {
+    switch (type) {
+        case GPIO_INTR_POSEDGE: return old_level == 0 && new_level == 1;
+        case GPIO_INTR_NEGEDGE: return old_level == 1 && new_level == 0;
+        case GPIO_INTR_ANYEDGE: return old_level != new_level;
+        case GPIO_INTR_LOW_LEVEL: return new_level == 0;
+        case GPIO_INTR_HIGH_LEVEL: return new_level == 1;
+        default: return false;
+    }
+}
+
+void sim_gpio_set_input(const int gpio, const int level) {
+    if (!is_valid(gpio)) return;
+
+    SimPin_t *pin = &pins[gpio];
+    const int old_level = pin->level;
+    pin->level = level != 0;
+    if (old_level == pin->level) return;
+
+    if (isr_service_installed && pin->handler && triggers(pin->intr_type, old_level, pin->level)) {
+        sim_isr_enter();
+        pin->handler(pin->arg);
+        sim_isr_exit();
+    }
+}
+
+esp_err_t gpio_config(const gpio_config_t *config) {
+    for (int gpio = 0; gpio < GPIO_NUM_MAX; gpio++) {
+        if (!(config->pin_bit_mask & 1ULL << gpio)) continue;
+        pins[gpio].intr_type = config->intr_type;
+        pins[gpio].level = config->pull_down_en == GPIO_PULLDOWN_ENABLE ? 0 : 1;
+    }
+    return ESP_OK;
+}
+
+int gpio_get_level(const gpio_num_t gpio) {
+    return is_valid(gpio) ? pins[gpio].level : 0;
+}
+
+esp_err_t gpio_set_level(const gpio_num_t gpio, const uint32_t level) {
+    if (!is_valid(gpio)) return ESP_ERR_INVALID_ARG;
+    pins[gpio].level = level != 0;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(const gpio_num_t gpio, const gpio_int_type_t type) {
+    if (!is_valid(gpio)) return ESP_ERR_INVALID_ARG;
+    pins[gpio].intr_type = type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(const int flags) {
+    (void) flags;
+    if (isr_service_installed) return ESP_ERR_INVALID_STATE;
+    isr_service_installed = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(const gpio_num_t gpio, const gpio_isr_t handler, void *arg) {
+    if (!is_valid(gpio)) return ESP_ERR_INVALID_ARG;
+    if (!isr_service_installed) return ESP_ERR_INVALID_STATE;
+    pins[gpio].handler = handler;
+    pins[gpio].arg = arg;
+    return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_enable(const gpio_num_t gpio, const gpio_int_type_t type) {
+    (void) type;
+    return is_valid(gpio) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
@@ -0,0 +1,219 @@
+#include "sim.h"
+
+#include "driver/i2c.h"
+#include "commands.h"
+
+#include <string.h>
+
+// One I2C bus with the SSD1306 at SSD1306_ADDR. Each transaction costs its SCL cycles on the virtual
+// clock: start, 9 per byte (8 bits and the ACK), stop. The calling task is blocked while they run.
+
+#define CONTROL_CO 0x80
+#define CONTROL_DC 0x40
+
+typedef struct {
+    const uint8_t *data; // NULL for a single byte stored in byte
+    size_t length;
+    uint8_t byte;
+} LinkWrite_t;
+
+typedef struct {
+    bool started;
+    bool stopped;
+    size_t count;
+    size_t capacity;
+    LinkWrite_t writes[];
+} CommandLink_t;
+
+typedef enum {
+    TRANSFER_ADDRESS,
+    TRANSFER_CONTROL,
+    TRANSFER_SINGLE, // the byte after a Co=1 control byte
+    TRANSFER_STREAM, // every byte after a Co=0 control byte
+    TRANSFER_NACKED,
+} TransferState;
+
+typedef struct {
+    TransferState state;
+    bool is_data;
+    size_t bytes;
+} Transfer_t;
+
+static uint32_t configured_frequency[I2C_NUM_MAX];
+static bool installed[I2C_NUM_MAX];
+static uint32_t panel_max_frequency;
+static uint32_t fail_next;
+static uint32_t ns_carry;
+static SimI2cStats_t stats;
+
+void sim_i2c_init(const uint32_t max_frequency) {
+    panel_max_frequency = max_frequency;
+    ssd1306_reset();
+}
+
+void sim_i2c_fail_next(const uint32_t count) {
+    fail_next = count;
+}
+
+uint32_t sim_i2c_frequency(void) {
+    return configured_frequency[I2C_NUM_0];
+}
+
+void sim_i2c_get_stats(SimI2cStats_t *out) {
+    *out = stats;
+}
+
+void sim_i2c_reset_stats(void) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+// false for a NACK, the master stops the transaction there
+static bool transfer_byte(Transfer_t *transfer, const i2c_port_t port, const uint8_t byte) {
+    transfer->bytes++;
+
+    switch (transfer->state) {
+        case TRANSFER_ADDRESS:
+            if (byte >> 1 != SSD1306_ADDR || (byte & 1) != I2C_MASTER_WRITE
+                || configured_frequency[port] > panel_max_frequency || fail_next > 0) {
+                if (fail_next > 0) fail_next--;
+                transfer->state = TRANSFER_NACKED;
+                return false;
+            }
+            transfer->state = TRANSFER_CONTROL;
+            return true;
+        case TRANSFER_CONTROL:
+            transfer->is_data = (byte & CONTROL_DC) != 0;
+            transfer->state = byte & CONTROL_CO ? TRANSFER_SINGLE : TRANSFER_STREAM;
+            return true;
+        case TRANSFER_SINGLE:
+            ssd1306_write(transfer->is_data, byte);
+            transfer->state = TRANSFER_CONTROL;
+            return true;
+        case TRANSFER_STREAM:
+            ssd1306_write(transfer->is_data, byte);
+            return true;
+        default:
+            return false;
+    }
+}
+
+static esp_err_t finish_transfer(const i2c_port_t port, const Transfer_t *transfer) {
+    const uint64_t bits = 2 + 9 * (uint64_t) transfer->bytes;
+    const uint64_t wire_ns = bits * 1000000000ULL / configured_frequency[port];
+
+    stats.transactions++;
+    stats.bytes += transfer->bytes;
+    stats.bits += bits;
+    stats.wire_ns += wire_ns;
+
+    const bool nacked = transfer->state == TRANSFER_NACKED;
+    if (nacked) stats.nacks++;
+
+    // whole microseconds on the virtual clock, the remainder is carried into the next transaction
+    const uint64_t total_ns = wire_ns + ns_carry;
+    ns_carry = (uint32_t) (total_ns % 1000);
+    sim_block_until(NULL, NULL, sim_now_us() + (int64_t) (total_ns / 1000));
+
+    return nacked ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t i2c_param_config(const i2c_port_t port, const i2c_config_t *config) {
+    if (port >= I2C_NUM_MAX || config->mode != I2C_MODE_MASTER || config->master.clk_speed == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    configured_frequency[port] = config->master.clk_speed;
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(const i2c_port_t port, const i2c_mode_t mode, const size_t slave_rx_buf_len,
+                             const size_t slave_tx_buf_len, const int intr_alloc_flags) {
+    (void) slave_rx_buf_len;
+    (void) slave_tx_buf_len;
+    (void) intr_alloc_flags;
+    if (port >= I2C_NUM_MAX || mode != I2C_MODE_MASTER) return ESP_ERR_INVALID_ARG;
+    if (installed[port]) return ESP_FAIL;
+    installed[port] = true;
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_delete(const i2c_port_t port) {
+    if (port >= I2C_NUM_MAX || !installed[port]) return ESP_ERR_INVALID_ARG;
+    installed[port] = false;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write_to_device(const i2c_port_t port, const uint8_t address, const uint8_t *data,
+                                     const size_t length, const TickType_t ticks) {
+    (void) ticks;
+    if (port >= I2C_NUM_MAX || !installed[port]) return ESP_ERR_INVALID_STATE;
+
+    Transfer_t transfer = {.state = TRANSFER_ADDRESS};
+    if (transfer_byte(&transfer, port, (uint8_t) (address << 1 | I2C_MASTER_WRITE))) {
+        for (size_t i = 0; i < length; i++) {
+            transfer_byte(&transfer, port, data[i]);
+        }
+    }
+    return finish_transfer(port, &transfer);
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *buffer, const uint32_t size) {
+    const uintptr_t align = _Alignof(CommandLink_t);
+    const uintptr_t aligned = ((uintptr_t) buffer + align - 1) & ~(align - 1);
+    const size_t padding = aligned - (uintptr_t) buffer;
+    if (size < padding + sizeof(CommandLink_t) + sizeof(LinkWrite_t)) return NULL;
+
+    CommandLink_t *link = (CommandLink_t *) aligned;
+    memset(link, 0, sizeof(*link));
+    link->capacity = (size - padding - sizeof(CommandLink_t)) / sizeof(LinkWrite_t);
+    return link;
+}
+
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd) {
+    (void) cmd;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd) {
+    CommandLink_t *link = cmd;
+    link->started = true;
+    return ESP_OK;
+}
+
+static esp_err_t add_write(CommandLink_t *link, const LinkWrite_t write) {
+    if (link->count >= link->capacity) return ESP_ERR_NO_MEM;
+    link->writes[link->count++] = write;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, const uint8_t data, const bool ack_en) {
+    (void) ack_en;
+    return add_write(cmd, (LinkWrite_t){.length = 1, .byte = data});
+}
+
+// like the IDF driver the data is not copied, it has to stay valid until i2c_master_cmd_begin
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, const uint8_t *data, const size_t length, const bool ack_en) {
+    (void) ack_en;
+    return add_write(cmd, (LinkWrite_t){.data = data, .length = length});
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd) {
+    CommandLink_t *link = cmd;
+    link->stopped = true;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_cmd_begin(const i2c_port_t port, i2c_cmd_handle_t cmd, const TickType_t ticks) {
+    (void) ticks;
+    const CommandLink_t *link = cmd;
+    if (port >= I2C_NUM_MAX || !installed[port]) return ESP_ERR_INVALID_STATE;
+    if (!link->started || !link->stopped) return ESP_ERR_INVALID_ARG;
+
+    Transfer_t transfer = {.state = TRANSFER_ADDRESS};
+    for (size_t i = 0; i < link->count && transfer.state != TRANSFER_NACKED; i++) {
+        const LinkWrite_t *write = &link->writes[i];
+        const uint8_t *data = write->data ? write->data : &write->byte;
+        for (size_t j = 0; j < write->length; j++) {
+            if (!transfer_byte(&transfer, port, data[j])) break;
+        }
+    }
+    return finish_transfer(port, &transfer);
+}
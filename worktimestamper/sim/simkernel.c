@@ -0,0 +1,654 @@
+#include "sim.h"
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TICK_US (1000000 / configTICK_RATE_HZ)
+#define ESP_TIMER_TASK_PRIORITY 22
+#define HOST_STACK_SIZE (256 * 1024)
+
+// A single core without time slicing: the highest priority ready task runs until it blocks, a task of
+// higher priority it wakes takes over inside the waking call. Equal priorities run first come first served.
+
+typedef enum {
+    TASK_READY,
+    TASK_RUNNING,
+    TASK_BLOCKED,
+    TASK_DELETED,
+} SimTaskState;
+
+struct SimTask {
+    pthread_t thread;
+    pthread_cond_t resume;
+    char name[16];
+    TaskFunction_t function;
+    void *arg;
+    UBaseType_t priority;
+    uint32_t stack_depth;
+    SimTaskState state;
+    uint64_t ready_order; // 0 for a preempted task, it continues before the others of its priority
+    sim_ready_t wait_ready;
+    void *wait_arg;
+    int64_t deadline_us;
+    bool timed_out;
+    uint32_t notify_value;
+    bool notify_pending;
+    int critical_nesting;
+    bool switch_pending; // woke a higher priority task inside a critical section
+    uint32_t switches;
+    struct SimTask *next;
+};
+
+struct SimQueue {
+    uint8_t *storage;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+};
+
+struct SimEventGroup {
+    EventBits_t bits;
+};
+
+struct SimTimer {
+    esp_timer_cb_t callback;
+    void *arg;
+    const char *name;
+    bool armed;
+    int64_t expiry_us;
+    uint64_t period_us;
+    struct SimTimer *next;
+};
+
+typedef struct {
+    struct SimEventGroup *group;
+    EventBits_t bits;
+    bool all;
+} BitsWait_t;
+
+static const char *state_names[] = {"ready", "running", "blocked", "deleted"};
+
+// the main thread holds kernel_lock while it runs the script, a task thread while it is scheduled
+static pthread_mutex_t kernel_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+static struct SimTask *tasks;
+static struct SimTask *current;
+static int64_t now_us;
+static uint64_t ready_counter = 1;
+
+static struct SimTimer *timers;
+static uint64_t timer_generation;
+
+static __thread struct SimTask *self;
+static __thread int isr_nesting;
+
+static int64_t deadline_of(const TickType_t ticks) {
+    if (ticks == portMAX_DELAY) return SIM_FOREVER;
+    return (now_us / TICK_US + ticks) * TICK_US;
+}
+
+static void make_ready(struct SimTask *task, const bool preempted) {
+    task->state = TASK_READY;
+    task->ready_order = preempted ? 0 : ready_counter++;
+}
+
+static struct SimTask *pick_next(void) {
+    struct SimTask *next = NULL;
+    for (struct SimTask *task = tasks; task; task = task->next) {
+        if (task->state != TASK_READY) continue;
+        if (next == NULL || task->priority > next->priority
+            || (task->priority == next->priority && task->ready_order < next->ready_order)) {
+            next = task;
+        }
+    }
+    return next;
+}
+
+// hand the CPU to the next task, or back to the script once nothing is ready
+static void schedule(void) {
+    current = pick_next();
+    if (current == NULL) {
+        pthread_cond_signal(&idle_cond);
+        return;
+    }
+    current->state = TASK_RUNNING;
+    current->switches++;
+    pthread_cond_signal(&current->resume);
+}
+
+// the caller set its own state already
+static void switch_out(void) {
+    schedule();
+    while (current != self) {
+        pthread_cond_wait(&self->resume, &kernel_lock);
+    }
+}
+
+static void maybe_preempt(void) {
+    if (self == NULL || isr_nesting > 0 || current != self) return;
+    if (self->critical_nesting > 0) {
+        self->switch_pending = true;
+        return;
+    }
+
+    const struct SimTask *next = pick_next();
+    if (next && next->priority > self->priority) {
+        make_ready(self, true);
+        switch_out();
+    }
+}
+
+void sim_recheck(void) {
+    for (struct SimTask *task = tasks; task; task = task->next) {
+        if (task->state == TASK_BLOCKED && task->wait_ready && task->wait_ready(task->wait_arg)) {
+            make_ready(task, false);
+        }
+    }
+    maybe_preempt();
+}
+
+bool sim_block_until(const sim_ready_t ready, void *arg, const int64_t deadline_us) {
+    for (;;) {
+        if (ready && ready(arg)) return true;
+        if (deadline_us <= now_us) return false;
+
+        self->wait_ready = ready;
+        self->wait_arg = arg;
+        self->deadline_us = deadline_us;
+        self->timed_out = false;
+        self->state = TASK_BLOCKED;
+        switch_out();
+        self->wait_ready = NULL;
+
+        // another task may have taken what woke this one, then it waits on
+        if (self->timed_out) return ready && ready(arg);
+    }
+}
+
+void sim_enter_critical(void) {
+    if (self && isr_nesting == 0) self->critical_nesting++;
+}
+
+void sim_exit_critical(void) {
+    if (self == NULL || isr_nesting > 0) return;
+    if (--self->critical_nesting == 0 && self->switch_pending) {
+        self->switch_pending = false;
+        maybe_preempt();
+    }
+}
+
+BaseType_t xPortInIsrContext(void) {
+    return isr_nesting > 0;
+}
+
+void sim_isr_enter(void) {
+    isr_nesting++;
+}
+
+void sim_isr_exit(void) {
+    isr_nesting--;
+}
+
+int64_t sim_now_us(void) {
+    return now_us;
+}
+
+static void run_ready_tasks(void) {
+    if (current == NULL) schedule();
+    while (current != NULL) {
+        pthread_cond_wait(&idle_cond, &kernel_lock);
+    }
+}
+
+void sim_run_until(const int64_t until_us) {
+    for (;;) {
+        run_ready_tasks();
+
+        int64_t next_us = SIM_FOREVER;
+        for (const struct SimTask *task = tasks; task; task = task->next) {
+            if (task->state == TASK_BLOCKED && task->deadline_us < next_us) next_us = task->deadline_us;
+        }
+        if (next_us == SIM_FOREVER || next_us > until_us) break;
+
+        if (next_us > now_us) now_us = next_us;
+        for (struct SimTask *task = tasks; task; task = task->next) {
+            if (task->state == TASK_BLOCKED && task->deadline_us <= now_us) {
+                task->timed_out = true;
+                make_ready(task, false);
+            }
+        }
+    }
+
+    if (until_us > now_us) now_us = until_us;
+}
+
+void sim_print_tasks(FILE *out) {
+    fprintf(out, "%-16s %4s %-8s %8s %10s\n", "task", "prio", "state", "stack", "switches");
+    for (const struct SimTask *task = tasks; task; task = task->next) {
+        fprintf(out, "%-16s %4u %-8s %8lu %10lu\n", task->name, task->priority, state_names[task->state],
+                (unsigned long) task->stack_depth, (unsigned long) task->switches);
+    }
+}
+
+static void *task_thread(void *arg) {
+    struct SimTask *task = arg;
+    self = task;
+
+    pthread_mutex_lock(&kernel_lock);
+    while (current != task) {
+        pthread_cond_wait(&task->resume, &kernel_lock);
+    }
+
+    task->function(task->arg);
+
+    // the IDF main task is deleted when app_main returns, other tasks must not return at all
+    task->state = TASK_DELETED;
+    schedule();
+    pthread_mutex_unlock(&kernel_lock);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(const TaskFunction_t function, const char *name, const uint32_t stack_depth, void *arg,
+                       const UBaseType_t priority, TaskHandle_t *handle) {
+    struct SimTask *task = calloc(1, sizeof(*task));
+    if (task == NULL) return pdFAIL;
+
+    pthread_cond_init(&task->resume, NULL);
+    strncpy(task->name, name, sizeof(task->name) - 1);
+    task->function = function;
+    task->arg = arg;
+    task->priority = priority < configMAX_PRIORITIES ? priority : configMAX_PRIORITIES - 1;
+    task->stack_depth = stack_depth;
+    task->deadline_us = SIM_FOREVER;
+    make_ready(task, false);
+
+    struct SimTask **tail = &tasks;
+    while (*tail) tail = &(*tail)->next;
+    *tail = task;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, HOST_STACK_SIZE);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    const int created = pthread_create(&task->thread, &attr, task_thread, task);
+    pthread_attr_destroy(&attr);
+    if (created != 0) {
+        task->state = TASK_DELETED;
+        return pdFAIL;
+    }
+
+    if (handle) *handle = task;
+    maybe_preempt();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(const TaskFunction_t function, const char *name, const uint32_t stack_depth,
+                                   void *arg, const UBaseType_t priority, TaskHandle_t *handle,
+                                   const BaseType_t core) {
+    (void) core;
+    return xTaskCreate(function, name, stack_depth, arg, priority, handle);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task != NULL && task != self) {
+        // the thread stays parked, it is never scheduled again
+        task->state = TASK_DELETED;
+        return;
+    }
+
+    self->state = TASK_DELETED;
+    schedule();
+    pthread_mutex_unlock(&kernel_lock);
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(const TickType_t ticks) {
+    if (ticks == 0) {
+        make_ready(self, false);
+        switch_out();
+        return;
+    }
+    sim_block_until(NULL, NULL, deadline_of(ticks));
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t) (now_us / TICK_US);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return self;
+}
+
+const char *pcTaskGetName(TaskHandle_t task) {
+    return (task ? task : self)->name;
+}
+
+TaskHandle_t xTaskGetHandle(const char *name) {
+    for (struct SimTask *task = tasks; task; task = task->next) {
+        if (task->state != TASK_DELETED && strcmp(task->name, name) == 0) return task;
+    }
+    return NULL;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return (task ? task : self)->stack_depth;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    return (task ? task : self)->priority;
+}
+
+static bool notify_pending(void *arg) {
+    return ((const struct SimTask *) arg)->notify_pending;
+}
+
+static bool notify_value_set(void *arg) {
+    return ((const struct SimTask *) arg)->notify_value != 0;
+}
+
+static bool notify(TaskHandle_t task, const uint32_t value, const eNotifyAction action) {
+    switch (action) {
+        case eSetBits:
+            task->notify_value |= value;
+            break;
+        case eIncrement:
+            task->notify_value++;
+            break;
+        case eSetValueWithOverwrite:
+            task->notify_value = value;
+            break;
+        case eSetValueWithoutOverwrite:
+            if (task->notify_pending) return false;
+            task->notify_value = value;
+            break;
+        case eNoAction:
+            break;
+    }
+    task->notify_pending = true;
+    return true;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, const uint32_t value, const eNotifyAction action) {
+    const bool notified = notify(task, value, action);
+    sim_recheck();
+    return notified ? pdPASS : pdFAIL;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, const uint32_t value, const eNotifyAction action,
+                              BaseType_t *woken) {
+    const bool was_blocked = task->state == TASK_BLOCKED;
+    const BaseType_t result = xTaskNotify(task, value, action);
+    if (woken && was_blocked && task->state == TASK_READY) *woken = pdTRUE;
+    return result;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    return xTaskNotify(task, 0, eIncrement);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {
+    xTaskNotifyFromISR(task, 0, eIncrement, woken);
+}
+
+BaseType_t xTaskNotifyWait(const uint32_t clear_on_entry, const uint32_t clear_on_exit, uint32_t *value,
+                           const TickType_t ticks) {
+    struct SimTask *task = self;
+    if (!task->notify_pending) task->notify_value &= ~clear_on_entry;
+
+    const bool notified = sim_block_until(notify_pending, task, deadline_of(ticks));
+    if (value) *value = task->notify_value;
+    if (!notified) return pdFALSE;
+
+    task->notify_value &= ~clear_on_exit;
+    task->notify_pending = false;
+    return pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(const BaseType_t clear_on_exit, const TickType_t ticks) {
+    struct SimTask *task = self;
+    sim_block_until(notify_value_set, task, deadline_of(ticks));
+
+    const uint32_t value = task->notify_value;
+    if (value != 0) task->notify_value = clear_on_exit ? 0 : value - 1;
+    task->notify_pending = false;
+    return value;
+}
+
+static bool queue_has_item(void *arg) {
+    const struct SimQueue *queue = arg;
+    return queue->count > 0;
+}
+
+static bool queue_has_space(void *arg) {
+    const struct SimQueue *queue = arg;
+    return queue->count < queue->length;
+}
+
+QueueHandle_t xQueueCreate(const UBaseType_t length, const UBaseType_t item_size) {
+    struct SimQueue *queue = calloc(1, sizeof(*queue));
+    if (queue == NULL || length == 0) {
+        free(queue);
+        return NULL;
+    }
+
+    queue->length = length;
+    queue->item_size = item_size;
+    if (item_size > 0) {
+        queue->storage = calloc(length, item_size);
+        if (queue->storage == NULL) {
+            free(queue);
+            return NULL;
+        }
+    }
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    free(queue->storage);
+    free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, const TickType_t ticks) {
+    if (!sim_block_until(queue_has_space, queue, deadline_of(ticks))) return pdFAIL;
+
+    if (queue->item_size > 0) {
+        const UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->storage + tail * queue->item_size, item, queue->item_size);
+    }
+    queue->count++;
+    sim_recheck();
+    return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken) {
+    const BaseType_t result = xQueueSend(queue, item, 0);
+    if (woken && result == pdPASS) *woken = pdTRUE;
+    return result;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, const TickType_t ticks) {
+    if (!sim_block_until(queue_has_item, queue, deadline_of(ticks))) return pdFAIL;
+
+    if (queue->item_size > 0 && item) {
+        memcpy(item, queue->storage + queue->head * queue->item_size, queue->item_size);
+    }
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    sim_recheck();
+    return pdPASS;
+}
+
+BaseType_t xQueueReceiveFromISR(QueueHandle_t queue, void *item, BaseType_t *woken) {
+    const BaseType_t result = xQueueReceive(queue, item, 0);
+    if (woken && result == pdPASS) *woken = pdTRUE;
+    return result;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    return queue->length - queue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    SemaphoreHandle_t mutex = xQueueCreate(1, 0);
+    if (mutex) mutex->count = 1;
+    return mutex;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return xQueueCreate(1, 0);
+}
+
+static bool bits_match(void *arg) {
+    const BitsWait_t *wait = arg;
+    const EventBits_t set = wait->group->bits & wait->bits;
+    return wait->all ? set == wait->bits : set != 0;
+}
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    return calloc(1, sizeof(struct SimEventGroup));
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, const EventBits_t bits, const BaseType_t clear_on_exit,
+                                const BaseType_t wait_for_all, const TickType_t ticks) {
+    BitsWait_t wait = {.group = group, .bits = bits, .all = wait_for_all};
+    const bool matched = sim_block_until(bits_match, &wait, deadline_of(ticks));
+
+    const EventBits_t result = group->bits;
+    if (matched && clear_on_exit) group->bits &= ~bits;
+    return result;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, const EventBits_t bits) {
+    group->bits |= bits;
+    const EventBits_t result = group->bits;
+    sim_recheck();
+    return result;
+}
+
+BaseType_t xEventGroupSetBitsFromISR(EventGroupHandle_t group, const EventBits_t bits, BaseType_t *woken) {
+    xEventGroupSetBits(group, bits);
+    if (woken) *woken = pdTRUE;
+    return pdPASS;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, const EventBits_t bits) {
+    const EventBits_t result = group->bits;
+    group->bits &= ~bits;
+    return result;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    return group->bits;
+}
+
+static void timers_changed(void) {
+    timer_generation++;
+    sim_recheck();
+}
+
+static bool generation_moved(void *arg) {
+    return timer_generation != *(const uint64_t *) arg;
+}
+
+// runs the callbacks in expiry order, timers due at the same time in creation order
+static void esp_timer_task(void *arg) {
+    // ReSharper disable once CppDFAEndlessLoop
+    while (1) {
+        struct SimTimer *due = NULL;
+        for (struct SimTimer *timer = timers; timer; timer = timer->next) {
+            if (timer->armed && (due == NULL || timer->expiry_us < due->expiry_us)) due = timer;
+        }
+
+        if (due == NULL || due->expiry_us > now_us) {
+            const uint64_t generation = timer_generation;
+            sim_block_until(generation_moved, (void *) &generation, due ? due->expiry_us : SIM_FOREVER);
+            continue;
+        }
+
+        if (due->period_us > 0) {
+            due->expiry_us += (int64_t) due->period_us;
+        } else {
+            due->armed = false;
+        }
+        due->callback(due->arg);
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle) {
+    if (args == NULL || args->callback == NULL || handle == NULL) return ESP_ERR_INVALID_ARG;
+
+    struct SimTimer *timer = calloc(1, sizeof(*timer));
+    if (timer == NULL) return ESP_ERR_NO_MEM;
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    timer->name = args->name;
+
+    struct SimTimer **tail = &timers;
+    while (*tail) tail = &(*tail)->next;
+    *tail = timer;
+
+    *handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t start_timer(esp_timer_handle_t timer, const uint64_t timeout_us, const uint64_t period_us) {
+    if (timer->armed) return ESP_ERR_INVALID_STATE;
+
+    timer->armed = true;
+    timer->expiry_us = now_us + (int64_t) timeout_us;
+    timer->period_us = period_us;
+    timers_changed();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, const uint64_t timeout_us) {
+    return start_timer(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, const uint64_t period_us) {
+    return start_timer(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer->armed) return ESP_ERR_INVALID_STATE;
+
+    timer->armed = false;
+    timers_changed();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (timer->armed) return ESP_ERR_INVALID_STATE;
+
+    struct SimTimer **link = &timers;
+    while (*link && *link != timer) link = &(*link)->next;
+    if (*link) *link = timer->next;
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    return timer->armed;
+}
+
+int64_t esp_timer_get_time(void) {
+    return now_us;
+}
+
+void sim_kernel_init(void) {
+    pthread_mutex_lock(&kernel_lock);
+    xTaskCreate(esp_timer_task, "esp_timer", 3584, NULL, ESP_TIMER_TASK_PRIORITY, NULL);
+}
@@ -0,0 +1,451 @@
+// Host simulator of the worktimestamper firmware.
+//
+// The firmware sources are compiled unchanged against the IDF shims in include/. FreeRTOS runs on
+// pthreads with a virtual clock (simkernel.c), the SSD1306 sits behind a fake I2C bus (simi2c.c,
+// simssd1306.c), the buttons are driven by a script (simgpio.c), the journal partition lives in RAM
+// (simflash.c). Wi-Fi and the export UART are left out (simwifi.c), the diagnostics console commands
+// run from the script (simconsole.c).
+//
+// Code runs in zero virtual time, only blocking and the SCL cycles of the bus take time. The clock jumps
+// from one deadline to the next while every task waits, so weeks of stamping run in seconds and every
+// run of a script produces the same log, frames and bus counters.
+//
+//   worktimestamper_sim [-t YYYY-MM-DDTHH:MM:SS] [-k] [-j journal.bin] [-f hz] [-q] [script]
+//
+//   -t  true local time at power-on (default 2024-01-08T07:55:00)
+//   -k  the RTC kept its time over the reset, otherwise the device clock starts at 1970
+//   -j  journal partition image, loaded at start and written back at the end
+//   -f  highest I2C clock the panel acknowledges (default 400000)
+//   -q  firmware log with warnings and errors only
+//
+// Script commands, one per line, # starts a comment. Durations take us, ms, s, m, h or d (default ms).
+//
+//   wait <duration>                  let the firmware run
+//   until <HH:MM[:SS]>               run up to the next time of day of the true local time
+//   press <1|2> / release <1|2>      change the level of a button
+//   click <1|2> [hold]               press, hold (default 100ms), release
+//   bounce <1|2> <edges> <interval>  toggle a button edges times, starting with a press
+//   sync                             NTP answer: the device clock jumps to the true time
+//   nack <count>                     the panel does not acknowledge the next count transactions
+//   frame <file.pbm>                 write the glass as PBM, a %d in the name takes a running number
+//   show                             print the glass
+//   stats [reset]                    bus, flash and firmware counters, reset starts a new window
+//   tasks                            simulated tasks
+//   trace                            dump the hot path trace, needs a build with -DSIM_TRACE=ON
+//   console <command> [args]         run a command of the diagnostics console, console help lists them
+//   time                             virtual, device and true time
+//   log <error|warn|info|debug>      firmware log level from here on
+//   echo <text>
+//   repeat <n> ... end               run the lines up to the matching end n times
+
+#include "sim.h"
+
+#include "buttonisrhandler.h"
+#include "inputring.h"
+#include "oledbus.h"
+#include "oledhandler.h"
+#include "tracehandler.h"
+#include "esp_log.h"
+#include "freertos/task.h"
+
+#include <ctype.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FIRMWARE_TZ "CET-1CEST,M3.5.0/2,M10.5.0/3" // app_main sets the same zone
+#define DEFAULT_START "2024-01-08T07:55:00"
+#define DEFAULT_I2C_MAX_HZ 400000
+#define DEFAULT_HOLD_US 100000
+#define MAIN_TASK_STACK 3584
+#define MAIN_TASK_PRIORITY 1
+#define MAX_LINE 256
+#define MAX_TOKENS 4
+
+typedef struct {
+    char **lines;
+    int count;
+} Script_t;
+
+extern void app_main(void);
+
+static const gpio_num_t button_pins[] = {GPIO_BUTTON_1, GPIO_BUTTON_2};
+
+static Script_t script;
+static int frame_number;
+static int64_t window_start_us;
+
+static void main_task(void *arg) {
+    (void) arg;
+    app_main();
+}
+
+static void run_for(const int64_t duration_us) {
+    sim_run_until(sim_now_us() + duration_us);
+}
+
+static bool parse_duration(const char *text, int64_t *duration_us) {
+    char *unit;
+    const double value = strtod(text, &unit);
+    if (unit == text || value < 0) return false;
+
+    static const struct {
+        const char *name;
+        double us;
+    } units[] = {{"", 1e3}, {"us", 1}, {"ms", 1e3}, {"s", 1e6}, {"m", 60e6}, {"h", 3600e6}, {"d", 86400e6}};
+
+    for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+        if (strcmp(unit, units[i].name) == 0) {
+            *duration_us = (int64_t) (value * units[i].us + 0.5);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_button(const char *text, gpio_num_t *pin) {
+    if (text == NULL || text[1] != '\0' || (text[0] != '1' && text[0] != '2')) return false;
+    *pin = button_pins[text[0] - '1'];
+    return true;
+}
+
+static bool parse_start_time(const char *text, int64_t *time_us) {
+    struct tm local = {.tm_isdst = -1};
+    if (sscanf(text, "%d-%d-%d%*1[ T]%d:%d:%d", &local.tm_year, &local.tm_mon, &local.tm_mday,
+               &local.tm_hour, &local.tm_min, &local.tm_sec) != 6) {
+        return false;
+    }
+    local.tm_year -= 1900;
+    local.tm_mon -= 1;
+    *time_us = (int64_t) mktime(&local) * 1000000;
+    return true;
+}
+
+// next occurrence of the time of day in the true local time, at least one second ahead
+static bool parse_time_of_day(const char *text, int64_t *until_us) {
+    int hour, minute, second = 0;
+    if (sscanf(text, "%d:%d:%d", &hour, &minute, &second) < 2) return false;
+
+    const time_t now = (time_t) (sim_true_time_us() / 1000000);
+    struct tm local;
+    localtime_r(&now, &local);
+    local.tm_hour = hour;
+    local.tm_min = minute;
+    local.tm_sec = second;
+    local.tm_isdst = -1;
+
+    time_t target = mktime(&local);
+    if (target <= now) {
+        local.tm_mday++;
+        local.tm_isdst = -1;
+        target = mktime(&local);
+    }
+    *until_us = sim_now_us() + ((int64_t) target - now) * 1000000 - sim_true_time_us() % 1000000;
+    return true;
+}
+
+// only a single %d or %0Nd is expanded, anything else in the name is taken literally
+static void expand_frame_path(const char *pattern, char *path, const size_t size) {
+    const char *percent = strchr(pattern, '%');
+    size_t digits = 0;
+    while (percent && isdigit((unsigned char) percent[1 + digits])) digits++;
+
+    if (percent == NULL || percent[1 + digits] != 'd') {
+        snprintf(path, size, "%s", pattern);
+        return;
+    }
+
+    const int width = digits > 0 ? atoi(percent + 1) : 0;
+    snprintf(path, size, "%.*s%0*d%s", (int) (percent - pattern), pattern, width, frame_number,
+             percent + 2 + digits);
+}
+
+static void print_time(void) {
+    const int64_t now_us = sim_now_us();
+    char device[32], truth[32];
+    struct tm local;
+
+    const time_t device_time = (time_t) (sim_device_time_us() / 1000000);
+    strftime(device, sizeof(device), "%Y-%m-%d %H:%M:%S", localtime_r(&device_time, &local));
+    const time_t true_time = (time_t) (sim_true_time_us() / 1000000);
+    strftime(truth, sizeof(truth), "%Y-%m-%d %H:%M:%S %a", localtime_r(&true_time, &local));
+
+    printf("sim: %lld.%06lld s since boot, device %s, true %s\n", (long long) (now_us / 1000000),
+           (long long) (now_us % 1000000), device, truth);
+}
+
+static void print_stats(void) {
+    SimI2cStats_t i2c;
+    SimFlashStats_t flash;
+    OledBusStats_t bus;
+    DisplayUpdateStats_t updates;
+    DisplayDeltaStats_t delta;
+    ButtonLatencyStats_t buttons;
+    sim_i2c_get_stats(&i2c);
+    sim_flash_get_stats(&flash);
+    get_oled_bus_stats(&bus);
+    get_display_update_stats(&updates);
+    get_display_delta_stats(&delta);
+    get_button_latency_stats(&buttons);
+
+    const int64_t window_us = sim_now_us() - window_start_us;
+    const double wire_ms = (double) i2c.wire_ns / 1e6;
+
+    print_time();
+    printf("  window    %.3f s\n", (double) window_us / 1e6);
+    printf("  i2c       %lu transactions, %lu nacked, %llu bytes, %llu SCL cycles at %lu Hz\n",
+           (unsigned long) i2c.transactions, (unsigned long) i2c.nacks, (unsigned long long) i2c.bytes,
+           (unsigned long long) i2c.bits, (unsigned long) sim_i2c_frequency());
+    printf("            %.3f ms on the wire, %.4f %% of the window\n", wire_ms,
+           window_us > 0 ? wire_ms * 1e5 / (double) window_us : 0.0);
+    printf("  flash     %lu reads, %lu writes, %lu bytes written, %lu sector erases\n",
+           (unsigned long) flash.reads, (unsigned long) flash.writes, (unsigned long) flash.bytes_written,
+           (unsigned long) flash.sector_erases);
+    printf("  since boot:\n");
+    printf("  oled bus  %lu batches, %lu transactions, %lu merged, %lu bytes, %lu retries, %lu errors, %lu rejected\n",
+           (unsigned long) bus.batches, (unsigned long) bus.transactions, (unsigned long) bus.merged_ops,
+           (unsigned long) bus.bytes, (unsigned long) bus.retries, (unsigned long) bus.errors,
+           (unsigned long) bus.rejected);
+    printf("  display   %lu writes, %lu coalesced, %lu redraws, %lu cells changed, %lu bytes (legacy %lu)\n",
+           (unsigned long) updates.writes, (unsigned long) updates.coalesced, (unsigned long) updates.redraws,
+           (unsigned long) delta.cells_changed, (unsigned long) delta.bytes_on_bus,
+           (unsigned long) delta.legacy_bytes);
+    printf("  buttons   %lu presses, max %lu us, mean %llu us, %lu dropped\n", (unsigned long) buttons.count,
+           (unsigned long) buttons.max_us,
+           (unsigned long long) (buttons.count > 0 ? buttons.total_us / buttons.count : 0),
+           (unsigned long) input_ring_dropped());
+}
+
+static void reset_stats(void) {
+    sim_i2c_reset_stats();
+    window_start_us = sim_now_us();
+}
+
+static bool write_frame(const char *pattern) {
+    char path[MAX_LINE];
+    expand_frame_path(pattern, path, sizeof(path));
+    frame_number++;
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+    ssd1306_write_pbm(file);
+    return fclose(file) == 0;
+}
+
+static bool set_log_level(const char *name) {
+    static const char *names[] = {"none", "error", "warn", "info", "debug", "verbose"};
+    for (int level = 0; level < (int) (sizeof(names) / sizeof(names[0])); level++) {
+        if (name && strcmp(name, names[level]) == 0) {
+            sim_log_set_level(level);
+            return true;
+        }
+    }
+    return false;
+}
+
+static int split(char *line, char *tokens[MAX_TOKENS]) {
+    int count = 0;
+    for (char *token = strtok(line, " \t"); token && count < MAX_TOKENS; token = strtok(NULL, " \t")) {
+        tokens[count++] = token;
+    }
+    return count;
+}
+
+// index of the end closing the repeat at line first, or -1
+static int find_end(const int first, const int last) {
+    int depth = 0;
+    for (int i = first + 1; i < last; i++) {
+        char copy[MAX_LINE];
+        char *tokens[MAX_TOKENS];
+        snprintf(copy, sizeof(copy), "%s", script.lines[i]);
+        const int count = split(copy, tokens);
+        if (count == 0) continue;
+        if (strcmp(tokens[0], "repeat") == 0) depth++;
+        if (strcmp(tokens[0], "end") == 0 && depth-- == 0) return i;
+    }
+    return -1;
+}
+
+static bool run_lines(int first, int last);
+
+// false on a line which can not be run, the script stops there
+static bool run_line(const int index, int *next) {
+    char copy[MAX_LINE];
+    char *tokens[MAX_TOKENS] = {0};
+    snprintf(copy, sizeof(copy), "%s", script.lines[index]);
+    const int count = split(copy, tokens);
+    *next = index + 1;
+    if (count == 0) return true;
+
+    const char *command = tokens[0];
+    int64_t duration_us;
+    gpio_num_t pin;
+
+    if (strcmp(command, "wait") == 0 && count == 2 && parse_duration(tokens[1], &duration_us)) {
+        run_for(duration_us);
+    } else if (strcmp(command, "until") == 0 && count == 2 && parse_time_of_day(tokens[1], &duration_us)) {
+        sim_run_until(duration_us);
+    } else if (strcmp(command, "press") == 0 && count == 2 && parse_button(tokens[1], &pin)) {
+        sim_gpio_set_input(pin, 0);
+        run_for(0);
+    } else if (strcmp(command, "release") == 0 && count == 2 && parse_button(tokens[1], &pin)) {
+        sim_gpio_set_input(pin, 1);
+        run_for(0);
+    } else if (strcmp(command, "click") == 0 && (count == 2 || count == 3) && parse_button(tokens[1], &pin)) {
+        duration_us = DEFAULT_HOLD_US;
+        if (count == 3 && !parse_duration(tokens[2], &duration_us)) return false;
+        sim_gpio_set_input(pin, 0);
+        run_for(duration_us);
+        sim_gpio_set_input(pin, 1);
+        run_for(0);
+    } else if (strcmp(command, "bounce") == 0 && count == 4 && parse_button(tokens[1], &pin)
+               && parse_duration(tokens[3], &duration_us)) {
+        const int edges = atoi(tokens[2]);
+        for (int edge = 0; edge < edges; edge++) {
+            sim_gpio_set_input(pin, edge % 2 == 0 ? 0 : 1);
+            run_for(edge < edges - 1 ? duration_us : 0);
+        }
+    } else if (strcmp(command, "sync") == 0 && count == 1) {
+        sim_wifi_sync();
+        run_for(0);
+    } else if (strcmp(command, "nack") == 0 && count == 2) {
+        sim_i2c_fail_next((uint32_t) strtoul(tokens[1], NULL, 10));
+    } else if (strcmp(command, "frame") == 0 && count == 2) {
+        return write_frame(tokens[1]);
+    } else if (strcmp(command, "show") == 0 && count == 1) {
+        print_time();
+        ssd1306_print(stdout);
+    } else if (strcmp(command, "stats") == 0 && count == 1) {
+        print_stats();
+    } else if (strcmp(command, "stats") == 0 && count == 2 && strcmp(tokens[1], "reset") == 0) {
+        reset_stats();
+    } else if (strcmp(command, "tasks") == 0 && count == 1) {
+        sim_print_tasks(stdout);
+    } else if (strcmp(command, "console") == 0 && count >= 2) {
+        const char *line = strstr(script.lines[index], "console") + 7;
+        return sim_console_run(line + strspn(line, " \t"));
+    } else if (strcmp(command, "trace") == 0 && count == 1) {
+#if HOT_PATH_TRACE
+        trace_dump();
+#else
+        printf("trace: built without HOT_PATH_TRACE\n");
+#endif
+    } else if (strcmp(command, "time") == 0 && count == 1) {
+        print_time();
+    } else if (strcmp(command, "log") == 0 && count == 2) {
+        return set_log_level(tokens[1]);
+    } else if (strcmp(command, "echo") == 0) {
+        const char *text = strstr(script.lines[index], "echo") + 4;
+        printf("%s\n", text + strspn(text, " \t"));
+    } else if (strcmp(command, "repeat") == 0 && count == 2) {
+        const int end = find_end(index, script.count);
+        const long times = strtol(tokens[1], NULL, 10);
+        if (end < 0 || times < 0) return false;
+        for (long i = 0; i < times; i++) {
+            if (!run_lines(index + 1, end)) return false;
+        }
+        *next = end + 1;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool run_lines(int first, const int last) {
+    while (first < last) {
+        int next;
+        if (!run_line(first, &next)) {
+            fprintf(stderr, "sim: line %d: cannot run '%s'\n", first + 1, script.lines[first]);
+            return false;
+        }
+        first = next;
+    }
+    return true;
+}
+
+static bool load_script(FILE *file) {
+    char line[MAX_LINE];
+    int capacity = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if (script.count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            char **lines = realloc(script.lines, (size_t) capacity * sizeof(char *));
+            if (lines == NULL) return false;
+            script.lines = lines;
+        }
+        script.lines[script.count] = strdup(line);
+        if (script.lines[script.count] == NULL) return false;
+        script.count++;
+    }
+    return true;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-t YYYY-MM-DDTHH:MM:SS] [-k] [-j journal.bin] [-f hz] [-q] [script]\n", name);
+}
+
+int main(const int argc, char *argv[]) {
+    const char *start = DEFAULT_START;
+    const char *journal = NULL;
+    uint32_t i2c_max_hz = DEFAULT_I2C_MAX_HZ;
+    bool keep_rtc = false;
+    int option;
+
+    while ((option = getopt(argc, argv, "t:kj:f:q")) != -1) {
+        switch (option) {
+            case 't': start = optarg; break;
+            case 'k': keep_rtc = true; break;
+            case 'j': journal = optarg; break;
+            case 'f': i2c_max_hz = (uint32_t) strtoul(optarg, NULL, 10); break;
+            case 'q': sim_log_set_level(ESP_LOG_WARN); break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+
+    setenv("TZ", FIRMWARE_TZ, 1);
+    tzset();
+
+    int64_t start_us;
+    if (!parse_start_time(start, &start_us)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    FILE *file = optind < argc && strcmp(argv[optind], "-") != 0 ? fopen(argv[optind], "r") : stdin;
+    if (file == NULL) {
+        perror(argv[optind]);
+        return 2;
+    }
+    const bool loaded = load_script(file);
+    if (file != stdin) fclose(file);
+    if (!loaded) return 2;
+
+    sim_kernel_init();
+    sim_clock_init(start_us, keep_rtc);
+    sim_flash_init(journal);
+    sim_i2c_init(i2c_max_hz);
+
+    xTaskCreate(main_task, "main", MAIN_TASK_STACK, NULL, MAIN_TASK_PRIORITY, NULL);
+    run_for(0);
+
+    const bool completed = run_lines(0, script.count);
+
+    if (!sim_flash_save()) {
+        perror(journal);
+        return 1;
+    }
+    fflush(stdout);
+    // the task threads are parked in the kernel, nothing has to be joined
+    _Exit(completed ? 0 : 1);
+}
@@ -0,0 +1,223 @@
+#include "sim.h"
+
+#include <string.h>
+
+#define PANEL_WIDTH 128
+#define PANEL_HEIGHT 64
+#define PANEL_PAGES (PANEL_HEIGHT / 8)
+#define MAX_ARGUMENTS 6
+
+#define ADDRESSING_HORIZONTAL 0
+#define ADDRESSING_VERTICAL 1
+#define ADDRESSING_PAGE 2
+
+// Command decoder and GDDRAM of the SSD1306 behind the I2C control bytes. The module is mounted the way
+// the common 0.96" boards are: with segment remap (0xA1) and reversed COM scan (0xC8) column 0 of
+// page 0 is the top left corner of the glass.
+
+static struct {
+    uint8_t gddram[PANEL_PAGES][PANEL_WIDTH];
+    bool display_on;
+    bool charge_pump; // the panel stays dark without it
+    bool inverse;
+    bool entire_on;
+    bool segment_remap;
+    bool com_reverse;
+    uint8_t contrast;
+    uint8_t addressing;
+    uint8_t start_line;
+    uint8_t column_start;
+    uint8_t column_end;
+    uint8_t page_start;
+    uint8_t page_end;
+    uint8_t column;
+    uint8_t page;
+    uint8_t command[1 + MAX_ARGUMENTS];
+    uint8_t command_length;
+    uint8_t arguments_missing;
+} panel;
+
+// power-on state of the datasheet, the GDDRAM content is undefined there and blank here
+void ssd1306_reset(void) {
+    memset(&panel, 0, sizeof(panel));
+    panel.contrast = 0x7F;
+    panel.addressing = ADDRESSING_PAGE;
+    panel.column_end = PANEL_WIDTH - 1;
+    panel.page_end = PANEL_PAGES - 1;
+}
+
+static uint8_t argument_count(const uint8_t command) {
+    switch (command) {
+        case 0x20: // addressing mode
+        case 0x81: // contrast
+        case 0x8D: // charge pump
+        case 0xA8: // multiplex ratio
+        case 0xD3: // display offset
+        case 0xD5: // clock divide
+        case 0xD9: // pre-charge period
+        case 0xDA: // COM pins
+        case 0xDB: // VCOMH level
+            return 1;
+        case 0x21: // column address
+        case 0x22: // page address
+        case 0xA3: // vertical scroll area
+            return 2;
+        case 0x29: // vertical and horizontal scroll setup
+        case 0x2A:
+            return 5;
+        case 0x26: // horizontal scroll setup
+        case 0x27:
+            return 6;
+        default:
+            return 0;
+    }
+}
+
+// multiplex, offset, timing and scroll commands are accepted without a visible effect
+static void execute(const uint8_t *command) {
+    const uint8_t code = command[0];
+
+    if (code <= 0x0F) {
+        panel.column = (uint8_t) ((panel.column & 0xF0) | (code & 0x0F));
+    } else if (code <= 0x1F) {
+        panel.column = (uint8_t) ((panel.column & 0x0F) | (code & 0x07) << 4);
+    } else if (code >= 0x40 && code <= 0x7F) {
+        panel.start_line = code & 0x3F;
+    } else if (code >= 0xB0 && code <= 0xB7) {
+        panel.page = code & 0x07;
+    }
+
+    switch (code) {
+        case 0x20:
+            panel.addressing = command[1] & 0x03;
+            break;
+        case 0x21:
+            panel.column_start = command[1] & 0x7F;
+            panel.column_end = command[2] & 0x7F;
+            panel.column = panel.column_start;
+            break;
+        case 0x22:
+            panel.page_start = command[1] & 0x07;
+            panel.page_end = command[2] & 0x07;
+            panel.page = panel.page_start;
+            break;
+        case 0x81:
+            panel.contrast = command[1];
+            break;
+        case 0x8D:
+            panel.charge_pump = (command[1] & 0x04) != 0;
+            break;
+        case 0xA0:
+        case 0xA1:
+            panel.segment_remap = code & 0x01;
+            break;
+        case 0xA4:
+        case 0xA5:
+            panel.entire_on = code & 0x01;
+            break;
+        case 0xA6:
+        case 0xA7:
+            panel.inverse = code & 0x01;
+            break;
+        case 0xAE:
+        case 0xAF:
+            panel.display_on = code & 0x01;
+            break;
+        case 0xC0:
+        case 0xC8:
+            panel.com_reverse = (code & 0x08) != 0;
+            break;
+        default:
+            break;
+    }
+}
+
+static void advance(void) {
+    switch (panel.addressing) {
+        case ADDRESSING_HORIZONTAL:
+            if (panel.column++ < panel.column_end) return;
+            panel.column = panel.column_start;
+            panel.page = panel.page < panel.page_end ? panel.page + 1 : panel.page_start;
+            return;
+        case ADDRESSING_VERTICAL:
+            if (panel.page++ < panel.page_end) return;
+            panel.page = panel.page_start;
+            panel.column = panel.column < panel.column_end ? panel.column + 1 : panel.column_start;
+            return;
+        default:
+            // page addressing wraps inside the page
+            panel.column = (panel.column + 1) % PANEL_WIDTH;
+            return;
+    }
+}
+
+void ssd1306_write(const bool is_data, const uint8_t byte) {
+    if (is_data) {
+        panel.gddram[panel.page][panel.column] = byte;
+        advance();
+        return;
+    }
+
+    // arguments may arrive in separate Co=1 pairs, the decoder does not care about the framing
+    if (panel.arguments_missing == 0) {
+        panel.command_length = 0;
+        panel.arguments_missing = argument_count(byte);
+    } else {
+        panel.arguments_missing--;
+    }
+    panel.command[panel.command_length++] = byte;
+
+    if (panel.arguments_missing == 0) {
+        execute(panel.command);
+    }
+}
+
+bool ssd1306_pixel(const int x, const int y) {
+    if (!panel.display_on || !panel.charge_pump) return false;
+    if (panel.entire_on) return true;
+
+    const int column = panel.segment_remap ? x : PANEL_WIDTH - 1 - x;
+    const int row = panel.com_reverse ? y : PANEL_HEIGHT - 1 - y;
+    const int line = (row + panel.start_line) % PANEL_HEIGHT;
+    const bool lit = panel.gddram[line / 8][column] >> (line % 8) & 1;
+    return lit != panel.inverse;
+}
+
+uint8_t ssd1306_contrast(void) {
+    return panel.contrast;
+}
+
+bool ssd1306_is_on(void) {
+    return panel.display_on && panel.charge_pump;
+}
+
+// binary PBM as the glass looks: lit pixels white on black
+void ssd1306_write_pbm(FILE *out) {
+    fprintf(out, "P4\n%d %d\n", PANEL_WIDTH, PANEL_HEIGHT);
+    for (int y = 0; y < PANEL_HEIGHT; y++) {
+        for (int x = 0; x < PANEL_WIDTH; x += 8) {
+            uint8_t packed = 0;
+            for (int bit = 0; bit < 8; bit++) {
+                if (!ssd1306_pixel(x + bit, y)) packed |= 0x80 >> bit;
+            }
+            fputc(packed, out);
+        }
+    }
+}
+
+void ssd1306_print(FILE *out) {
+    char line[PANEL_WIDTH + 3];
+    memset(line, '-', sizeof(line) - 1);
+    line[0] = line[PANEL_WIDTH + 1] = '+';
+    line[PANEL_WIDTH + 2] = '\0';
+
+    fprintf(out, "%s\n", line);
+    for (int y = 0; y < PANEL_HEIGHT; y++) {
+        fputc('|', out);
+        for (int x = 0; x < PANEL_WIDTH; x++) {
+            fputc(ssd1306_pixel(x, y) ? '#' : ' ', out);
+        }
+        fputs("|\n", out);
+    }
+    fprintf(out, "%s\n", line);
+}
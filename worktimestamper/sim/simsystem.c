@@ -0,0 +1,116 @@
+#include "sim.h"
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <time.h>
+
+// The device clock is a wall time offset against the virtual clock, settimeofday moves the offset.
+// The true time is what an NTP server would answer, it starts at the -t time of the script.
+static int64_t device_offset_us;
+static int64_t true_offset_us;
+static bool rtc_kept;
+static esp_log_level_t log_level = ESP_LOG_INFO;
+
+static const char level_letters[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+
+void sim_clock_init(const int64_t true_time_us, const bool keep_rtc) {
+    rtc_kept = keep_rtc;
+    true_offset_us = true_time_us - sim_now_us();
+    // after a power loss the RTC starts over at the epoch
+    device_offset_us = keep_rtc ? true_offset_us : -sim_now_us();
+}
+
+int64_t sim_true_time_us(void) {
+    return true_offset_us + sim_now_us();
+}
+
+int64_t sim_device_time_us(void) {
+    return device_offset_us + sim_now_us();
+}
+
+void sim_set_device_time_us(const int64_t time_us) {
+    device_offset_us = time_us - sim_now_us();
+}
+
+bool sim_rtc_kept(void) {
+    return rtc_kept;
+}
+
+// the firmware objects are linked with --wrap for these, see CMakeLists.txt
+int __wrap_gettimeofday(struct timeval *tv, void *tz) {
+    (void) tz;
+    if (tv) {
+        const int64_t now = sim_device_time_us();
+        tv->tv_sec = (time_t) (now / 1000000);
+        tv->tv_usec = (suseconds_t) (now % 1000000);
+    }
+    return 0;
+}
+
+int __wrap_settimeofday(const struct timeval *tv, const void *tz) {
+    (void) tz;
+    if (tv) sim_set_device_time_us((int64_t) tv->tv_sec * 1000000 + tv->tv_usec);
+    return 0;
+}
+
+time_t __wrap_time(time_t *out) {
+    const time_t now = (time_t) (sim_device_time_us() / 1000000);
+    if (out) *out = now;
+    return now;
+}
+
+void sim_log_set_level(const int level) {
+    log_level = (esp_log_level_t) level;
+}
+
+void esp_log_level_set(const char *tag, const esp_log_level_t level) {
+    (void) tag;
+    log_level = level;
+}
+
+void esp_log_write(const esp_log_level_t level, const char *tag, const char *format, ...) {
+    if (level > log_level || level == ESP_LOG_NONE) return;
+
+    printf("%c (%lld) %s: ", level_letters[level], (long long) (sim_now_us() / 1000), tag);
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    putchar('\n');
+}
+
+esp_reset_reason_t esp_reset_reason(void) {
+    return rtc_kept ? ESP_RST_SW : ESP_RST_POWERON;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_uart_wakeup(const int uart_num) {
+    (void) uart_num;
+    return ESP_OK;
+}
+
+// the host heap is not modelled, the console reports an empty one
+size_t heap_caps_get_free_size(const uint32_t caps) {
+    (void) caps;
+    return 0;
+}
+
+size_t heap_caps_get_minimum_free_size(const uint32_t caps) {
+    (void) caps;
+    return 0;
+}
+
+size_t heap_caps_get_largest_free_block(const uint32_t caps) {
+    (void) caps;
+    return 0;
+}
@@ -0,0 +1,42 @@
+#include "sim.h"
+
+#include "esp_log.h"
+#include "exporthandler.h"
+#include "wifisynchandler.h"
+
+
+// The radio and the export UART are not simulated. The sync task is replaced by the script command
+// "sync", which sets the clock to the true time the way a successful NTP run does.
+
+static const char *TAG = "SIM_WIFI";
+
+static time_sync_callback_t sync_callback;
+static bool synced;
+static WifiSyncTimings_t timings;
+
+void init_wifi_sync_handler(const int priority, const uint32_t max_error_ms, const time_sync_callback_t on_synced) {
+    (void) priority;
+    (void) max_error_ms;
+    sync_callback = on_synced;
+    ESP_LOGI(TAG, "no radio, the script command 'sync' sets the clock");
+}
+
+void get_wifi_sync_timings(WifiSyncTimings_t *out) {
+    *out = timings;
+}
+
+// the callback only runs for the first sync after boot, later runs just correct the clock
+void sim_wifi_sync(void) {
+    sim_set_device_time_us(sim_true_time_us());
+    timings.runs++;
+
+    if (!synced && sync_callback) {
+        synced = true;
+        sync_callback();
+    }
+}
+
+void init_export_handler(const int priority) {
+    (void) priority;
+    ESP_LOGI("SIM_EXPORT", "export UART not simulated");
+}
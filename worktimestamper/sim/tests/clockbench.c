@@ -0,0 +1,176 @@
+// Cost of one clock tick of the working view: the digit registers of timetracker_clock.c against the
+// snprintf path they replaced (localtime_r and two snprintf into scratch buffers every second).
+//
+//   clockbench [days]
+//
+// Both paths render the header and the net work row for every second of the day of the switch to
+// summer time, once per day asked for. A verification pass first checks they produce the same text,
+// including the switch the registers only see on their minute resync. Cycles come from the TSC on x86,
+// elsewhere the cost is in ns.
+
+#include "timetracker_clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define COST_UNIT "cycles"
+
+static uint64_t cost_now(void) {
+    return __rdtsc();
+}
+#else
+#define COST_UNIT "ns"
+
+static uint64_t cost_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+#endif
+
+#define FIRMWARE_TZ "CET-1CEST,M3.5.0/2,M10.5.0/3" // app_main sets the same zone
+#define DEFAULT_DAYS 20
+#define DAY_TICKS 86400
+#define ROW_LENGTH 20
+#define HEADER_STATUS_COLUMN 13
+#define NET_WORK_LABEL "net work: "
+
+// 2024-03-31 00:00:00 CET, summer time starts at 02:00
+#define START_TIME 1711839600
+#define SESSION_START (START_TIME - 2 * 3600)
+
+typedef struct {
+    char header[ROW_LENGTH + 1];
+    char net_work[ROW_LENGTH + 1];
+} Rows_t;
+
+static TimeRegister_t clock_register = {.hour_modulo = 24};
+static TimeRegister_t work_register = {.hour_modulo = 100};
+
+// display_working before the registers, the session of calculate_work_time is running
+static void render_snprintf(const time_t now, Rows_t *rows) {
+    struct tm time_info;
+    localtime_r(&now, &time_info);
+    snprintf(rows->header, sizeof(rows->header), "%02d:%02d:%02d     %s", time_info.tm_hour, time_info.tm_min,
+             time_info.tm_sec, "working");
+
+    const time_t work_time = now - SESSION_START;
+    char temp[64];
+    const int len = snprintf(temp, sizeof(temp), "net work: %02d:%02d:%02d", (int) work_time / 3600,
+                             (int) (work_time % 3600) / 60, (int) work_time % 60);
+    memcpy(rows->net_work, temp, len < ROW_LENGTH ? (size_t) len : ROW_LENGTH);
+}
+
+static void resync_registers(const time_t now) {
+    struct tm time_info;
+    localtime_r(&now, &time_info);
+    time_register_set(&clock_register, time_info.tm_hour, time_info.tm_min, time_info.tm_sec);
+    time_register_set_seconds(&work_register, (uint32_t) (now - SESSION_START));
+}
+
+// advance_registers and render_working of timetracker_display.c, one second after the last call
+static void render_registers(const time_t now, Rows_t *rows) {
+    const bool minute_passed = time_register_tick(&clock_register);
+    time_register_tick(&work_register);
+    if (minute_passed) {
+        resync_registers(now);
+    }
+
+    memcpy(rows->header, clock_register.text, TIME_REGISTER_LENGTH);
+    memcpy(rows->header + HEADER_STATUS_COLUMN, "working", 7);
+    memcpy(rows->net_work, NET_WORK_LABEL, sizeof(NET_WORK_LABEL) - 1);
+    memcpy(rows->net_work + sizeof(NET_WORK_LABEL) - 1, work_register.text, TIME_REGISTER_LENGTH);
+}
+
+// clear_frame of oledhandler.c for the two rows
+static void clear_rows(Rows_t *rows) {
+    memset(rows, ' ', sizeof(*rows));
+    rows->header[ROW_LENGTH] = '\0';
+    rows->net_work[ROW_LENGTH] = '\0';
+}
+
+static bool verify(void) {
+    resync_registers(START_TIME);
+
+    for (uint32_t i = 1; i <= DAY_TICKS; i++) {
+        const time_t now = START_TIME + i;
+        Rows_t expected, rendered;
+        clear_rows(&expected);
+        clear_rows(&rendered);
+        render_snprintf(now, &expected);
+        render_registers(now, &rendered);
+
+        if (memcmp(&expected, &rendered, sizeof(expected)) != 0) {
+            fprintf(stderr, "tick %lu: \"%s\" \"%s\" expected \"%s\" \"%s\"\n", (unsigned long) i,
+                    rendered.header, rendered.net_work, expected.header, expected.net_work);
+            return false;
+        }
+    }
+    return true;
+}
+
+// the rows go into a checksum so neither loop can be optimized away
+static uint64_t run_snprintf(const uint32_t days, uint32_t *checksum) {
+    Rows_t rows;
+    clear_rows(&rows);
+
+    const uint64_t started = cost_now();
+    for (uint32_t day = 0; day < days; day++) {
+        for (uint32_t i = 1; i <= DAY_TICKS; i++) {
+            render_snprintf(START_TIME + i, &rows);
+            *checksum += (uint8_t) rows.header[7] + (uint8_t) rows.net_work[17];
+        }
+    }
+    return cost_now() - started;
+}
+
+// every day starts with the resync the boot or a time sync does
+static uint64_t run_registers(const uint32_t days, uint32_t *checksum) {
+    Rows_t rows;
+    clear_rows(&rows);
+
+    const uint64_t started = cost_now();
+    for (uint32_t day = 0; day < days; day++) {
+        resync_registers(START_TIME);
+        for (uint32_t i = 1; i <= DAY_TICKS; i++) {
+            render_registers(START_TIME + i, &rows);
+            *checksum += (uint8_t) rows.header[7] + (uint8_t) rows.net_work[17];
+        }
+    }
+    return cost_now() - started;
+}
+
+int main(const int argc, char **argv) {
+    const uint32_t days = argc > 1 ? (uint32_t) strtoul(argv[1], NULL, 10) : DEFAULT_DAYS;
+    if (days == 0) {
+        fprintf(stderr, "usage: clockbench [days]\n");
+        return 2;
+    }
+
+    setenv("TZ", FIRMWARE_TZ, 1);
+    tzset();
+
+    if (!verify()) return 1;
+
+    uint32_t snprintf_sum = 0;
+    uint32_t register_sum = 0;
+    const uint64_t snprintf_cost = run_snprintf(days, &snprintf_sum);
+    const uint64_t register_cost = run_registers(days, &register_sum);
+    const uint32_t ticks = days * DAY_TICKS;
+    if (snprintf_sum != register_sum) {
+        fprintf(stderr, "checksums differ: %lu %lu\n", (unsigned long) snprintf_sum, (unsigned long) register_sum);
+        return 1;
+    }
+
+    const double snprintf_per_tick = (double) snprintf_cost / ticks;
+    const double register_per_tick = (double) register_cost / ticks;
+    printf("%lu ticks, same rows on both paths\n", (unsigned long) ticks);
+    printf("snprintf   %8.1f %s/tick\n", snprintf_per_tick, COST_UNIT);
+    printf("registers  %8.1f %s/tick, %.1fx faster\n", register_per_tick, COST_UNIT,
+           snprintf_per_tick / register_per_tick);
+    return 0;
+}
@@ -0,0 +1,150 @@
+// exporthandler/exporthandler.c on the host, its UART mapped to a pty for tools/export_decoder.py.
+//
+//   exporthost
+//
+// Fills the journal on the RAM partition of simflash.c, prints the path of the pty to open as the
+// serial port and serves queries until stdin is closed. exporttest.py drives it. The journal:
+//
+//   1 .. EXPORT_UNSYNCED_STAMPS    stamps taken before the clock was set
+//   EXPORT_UNSYNCED_STAMPS + 1     the correction shifting them by EXPORT_CORRECTION_S
+//   up to EXPORT_RECORDS           synced stamps
+//
+// Stamp n is at EXPORT_BASE_TIME + n * EXPORT_INTERVAL_S, odd sequences start a session.
+
+// posix_openpt and friends are XSI
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+
+#include "sim.h"
+#include "exporthandler.h"
+#include "timetracker_journal.h"
+
+#include <driver/uart.h>
+#include <esp_sleep.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define EXPORT_RECORDS 70
+#define EXPORT_UNSYNCED_STAMPS 4
+#define EXPORT_CORRECTION_S (-7200)
+#define EXPORT_BASE_TIME 1704700800 // 2024-01-08 08:00 UTC
+#define EXPORT_INTERVAL_S 60
+
+// the master side is the UART, the slave side is the serial port of the host
+static int uart_fd = -1;
+
+esp_err_t uart_driver_install(const uart_port_t uart_num, const int rx_buffer_size, const int tx_buffer_size,
+                              const int queue_size, QueueHandle_t *uart_queue, const int intr_alloc_flags) {
+    (void) uart_num;
+    (void) rx_buffer_size;
+    (void) tx_buffer_size;
+    (void) queue_size;
+    (void) uart_queue;
+    (void) intr_alloc_flags;
+    return uart_fd >= 0 ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t uart_param_config(const uart_port_t uart_num, const uart_config_t *uart_config) {
+    (void) uart_num;
+    (void) uart_config;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(const uart_port_t uart_num, const int tx_io_num, const int rx_io_num, const int rts_io_num,
+                       const int cts_io_num) {
+    (void) uart_num;
+    (void) tx_io_num;
+    (void) rx_io_num;
+    (void) rts_io_num;
+    (void) cts_io_num;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_wakeup_threshold(const uart_port_t uart_num, const int wakeup_threshold) {
+    (void) uart_num;
+    (void) wakeup_threshold;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_uart_wakeup(const int uart_num) {
+    (void) uart_num;
+    return ESP_OK;
+}
+
+int uart_read_bytes(const uart_port_t uart_num, void *buf, const uint32_t length, const TickType_t ticks_to_wait) {
+    (void) uart_num;
+    struct pollfd readable = {.fd = uart_fd, .events = POLLIN};
+    const int timeout_ms = ticks_to_wait == portMAX_DELAY ? -1 : (int) pdTICKS_TO_MS(ticks_to_wait);
+    if (poll(&readable, 1, timeout_ms) <= 0) return 0;
+
+    const ssize_t count = read(uart_fd, buf, length);
+    return count < 0 ? -1 : (int) count;
+}
+
+int uart_write_bytes(const uart_port_t uart_num, const void *src, const size_t size) {
+    (void) uart_num;
+    for (size_t written = 0; written < size;) {
+        const ssize_t count = write(uart_fd, (const uint8_t *) src + written, size - written);
+        if (count < 0) return -1;
+        written += (size_t) count;
+    }
+    return (int) size;
+}
+
+esp_err_t uart_wait_tx_done(const uart_port_t uart_num, const TickType_t ticks_to_wait) {
+    (void) uart_num;
+    (void) ticks_to_wait;
+    return ESP_OK;
+}
+
+// The slave stays open here as well: the master reads EIO while no process has it open, that is
+// between two runs of the decoder. Raw mode keeps the line discipline off the binary frames.
+static const char *open_pty(void) {
+    uart_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (uart_fd < 0 || grantpt(uart_fd) != 0 || unlockpt(uart_fd) != 0) return NULL;
+
+    const char *path = ptsname(uart_fd);
+    const int slave_fd = path ? open(path, O_RDWR | O_NOCTTY) : -1;
+    struct termios attributes;
+    if (slave_fd < 0 || tcgetattr(slave_fd, &attributes) != 0) return NULL;
+    cfmakeraw(&attributes);
+    tcsetattr(slave_fd, TCSANOW, &attributes);
+    return path;
+}
+
+static void fill_journal(void) {
+    for (uint32_t sequence = 1; sequence <= EXPORT_RECORDS; sequence++) {
+        if (sequence == EXPORT_UNSYNCED_STAMPS + 1) {
+            journal_append_correction(EXPORT_CORRECTION_S);
+            continue;
+        }
+        journal_append_stamp(EXPORT_BASE_TIME + sequence * EXPORT_INTERVAL_S, sequence % 2 == 1,
+                             sequence > EXPORT_UNSYNCED_STAMPS);
+    }
+}
+
+int main(void) {
+    sim_flash_init(NULL);
+    if (init_journal() != ESP_OK) return 2;
+    fill_journal();
+
+    const char *path = open_pty();
+    if (path == NULL) {
+        perror("pty");
+        return 2;
+    }
+
+    init_export_handler(5);
+    printf("%s\n", path);
+    fflush(stdout);
+
+    char discard[64];
+    while (read(STDIN_FILENO, discard, sizeof(discard)) > 0) {
+    }
+    return 0;
+}
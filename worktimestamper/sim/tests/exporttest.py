@@ -0,0 +1,217 @@
+#!/usr/bin/env python3
+"""tools/export_decoder.py against exporthandler.c on a pty, see exporthost.c.
+
+  exporttest.py path/to/exporthost path/to/export_decoder.py
+
+Runs the decoder as the user does with two --since values in CSV and JSON and checks the records
+against the journal exporthost fills. Captures of the device stream with a damaged frame or without
+the end frame check the CRC and end handling of the decoder, a query with a broken CRC the one of
+the device.
+"""
+
+import csv
+import importlib.util
+import io
+import json
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+import unittest
+
+# exporthost.c
+RECORDS = 70
+UNSYNCED_STAMPS = 4
+CORRECTION_S = -7200
+BASE_TIME = 1704700800
+INTERVAL_S = 60
+
+RECORDS_PER_FRAME = 32
+FRAME_SIZE = 5 + RECORDS_PER_FRAME * 13 + 4
+SINCE = 37
+
+host_path = None
+decoder_path = None
+decoder = None
+
+
+def expected_rows(since):
+    """The rows of the decoder for every journal record above since."""
+    rows = []
+    for sequence in range(since + 1, RECORDS + 1):
+        row = dict.fromkeys(decoder.FIELDS)
+        row["sequence"] = sequence
+        if sequence == UNSYNCED_STAMPS + 1:
+            row.update(kind="correction", offset=CORRECTION_S, first_sequence=1)
+        else:
+            row.update(kind="start" if sequence % 2 else "end", synced=sequence > UNSYNCED_STAMPS,
+                       time=BASE_TIME + sequence * INTERVAL_S)
+            row["iso_time"] = time.strftime("%Y-%m-%dT%H:%M:%S+00:00", time.gmtime(row["time"]))
+        rows.append(row)
+    return rows
+
+
+def as_csv_text(rows):
+    """What csv.DictWriter makes of rows: None empty, everything else as str()."""
+    return [{key: "" if value is None else str(value) for key, value in row.items()} for row in rows]
+
+
+class ExportTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        # the log of the device goes to stderr as it is
+        cls.host = subprocess.Popen([host_path], stdin=subprocess.PIPE, stdout=subprocess.PIPE, text=True)
+        cls.port = cls.host.stdout.readline().strip()
+        if not cls.port:
+            raise RuntimeError("exporthost printed no pty")
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.host.stdin.close()
+        cls.host.wait(timeout=5)
+        cls.host.stdout.close()
+
+    def run_decoder(self, *args):
+        result = subprocess.run([sys.executable, decoder_path, *args], capture_output=True, text=True, timeout=30)
+        return result.returncode, result.stdout, result.stderr
+
+    def capture(self, since, payload=None):
+        """The raw device stream for one query, the query payload can be replaced by a damaged one."""
+        fd = decoder.open_port(self.port, 921600)
+        try:
+            os.write(fd, decoder.WAKE)
+            time.sleep(decoder.WAKE_S)
+            os.write(fd, payload or decoder.encode_frame(decoder.FRAME_QUERY, struct.pack("<I", since)))
+
+            data = b""
+            deadline = time.monotonic() + 0.5
+            while time.monotonic() < deadline:
+                try:
+                    chunk = os.read(fd, 4096)
+                except BlockingIOError:
+                    time.sleep(0.005)
+                    continue
+                data += chunk
+                deadline = time.monotonic() + 0.5
+            return data
+        finally:
+            os.close(fd)
+
+    def decode_capture(self, data):
+        with tempfile.NamedTemporaryFile(suffix=".bin", delete=False) as capture:
+            capture.write(data)
+        try:
+            return self.run_decoder("--capture", capture.name, "--json")
+        finally:
+            os.unlink(capture.name)
+
+    def test_everything_as_csv(self):
+        code, output, errors = self.run_decoder(self.port)
+        self.assertEqual(code, 0, errors)
+        self.assertEqual(list(csv.DictReader(io.StringIO(output))), as_csv_text(expected_rows(0)))
+        self.assertIn(f"next --since {RECORDS}", errors)
+        self.assertNotIn("decoded", errors)
+
+    def test_since_as_json(self):
+        code, output, errors = self.run_decoder(self.port, "--since", str(SINCE), "--json")
+        self.assertEqual(code, 0, errors)
+        self.assertEqual(json.loads(output), expected_rows(SINCE))
+        self.assertIn(f"next --since {RECORDS}", errors)
+
+    def test_nothing_new_keeps_since(self):
+        code, output, errors = self.run_decoder(self.port, "--since", str(RECORDS), "--json")
+        self.assertEqual(code, 0, errors)
+        self.assertEqual(json.loads(output), [])
+        self.assertIn(f"next --since {RECORDS}", errors)
+
+    def test_stream_framing(self):
+        data = self.capture(0)
+        frames = list(decoder.read_frames(iter([data, None]).__next__, timeout=1.0))
+        types = [frame_type for frame_type, _ in frames]
+        full, rest = divmod(RECORDS, RECORDS_PER_FRAME)
+        self.assertEqual(types, [decoder.FRAME_RECORDS] * (full + (rest > 0)) + [decoder.FRAME_END])
+        self.assertEqual(struct.unpack("<II", frames[-1][1]), (RECORDS, RECORDS))
+
+    def test_damaged_query_is_ignored(self):
+        query = bytearray(decoder.encode_frame(decoder.FRAME_QUERY, struct.pack("<I", 0)))
+        query[-1] ^= 0xFF
+        self.assertEqual(self.capture(0, bytes(query)), b"")
+
+        # the device resynchronizes, the next query is answered
+        self.assertTrue(self.capture(RECORDS).endswith(
+            decoder.encode_frame(decoder.FRAME_END, struct.pack("<II", RECORDS, 0))))
+
+    def test_capture_with_damaged_frame(self):
+        data = bytearray(self.capture(0))
+        # a byte of the first record of the first frame, the decoder skips that frame and resynchronizes
+        data[decoder.HEADER_SIZE + 4] ^= 0xFF
+        code, output, errors = self.decode_capture(bytes(data))
+        self.assertEqual(code, 1, errors)
+        self.assertEqual(json.loads(output), expected_rows(RECORDS_PER_FRAME))
+        self.assertIn(f"device sent {RECORDS} records, decoded {RECORDS - RECORDS_PER_FRAME}", errors)
+        # the end frame's sequence would lose the skipped records, the capture's own since is unknown
+        self.assertNotIn("--since", errors)
+
+    def test_damage_resumes_in_front_of_it(self):
+        data = bytearray(self.capture(0))
+        second_frame = FRAME_SIZE
+        data[second_frame + decoder.HEADER_SIZE + 4] ^= 0xFF
+        code, output, errors = self.decode_capture(bytes(data))
+        self.assertEqual(code, 1, errors)
+        rows = expected_rows(0)
+        self.assertEqual(json.loads(output), rows[:RECORDS_PER_FRAME] + rows[2 * RECORDS_PER_FRAME:])
+        self.assertIn(f"resume with --since {RECORDS_PER_FRAME}", errors)
+
+        # damage in front of every record of a query resumes at the since of the query
+        data = bytearray(self.capture(SINCE))
+        data[decoder.HEADER_SIZE + 4] ^= 0xFF
+        _, resume, problem = decoder.collect(decoder.read_frames(iter([bytes(data), None]).__next__, 1.0), SINCE)
+        self.assertEqual(resume, SINCE)
+        self.assertIn("decoded", problem)
+
+    def test_damaged_length_does_not_swallow_the_stream(self):
+        data = bytearray(self.capture(0))
+        # the high length byte of the first frame, 64 KB would cover the rest of the stream
+        data[4] ^= 0xFF
+        code, output, errors = self.decode_capture(bytes(data))
+        self.assertEqual(code, 1, errors)
+        self.assertEqual(json.loads(output), expected_rows(RECORDS_PER_FRAME))
+        self.assertIn(f"device sent {RECORDS} records, decoded {RECORDS - RECORDS_PER_FRAME}", errors)
+
+    def test_capture_without_end_frame(self):
+        data = self.capture(SINCE)
+        end = decoder.encode_frame(decoder.FRAME_END, struct.pack("<II", RECORDS, RECORDS - SINCE))
+        self.assertTrue(data.endswith(end))
+        code, output, errors = self.decode_capture(data[:-len(end)])
+        self.assertEqual(code, 1)
+        self.assertEqual(json.loads(output), expected_rows(SINCE))
+        self.assertIn("no end frame", errors)
+        self.assertIn(f"resume with --since {RECORDS}", errors)
+
+        # a damaged end frame is no end frame either
+        damaged = bytearray(data)
+        damaged[-1] ^= 0xFF
+        code, _, errors = self.decode_capture(bytes(damaged))
+        self.assertEqual(code, 1)
+        self.assertIn("no end frame", errors)
+
+
+def main():
+    global host_path, decoder_path, decoder
+    if len(sys.argv) < 3:
+        print(__doc__, file=sys.stderr)
+        return 2
+    host_path, decoder_path = sys.argv[1], sys.argv[2]
+
+    spec = importlib.util.spec_from_file_location("export_decoder", decoder_path)
+    decoder = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(decoder)
+
+    program = unittest.main(argv=sys.argv[:1] + sys.argv[3:], exit=False, verbosity=2)
+    return 0 if program.result.wasSuccessful() else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,192 @@
+// esp_http_client of the host tests: HTTP/1.1 over a host TCP socket, only what uploadhandler.c
+// uses. The socket is connected by the first open and reused by every later one until close, a
+// connection the server dropped meanwhile fails on that request the way it does on the device.
+
+#include "esp_http_client.h"
+
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define HOST_HTTP_MAX_HEADERS 4
+#define HOST_HTTP_BUFFER 1024
+
+struct HostHttpClient {
+    char host[64];
+    char port[8];
+    char path[128];
+    esp_http_client_method_t method;
+    int timeout_ms;
+    char headers[HOST_HTTP_MAX_HEADERS][2][64];
+    int header_count;
+
+    int sock; // -1 while not connected
+    int status;
+    int64_t content_length;
+    int64_t body_left;
+    char buffer[HOST_HTTP_BUFFER]; // received behind the response headers, not read yet
+    int buffered;
+};
+
+static bool parse_url(esp_http_client_handle_t client, const char *url) {
+    if (strncmp(url, "http://", 7) != 0) return false;
+
+    const char *host = url + 7;
+    const char *path = strchr(host, '/');
+    if (path == NULL) path = "/";
+    const char *port = memchr(host, ':', (size_t) (path - host));
+    const char *host_end = port ? port : path;
+
+    snprintf(client->host, sizeof(client->host), "%.*s", (int) (host_end - host), host);
+    snprintf(client->port, sizeof(client->port), "%.*s", port ? (int) (path - port - 1) : 2, port ? port + 1 : "80");
+    snprintf(client->path, sizeof(client->path), "%s", path);
+    return true;
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config) {
+    esp_http_client_handle_t client = calloc(1, sizeof(*client));
+    if (client == NULL || !parse_url(client, config->url)) {
+        free(client);
+        return NULL;
+    }
+
+    client->method = config->method;
+    client->timeout_ms = config->timeout_ms;
+    client->sock = -1;
+    return client;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value) {
+    if (client->header_count == HOST_HTTP_MAX_HEADERS) return ESP_ERR_NO_MEM;
+    snprintf(client->headers[client->header_count][0], sizeof(client->headers[0][0]), "%s", key);
+    snprintf(client->headers[client->header_count][1], sizeof(client->headers[0][1]), "%s", value);
+    client->header_count++;
+    return ESP_OK;
+}
+
+static bool connect_socket(esp_http_client_handle_t client) {
+    const struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *found = NULL;
+    if (getaddrinfo(client->host, client->port, &hints, &found) != 0 || found == NULL) return false;
+
+    client->sock = socket(AF_INET, SOCK_STREAM, 0);
+    const struct timeval timeout = {.tv_sec = client->timeout_ms / 1000, .tv_usec = client->timeout_ms % 1000 * 1000};
+    setsockopt(client->sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client->sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    const bool connected = connect(client->sock, found->ai_addr, found->ai_addrlen) == 0;
+    freeaddrinfo(found);
+    if (!connected) esp_http_client_close(client);
+    return connected;
+}
+
+static bool send_all(esp_http_client_handle_t client, const char *data, const int length) {
+    for (int sent = 0; sent < length;) {
+        const ssize_t count = send(client->sock, data + sent, (size_t) (length - sent), MSG_NOSIGNAL);
+        if (count <= 0) return false;
+        sent += (int) count;
+    }
+    return true;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, const int write_len) {
+    if (client->sock < 0 && !connect_socket(client)) return ESP_FAIL;
+
+    char request[HOST_HTTP_BUFFER];
+    int length = snprintf(request, sizeof(request), "%s %s HTTP/1.1\r\nHost: %s\r\nContent-Length: %d\r\n",
+                          client->method == HTTP_METHOD_POST ? "POST" : "GET", client->path, client->host, write_len);
+    for (int i = 0; i < client->header_count; i++) {
+        length += snprintf(request + length, sizeof(request) - length, "%s: %s\r\n", client->headers[i][0],
+                           client->headers[i][1]);
+    }
+    length += snprintf(request + length, sizeof(request) - length, "\r\n");
+
+    client->status = 0;
+    client->buffered = 0;
+    return send_all(client, request, length) ? ESP_OK : ESP_FAIL;
+}
+
+int esp_http_client_write(esp_http_client_handle_t client, const char *buffer, const int len) {
+    return send_all(client, buffer, len) ? len : -1;
+}
+
+// reads up to the end of the headers, whatever came behind them is kept for esp_http_client_read
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client) {
+    char headers[HOST_HTTP_BUFFER + 1];
+    int used = 0;
+    char *end = NULL;
+
+    while (end == NULL) {
+        if (used == HOST_HTTP_BUFFER) return ESP_FAIL;
+        const ssize_t count = recv(client->sock, headers + used, (size_t) (HOST_HTTP_BUFFER - used), 0);
+        if (count <= 0) return ESP_FAIL;
+        used += (int) count;
+        headers[used] = '\0';
+        end = strstr(headers, "\r\n\r\n");
+    }
+
+    if (sscanf(headers, "HTTP/1.%*d %d", &client->status) != 1) return ESP_FAIL;
+
+    client->content_length = 0;
+    for (const char *line = strstr(headers, "\r\n"); line && line < end; line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, "Content-Length:", 15) == 0) {
+            client->content_length = strtoll(line + 17, NULL, 10);
+        }
+    }
+
+    client->buffered = used - (int) (end + 4 - headers);
+    memcpy(client->buffer, end + 4, (size_t) client->buffered);
+    client->body_left = client->content_length;
+    return client->content_length;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client) {
+    return client->status;
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len) {
+    if (len > client->body_left) len = (int) client->body_left;
+    if (len <= 0) return 0;
+
+    if (client->buffered > 0) {
+        if (len > client->buffered) len = client->buffered;
+        memcpy(buffer, client->buffer, (size_t) len);
+        memmove(client->buffer, client->buffer + len, (size_t) (client->buffered - len));
+        client->buffered -= len;
+    } else {
+        const ssize_t count = recv(client->sock, buffer, (size_t) len, 0);
+        if (count <= 0) return -1;
+        len = (int) count;
+    }
+
+    client->body_left -= len;
+    return len;
+}
+
+esp_err_t esp_http_client_flush_response(esp_http_client_handle_t client, int *len) {
+    int flushed = 0;
+    char discard[64];
+    int count;
+    while ((count = esp_http_client_read(client, discard, sizeof(discard))) > 0) {
+        flushed += count;
+    }
+    if (len) *len = flushed;
+    return count < 0 ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client) {
+    if (client->sock >= 0) close(client->sock);
+    client->sock = -1;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client) {
+    esp_http_client_close(client);
+    free(client);
+    return ESP_OK;
+}
@@ -0,0 +1,187 @@
+// Runtime of the host tests: the IDF shims of sim/include on the real clock, for firmware modules
+// which talk to real sockets or ptys. The simulator itself runs on the virtual clock of simkernel.c.
+
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NVS_MAX_NAMESPACES 4
+#define NVS_MAX_VALUES 16
+
+static const char level_letters[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+static esp_log_level_t log_level = ESP_LOG_INFO;
+
+int64_t esp_timer_get_time(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void esp_log_level_set(const char *tag, const esp_log_level_t level) {
+    (void) tag;
+    log_level = level;
+}
+
+// on stderr, stdout belongs to the test
+void esp_log_write(const esp_log_level_t level, const char *tag, const char *format, ...) {
+    if (level > log_level || level == ESP_LOG_NONE) return;
+
+    fprintf(stderr, "%c (%lld) %s: ", level_letters[level], (long long) (esp_timer_get_time() / 1000), tag);
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+// the tasks are real threads, a critical section is one lock over all of them, nesting like the spinlocks
+static pthread_mutex_t critical_lock;
+static pthread_once_t critical_once = PTHREAD_ONCE_INIT;
+
+static void init_critical_lock(void) {
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&critical_lock, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+}
+
+void sim_enter_critical(void) {
+    pthread_once(&critical_once, init_critical_lock);
+    pthread_mutex_lock(&critical_lock);
+}
+
+void sim_exit_critical(void) {
+    pthread_mutex_unlock(&critical_lock);
+}
+
+BaseType_t xPortInIsrContext(void) {
+    return pdFALSE;
+}
+
+typedef struct {
+    TaskFunction_t function;
+    void *arg;
+} HostTask_t;
+
+static void *run_task(void *arg) {
+    const HostTask_t task = *(HostTask_t *) arg;
+    free(arg);
+    task.function(task.arg);
+    return NULL;
+}
+
+// a detached thread, priority and stack are the host's, no handle is handed out
+BaseType_t xTaskCreate(const TaskFunction_t function, const char *name, const uint32_t stack_depth, void *arg,
+                       const UBaseType_t priority, TaskHandle_t *handle) {
+    (void) name;
+    (void) stack_depth;
+    (void) priority;
+    if (handle) *handle = NULL;
+
+    HostTask_t *task = malloc(sizeof(*task));
+    if (task == NULL) return pdFAIL;
+    *task = (HostTask_t){function, arg};
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, run_task, task) != 0) {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    return pdPASS;
+}
+
+// the host never sleeps, the locks only have to exist
+esp_err_t esp_pm_lock_create(const esp_pm_lock_type_t lock_type, const int arg, const char *name,
+                             esp_pm_lock_handle_t *out_handle) {
+    (void) lock_type;
+    (void) arg;
+    (void) name;
+    *out_handle = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(const esp_pm_lock_handle_t handle) {
+    (void) handle;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(const esp_pm_lock_handle_t handle) {
+    (void) handle;
+    return ESP_OK;
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, const esp_mac_type_t type) {
+    (void) type;
+    static const uint8_t address[6] = {0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01};
+    memcpy(mac, address, sizeof(address));
+    return ESP_OK;
+}
+
+// a handle is its namespace index + 1, values are committed right away
+typedef struct {
+    nvs_handle_t handle;
+    char key[16];
+    uint32_t value;
+} NvsValue_t;
+
+static char nvs_namespaces[NVS_MAX_NAMESPACES][16];
+static NvsValue_t nvs_values[NVS_MAX_VALUES];
+
+esp_err_t nvs_open(const char *name, const nvs_open_mode_t open_mode, nvs_handle_t *handle) {
+    for (int i = 0; i < NVS_MAX_NAMESPACES; i++) {
+        if (strcmp(nvs_namespaces[i], name) == 0 || (nvs_namespaces[i][0] == '\0' && open_mode == NVS_READWRITE)) {
+            strncpy(nvs_namespaces[i], name, sizeof(nvs_namespaces[i]) - 1);
+            *handle = (nvs_handle_t) i + 1;
+            return ESP_OK;
+        }
+    }
+    return open_mode == NVS_READONLY ? ESP_ERR_NVS_NOT_FOUND : ESP_ERR_NO_MEM;
+}
+
+static NvsValue_t *nvs_find(const nvs_handle_t handle, const char *key, const bool create) {
+    for (int i = 0; i < NVS_MAX_VALUES; i++) {
+        NvsValue_t *value = &nvs_values[i];
+        if (value->handle == handle && strcmp(value->key, key) == 0) return value;
+        if (value->handle == 0 && create) {
+            value->handle = handle;
+            strncpy(value->key, key, sizeof(value->key) - 1);
+            return value;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t nvs_get_u32(const nvs_handle_t handle, const char *key, uint32_t *out_value) {
+    const NvsValue_t *value = nvs_find(handle, key, false);
+    if (value == NULL) return ESP_ERR_NVS_NOT_FOUND;
+    *out_value = value->value;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u32(const nvs_handle_t handle, const char *key, const uint32_t value) {
+    NvsValue_t *stored = nvs_find(handle, key, true);
+    if (stored == NULL) return ESP_ERR_NO_MEM;
+    stored->value = value;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(const nvs_handle_t handle) {
+    (void) handle;
+    return ESP_OK;
+}
+
+void nvs_close(const nvs_handle_t handle) {
+    (void) handle;
+}
@@ -0,0 +1,252 @@
+// ntp_query of wifihandler/ntpclient.c against NTP stand-ins on 127.0.0.1.
+//
+// Every responder is a thread with its own UDP port. It can hold a request back before stamping it
+// (network delay, counts into the round trip) or between its receive and transmit stamps (server
+// processing, excluded from the round trip), run its clock off, or send answers the client has
+// to drop: a foreign originate, stratum 0 or 16, the unsynchronized leap indicator.
+
+#include "ntpclient.h"
+#include "esp_timer.h"
+
+#include <pthread.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define NTP_PACKET_SIZE 48
+#define NTP_UNIX_OFFSET 2208988800ULL
+#define NTP_LEAP_UNSYNCED 3
+#define NTP_MODE_SERVER 4
+
+// the firmware values, wifisynchandler.c
+#define SNTP_TIMEOUT_MS 3000
+#define SNTP_GRACE_MS 100
+
+// slack for the scheduling of the host, all delays of the stand-ins are far above it
+#define SLACK_MS 25
+
+typedef struct {
+    uint32_t network_delay_ms;
+    uint32_t processing_ms;
+    int64_t clock_offset_us; // server clock minus host clock
+    uint8_t stratum;
+    uint8_t leap;
+    bool foreign_originate;
+    bool silent;
+
+    int sock;
+    uint16_t port;
+    pthread_t thread;
+    volatile bool stop;
+    volatile int requests;
+} Responder_t;
+
+static int failures;
+
+#define CHECK(condition, ...) do { \
+    if (!(condition)) { \
+        failures++; \
+        printf("  FAIL %s:%d %s: ", __FILE__, __LINE__, #condition); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+    } \
+} while (0)
+
+static int64_t wall_us(const int64_t offset_us) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_usec + offset_us;
+}
+
+static void put_timestamp(uint8_t *dst, const int64_t unix_us) {
+    const uint32_t seconds = (uint32_t) (unix_us / 1000000 + NTP_UNIX_OFFSET);
+    const uint32_t fraction = (uint32_t) (((uint64_t) (unix_us % 1000000) << 32) / 1000000);
+    const uint32_t words[2] = {htonl(seconds), htonl(fraction)};
+    memcpy(dst, words, sizeof(words));
+}
+
+static void sleep_ms(const uint32_t ms) {
+    if (ms > 0) usleep(ms * 1000);
+}
+
+static void *responder_thread(void *arg) {
+    Responder_t *responder = arg;
+    struct pollfd readable = {.fd = responder->sock, .events = POLLIN};
+
+    while (!responder->stop) {
+        if (poll(&readable, 1, 20) <= 0) continue;
+
+        uint8_t request[NTP_PACKET_SIZE];
+        struct sockaddr_in client;
+        socklen_t client_length = sizeof(client);
+        const ssize_t length = recvfrom(responder->sock, request, sizeof(request), 0,
+                                        (struct sockaddr *) &client, &client_length);
+        if (length != NTP_PACKET_SIZE) continue;
+        responder->requests++;
+        if (responder->silent) continue;
+
+        sleep_ms(responder->network_delay_ms);
+        uint8_t reply[NTP_PACKET_SIZE] = {0};
+        put_timestamp(reply + 32, wall_us(responder->clock_offset_us));
+        sleep_ms(responder->processing_ms);
+
+        reply[0] = (uint8_t) (responder->leap << 6 | 4 << 3 | NTP_MODE_SERVER);
+        reply[1] = responder->stratum;
+        memcpy(reply + 24, request + 40, 8);
+        if (responder->foreign_originate) reply[31] ^= 0x55;
+        put_timestamp(reply + 40, wall_us(responder->clock_offset_us));
+
+        sendto(responder->sock, reply, sizeof(reply), 0, (const struct sockaddr *) &client, client_length);
+    }
+    return NULL;
+}
+
+static void start_responders(Responder_t *responders, NtpServer_t *servers, const int count) {
+    for (int i = 0; i < count; i++) {
+        Responder_t *responder = &responders[i];
+        responder->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+        struct sockaddr_in address = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+        socklen_t length = sizeof(address);
+        if (responder->sock < 0 || bind(responder->sock, (struct sockaddr *) &address, sizeof(address)) != 0
+            || getsockname(responder->sock, (struct sockaddr *) &address, &length) != 0) {
+            perror("responder socket");
+            exit(2);
+        }
+
+        responder->port = ntohs(address.sin_port);
+        servers[i] = (NtpServer_t){"127.0.0.1", responder->port};
+        pthread_create(&responder->thread, NULL, responder_thread, responder);
+    }
+}
+
+static void stop_responders(Responder_t *responders, const int count) {
+    for (int i = 0; i < count; i++) {
+        responders[i].stop = true;
+        pthread_join(responders[i].thread, NULL);
+        close(responders[i].sock);
+    }
+}
+
+// runs one query against the responders, returns its duration in ms
+static int64_t query(Responder_t *responders, const int count, const uint32_t timeout_ms, bool *accepted,
+                     NtpResult_t *result) {
+    NtpServer_t servers[NTP_MAX_SERVERS];
+    start_responders(responders, servers, count);
+
+    const int64_t started_us = esp_timer_get_time();
+    *accepted = ntp_query(servers, count, timeout_ms, SNTP_GRACE_MS, result);
+    const int64_t elapsed_ms = (esp_timer_get_time() - started_us) / 1000;
+
+    stop_responders(responders, count);
+    return elapsed_ms;
+}
+
+// the later answer has the lower round trip, the one the network delayed loses although it came first
+static void test_lowest_rtt_wins(void) {
+    printf("lowest round trip wins over the first answer\n");
+    Responder_t responders[] = {
+        {.stratum = 2, .network_delay_ms = 40},
+        {.stratum = 1, .processing_ms = 80, .clock_offset_us = 1500000},
+    };
+
+    bool accepted;
+    NtpResult_t result;
+    query(responders, 2, SNTP_TIMEOUT_MS, &accepted, &result);
+
+    CHECK(accepted, "no answer accepted");
+    CHECK(result.server == 1, "server %d accepted", result.server);
+    CHECK(result.answers == 2, "%d answers", result.answers);
+    CHECK(result.rtt_us < SLACK_MS * 1000, "rtt %lu us", (unsigned long) result.rtt_us);
+    CHECK(llabs(result.offset_us - 1500000) < SLACK_MS * 1000, "offset %lld us", (long long) result.offset_us);
+    CHECK(result.latency_us >= 80000 && result.latency_us < (80 + SLACK_MS) * 1000,
+          "latency %lu us", (unsigned long) result.latency_us);
+}
+
+// an answer later than the grace after the first valid one is not waited for
+static void test_grace_ends_the_race(void) {
+    printf("the race ends %d ms after the first valid answer\n", SNTP_GRACE_MS);
+    Responder_t responders[] = {
+        {.stratum = 2},
+        {.stratum = 1, .network_delay_ms = 600},
+    };
+
+    bool accepted;
+    NtpResult_t result;
+    const int64_t elapsed_ms = query(responders, 2, SNTP_TIMEOUT_MS, &accepted, &result);
+
+    CHECK(accepted, "no answer accepted");
+    CHECK(result.server == 0, "server %d accepted", result.server);
+    CHECK(result.answers == 1, "%d answers", result.answers);
+    CHECK(llabs(result.offset_us) < SLACK_MS * 1000, "offset %lld us", (long long) result.offset_us);
+    CHECK(elapsed_ms >= SNTP_GRACE_MS && elapsed_ms < SNTP_GRACE_MS + SLACK_MS * 4, "took %lld ms",
+          (long long) elapsed_ms);
+}
+
+// invalid answers are not even counted, they can neither win nor start the grace period
+static void test_invalid_replies_dropped(void) {
+    printf("foreign originate, stratum 0 and 16, unsynchronized leap are dropped\n");
+    Responder_t responders[] = {
+        {.stratum = 2, .foreign_originate = true},
+        {.stratum = 0},
+        {.stratum = 16},
+        {.stratum = 2, .leap = NTP_LEAP_UNSYNCED},
+    };
+
+    bool accepted;
+    NtpResult_t result;
+    query(responders, 4, 500, &accepted, &result);
+    CHECK(!accepted, "server %d accepted", result.server);
+    CHECK(result.answers == 0, "%d answers", result.answers);
+
+    for (int i = 0; i < 4; i++) {
+        CHECK(responders[i].requests == 1, "responder %d got %d requests", i, responders[i].requests);
+    }
+
+    // they come first and would win on round trip
+    printf("a slow valid answer behind the invalid ones is taken\n");
+    Responder_t mixed[] = {
+        {.stratum = 0},
+        {.stratum = 2, .leap = NTP_LEAP_UNSYNCED},
+        {.stratum = 3, .network_delay_ms = 50},
+        {.stratum = 2, .foreign_originate = true},
+    };
+
+    query(mixed, 4, SNTP_TIMEOUT_MS, &accepted, &result);
+    CHECK(accepted, "no answer accepted");
+    CHECK(result.server == 2, "server %d accepted", result.server);
+    CHECK(result.answers == 1, "%d answers", result.answers);
+}
+
+static void test_timeout_bound(void) {
+    printf("nothing valid: ntp_query gives up after %d ms\n", SNTP_TIMEOUT_MS);
+    Responder_t responders[] = {
+        {.silent = true},
+        {.stratum = 0},
+    };
+
+    bool accepted;
+    NtpResult_t result;
+    const int64_t elapsed_ms = query(responders, 2, SNTP_TIMEOUT_MS, &accepted, &result);
+
+    CHECK(!accepted, "server %d accepted", result.server);
+    CHECK(responders[0].requests == 1, "silent responder got %d requests", responders[0].requests);
+    CHECK(elapsed_ms >= SNTP_TIMEOUT_MS && elapsed_ms < SNTP_TIMEOUT_MS + SLACK_MS * 4, "took %lld ms",
+          (long long) elapsed_ms);
+}
+
+int main(void) {
+    test_lowest_rtt_wins();
+    test_grace_ends_the_race();
+    test_invalid_replies_dropped();
+    test_timeout_bound();
+
+    printf(failures ? "%d checks failed\n" : "all checks passed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,334 @@
+// upload_pending_records of uploadhandler/uploadhandler.c against a stand-in collector on 127.0.0.1.
+//
+// The journal is the real one on the RAM partition of simflash.c, the HTTP client is hosthttp.c.
+// The collector decodes every stamp frame, keeps each sequence once and answers with the newest
+// sequence up to which it has everything. It can lose the answer to a request (the connection is
+// closed after the frame was stored) or drop the connection after every answer.
+
+#include "sim.h"
+#include "uploadhandler.h"
+#include "stampframe.h"
+#include "timetracker_journal.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// the firmware values, wifisynchandler.c and uploadhandler.c
+#define UPLOAD_BUDGET_MS 2000
+#define UPLOAD_MAX_FRAMES_PER_WINDOW 8
+
+#define MAX_SEQUENCE 2048
+#define STAMP_BASE_TIME 1704700800 // 2024-01-08 08:00 UTC
+#define STAMP_INTERVAL_S 60
+
+// credentials.h of this test points UPLOAD_URL here
+char upload_test_url[64];
+
+typedef struct {
+    int lose_answer_of; // request of the window whose answer is lost, 1 based, 0 for none
+    bool close_after_answer;
+
+    int connections;
+    int requests;
+    int duplicates;
+    int bad_frames;
+    bool stored[MAX_SEQUENCE + 1];
+} Collector_t;
+
+static Collector_t collector;
+static int listen_sock;
+static pthread_t collector_thread;
+static volatile bool collector_stop;
+
+static int failures;
+
+#define CHECK(condition, ...) do { \
+    if (!(condition)) { \
+        failures++; \
+        printf("  FAIL %s:%d %s: ", __FILE__, __LINE__, #condition); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+    } \
+} while (0)
+
+static uint64_t get_varint(const uint8_t **pos) {
+    uint64_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        const uint8_t byte = *(*pos)++;
+        value |= (uint64_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+}
+
+static int64_t get_zigzag(const uint8_t **pos) {
+    const uint64_t value = get_varint(pos);
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+static uint32_t get_u32(const uint8_t *src) {
+    return src[0] | (uint32_t) src[1] << 8 | (uint32_t) src[2] << 16 | (uint32_t) src[3] << 24;
+}
+
+// every stamp of the test journal lies STAMP_INTERVAL_S behind the previous one
+static void store_frame(const uint8_t *frame, const size_t length) {
+    if (length < STAMP_FRAME_HEADER_SIZE + 4 || frame[0] != STAMP_FRAME_MAGIC_0 || frame[1] != STAMP_FRAME_MAGIC_1
+        || frame[2] != STAMP_FRAME_VERSION
+        || esp_rom_crc32_le(0, frame, (uint32_t) (length - 4)) != get_u32(frame + length - 4)) {
+        collector.bad_frames++;
+        return;
+    }
+
+    const uint8_t *pos = frame + STAMP_FRAME_HEADER_SIZE;
+    uint32_t sequence = get_u32(frame + 10);
+    int64_t time = 0;
+
+    for (int i = 0; i < frame[3]; i++) {
+        const uint8_t kind = *pos++;
+        sequence += (uint32_t) get_varint(&pos);
+        time += get_zigzag(&pos);
+
+        const bool expected_kind = (kind == STAMP_FRAME_START) == (sequence % 2 == 1);
+        if (sequence > MAX_SEQUENCE || !expected_kind || time != STAMP_BASE_TIME + sequence * STAMP_INTERVAL_S) {
+            collector.bad_frames++;
+            return;
+        }
+
+        if (collector.stored[sequence]) {
+            collector.duplicates++;
+        }
+        collector.stored[sequence] = true;
+    }
+}
+
+static uint32_t contiguous_sequence(void) {
+    uint32_t sequence = 0;
+    while (sequence < MAX_SEQUENCE && collector.stored[sequence + 1]) sequence++;
+    return sequence;
+}
+
+static bool receive(const int sock, char *buffer, const size_t length) {
+    for (size_t used = 0; used < length;) {
+        struct pollfd readable = {.fd = sock, .events = POLLIN};
+        if (poll(&readable, 1, 1000) <= 0) return false;
+        const ssize_t count = recv(sock, buffer + used, length - used, 0);
+        if (count <= 0) return false;
+        used += (size_t) count;
+    }
+    return true;
+}
+
+// one request, false once the connection is to be closed
+static bool serve_request(const int sock) {
+    char headers[1024];
+    size_t used = 0;
+    while (used < 4 || memcmp(headers + used - 4, "\r\n\r\n", 4) != 0) {
+        if (used == sizeof(headers) - 1 || !receive(sock, headers + used, 1)) return false;
+        used++;
+    }
+    headers[used] = '\0';
+
+    size_t length = 0;
+    for (const char *line = strstr(headers, "\r\n"); line; line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, "Content-Length:", 15) == 0) length = strtoul(line + 17, NULL, 10);
+    }
+    uint8_t frame[STAMP_FRAME_MAX_SIZE];
+    if (length > sizeof(frame) || !receive(sock, (char *) frame, length)) return false;
+
+    collector.requests++;
+    store_frame(frame, length);
+    if (collector.requests == collector.lose_answer_of) return false;
+
+    char body[16];
+    const int body_length = snprintf(body, sizeof(body), "%lu", (unsigned long) contiguous_sequence());
+    char response[128];
+    const int response_length = snprintf(response, sizeof(response),
+                                         "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n%s", body_length, body);
+    send(sock, response, (size_t) response_length, MSG_NOSIGNAL);
+    return !collector.close_after_answer;
+}
+
+static void *collector_main(void *arg) {
+    (void) arg;
+    while (!collector_stop) {
+        struct pollfd pending = {.fd = listen_sock, .events = POLLIN};
+        if (poll(&pending, 1, 20) <= 0) continue;
+
+        const int sock = accept(listen_sock, NULL, NULL);
+        if (sock < 0) continue;
+        collector.connections++;
+        while (serve_request(sock)) {
+        }
+        close(sock);
+    }
+    return NULL;
+}
+
+static void start_collector(void) {
+    listen_sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t length = sizeof(address);
+    if (listen_sock < 0 || bind(listen_sock, (struct sockaddr *) &address, sizeof(address)) != 0
+        || listen(listen_sock, 4) != 0 || getsockname(listen_sock, (struct sockaddr *) &address, &length) != 0) {
+        perror("collector socket");
+        exit(2);
+    }
+
+    snprintf(upload_test_url, sizeof(upload_test_url), "http://127.0.0.1:%u/stamps", ntohs(address.sin_port));
+    pthread_create(&collector_thread, NULL, collector_main, NULL);
+}
+
+static void stop_collector(void) {
+    collector_stop = true;
+    pthread_join(collector_thread, NULL);
+    close(listen_sock);
+}
+
+// the collector counts per window, what it stored stays
+static void start_window(const int lose_answer_of, const bool close_after_answer) {
+    collector.lose_answer_of = lose_answer_of;
+    collector.close_after_answer = close_after_answer;
+    collector.connections = 0;
+    collector.requests = 0;
+    collector.duplicates = 0;
+}
+
+// stamps alternate start and end, odd sequences start a session
+static void append_stamps(const int count) {
+    for (int i = 0; i < count; i++) {
+        const uint32_t sequence = journal_next_sequence();
+        journal_append_stamp(STAMP_BASE_TIME + sequence * STAMP_INTERVAL_S, sequence % 2 == 1, true);
+    }
+}
+
+static uint32_t stored_acked(void) {
+    nvs_handle_t handle;
+    uint32_t acked = 0;
+    if (nvs_open("upload", NVS_READONLY, &handle) == ESP_OK) {
+        nvs_get_u32(handle, "acked", &acked);
+        nvs_close(handle);
+    }
+    return acked;
+}
+
+static void check_window(const UploadStats_t *before, const uint32_t frames, const uint32_t acked,
+                         const uint32_t failures_added) {
+    UploadStats_t stats;
+    get_upload_stats(&stats);
+
+    CHECK(stats.frames - before->frames == frames, "%lu frames", (unsigned long) (stats.frames - before->frames));
+    CHECK(stats.acked_sequence == acked, "acked %lu", (unsigned long) stats.acked_sequence);
+    CHECK(stored_acked() == acked, "stored offset %lu", (unsigned long) stored_acked());
+    CHECK(stats.failures - before->failures == failures_added, "%lu failures",
+          (unsigned long) (stats.failures - before->failures));
+    CHECK(contiguous_sequence() == acked, "collector has everything up to %lu", (unsigned long) contiguous_sequence());
+    CHECK(collector.bad_frames == 0, "%d bad frames", collector.bad_frames);
+}
+
+static void test_one_connection_per_window(void) {
+    printf("150 records: 3 frames on one kept-alive connection\n");
+    append_stamps(150);
+    UploadStats_t before;
+    get_upload_stats(&before);
+    start_window(0, false);
+
+    upload_pending_records(UPLOAD_BUDGET_MS);
+
+    check_window(&before, 3, 150, 0);
+    CHECK(collector.connections == 1, "%d connections", collector.connections);
+    CHECK(collector.requests == 3, "%d requests", collector.requests);
+    CHECK(collector.duplicates == 0, "%d duplicates", collector.duplicates);
+
+    printf("nothing pending: no connection\n");
+    get_upload_stats(&before);
+    start_window(0, false);
+    upload_pending_records(UPLOAD_BUDGET_MS);
+    check_window(&before, 0, 150, 0);
+    CHECK(collector.connections == 0, "%d connections", collector.connections);
+}
+
+static void test_frames_per_window_bounded(void) {
+    printf("600 records: %d frames in the first window, the rest in the next\n", UPLOAD_MAX_FRAMES_PER_WINDOW);
+    append_stamps(600);
+    UploadStats_t before;
+    get_upload_stats(&before);
+    start_window(0, false);
+
+    upload_pending_records(UPLOAD_BUDGET_MS);
+    check_window(&before, UPLOAD_MAX_FRAMES_PER_WINDOW, 150 + UPLOAD_MAX_FRAMES_PER_WINDOW * STAMP_FRAME_MAX_ENTRIES, 0);
+    CHECK(collector.connections == 1, "%d connections", collector.connections);
+
+    get_upload_stats(&before);
+    start_window(0, false);
+    upload_pending_records(UPLOAD_BUDGET_MS);
+    check_window(&before, 2, 750, 0);
+    CHECK(collector.connections == 1, "%d connections", collector.connections);
+    CHECK(collector.duplicates == 0, "%d duplicates", collector.duplicates);
+}
+
+static void test_lost_answer_resumes(void) {
+    printf("lost answer to the first frame: the next window resends it, nothing is stored twice\n");
+    append_stamps(100);
+    UploadStats_t before;
+    get_upload_stats(&before);
+    start_window(1, false);
+
+    upload_pending_records(UPLOAD_BUDGET_MS);
+    UploadStats_t stats;
+    get_upload_stats(&stats);
+    CHECK(stats.failures - before.failures == 1, "%lu failures", (unsigned long) (stats.failures - before.failures));
+    CHECK(stats.acked_sequence == 750, "acked %lu", (unsigned long) stats.acked_sequence);
+    CHECK(collector.requests == 1, "%d requests", collector.requests);
+
+    get_upload_stats(&before);
+    start_window(0, false);
+    upload_pending_records(UPLOAD_BUDGET_MS);
+    check_window(&before, 2, 850, 0);
+    CHECK(collector.duplicates == STAMP_FRAME_MAX_ENTRIES, "%d duplicates", collector.duplicates);
+
+    printf("lost answer to a later frame: one retry on a new connection\n");
+    append_stamps(100);
+    get_upload_stats(&before);
+    start_window(2, false);
+    upload_pending_records(UPLOAD_BUDGET_MS);
+    check_window(&before, 2, 950, 0);
+    CHECK(collector.connections == 2, "%d connections", collector.connections);
+    CHECK(collector.duplicates == 100 - STAMP_FRAME_MAX_ENTRIES, "%d duplicates", collector.duplicates);
+}
+
+static void test_dropped_connection_reconnects(void) {
+    printf("collector closes after every answer: each frame reconnects once\n");
+    append_stamps(200);
+    UploadStats_t before;
+    get_upload_stats(&before);
+    start_window(0, true);
+
+    upload_pending_records(UPLOAD_BUDGET_MS);
+    check_window(&before, 4, 1150, 0);
+    CHECK(collector.connections == 4, "%d connections", collector.connections);
+    CHECK(collector.duplicates == 0, "%d duplicates", collector.duplicates);
+}
+
+int main(void) {
+    sim_flash_init(NULL);
+    if (init_journal() != ESP_OK) return 2;
+    start_collector();
+
+    test_one_connection_per_window();
+    test_frames_per_window_bounded();
+    test_lost_answer_resumes();
+    test_dropped_connection_reconnects();
+
+    stop_collector();
+    printf(failures ? "%d checks failed\n" : "all checks passed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,230 @@
+#!/usr/bin/env python3
+"""Host side of the UART journal export, see main/exporthandler/exporthandler.h.
+
+Queries a device (or reads a captured stream with --capture) and writes the records as CSV or JSON.
+Only the standard library is used, the port is configured with termios.
+
+  export_decoder.py /dev/ttyUSB0                    everything as CSV on stdout
+  export_decoder.py /dev/ttyUSB0 --since 120 --json records after sequence 120
+  export_decoder.py --capture dump.bin              decode a recorded device stream
+
+The sequence to pass as --since next time is printed to stderr. A stream with a damaged frame or
+without its end frame exits 1, the --since printed then resumes in front of the damage.
+"""
+
+import argparse
+import csv
+import datetime
+import json
+import os
+import struct
+import sys
+import termios
+import time
+import tty
+import zlib
+
+SYNC = b"\xA5\x5A"
+HEADER_SIZE = 5
+CRC_SIZE = 4
+FRAME_QUERY = 0x01
+FRAME_RECORDS = 0x81
+FRAME_END = 0x82
+RECORD = struct.Struct("<IBiI")
+# EXPORT_RECORDS_PER_FRAME records, no device frame is longer
+MAX_PAYLOAD = 32 * RECORD.size
+# read_frames reports skipped bytes as a frame of this type
+FRAME_DAMAGED = None
+WAKE = b"\x00" * 4
+WAKE_S = 0.02
+
+KIND_START = 0
+KIND_END = 1
+KIND_CORRECTION = 2
+KIND_UNSYNCED = 0x80
+
+FIELDS = ["sequence", "kind", "synced", "time", "iso_time", "offset", "first_sequence"]
+
+
+def encode_frame(frame_type, payload):
+    body = struct.pack("<BH", frame_type, len(payload)) + payload
+    return SYNC + body + struct.pack("<I", zlib.crc32(body))
+
+
+def read_frames(read, timeout):
+    """Yield (type, payload) of every intact frame, damaged bytes are skipped until the next sync.
+
+    Skipped bytes are reported once before the next intact frame as (FRAME_DAMAGED, b"").
+    A length above MAX_PAYLOAD is damage as well, waiting for that many bytes would swallow the
+    intact frames behind it.
+    """
+    buffer = b""
+    damaged = False
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        chunk = read()
+        if chunk:
+            buffer += chunk
+            deadline = time.monotonic() + timeout
+        elif chunk is None:
+            return
+
+        while True:
+            start = buffer.find(SYNC)
+            if start < 0:
+                keep = 1 if buffer.endswith(SYNC[:1]) else 0
+                damaged |= len(buffer) > keep
+                buffer = buffer[len(buffer) - keep:]
+                break
+            damaged |= start > 0
+            buffer = buffer[start:]
+            if len(buffer) < HEADER_SIZE:
+                break
+            frame_type, length = struct.unpack_from("<BH", buffer, 2)
+            if length > MAX_PAYLOAD:
+                damaged = True
+                buffer = buffer[1:]
+                continue
+            end = HEADER_SIZE + length + CRC_SIZE
+            if len(buffer) < end:
+                break
+            (crc,) = struct.unpack_from("<I", buffer, HEADER_SIZE + length)
+            if zlib.crc32(buffer[2:HEADER_SIZE + length]) != crc:
+                damaged = True
+                buffer = buffer[1:]
+                continue
+            if damaged:
+                damaged = False
+                yield FRAME_DAMAGED, b""
+            yield frame_type, buffer[HEADER_SIZE:HEADER_SIZE + length]
+            buffer = buffer[end:]
+
+
+def decode_record(data, offset):
+    sequence, kind, value, aux = RECORD.unpack_from(data, offset)
+    row = dict.fromkeys(FIELDS)
+    row["sequence"] = sequence
+    if kind == KIND_CORRECTION:
+        row["kind"] = "correction"
+        row["offset"] = value
+        row["first_sequence"] = aux
+        return row
+
+    timestamp = value & 0xFFFFFFFF
+    row["kind"] = "start" if kind & ~KIND_UNSYNCED == KIND_START else "end"
+    row["synced"] = not kind & KIND_UNSYNCED
+    row["time"] = timestamp
+    row["iso_time"] = datetime.datetime.fromtimestamp(timestamp, datetime.timezone.utc).isoformat()
+    return row
+
+
+def collect(frames, since):
+    """Return the rows, the --since to continue with and the problem of an incomplete stream.
+
+    The device sends the records in sequence order, so everything up to the last record in front
+    of the first damage arrived. That is the continuation of an incomplete stream, or since if the
+    damage came first (None for a capture, its since is not known).
+    """
+    rows = []
+    resume = since
+    damaged = False
+    for frame_type, payload in frames:
+        if frame_type == FRAME_DAMAGED:
+            damaged = True
+        elif frame_type == FRAME_RECORDS:
+            for offset in range(0, len(payload) - RECORD.size + 1, RECORD.size):
+                rows.append(decode_record(payload, offset))
+            if rows and not damaged:
+                resume = rows[-1]["sequence"]
+        elif frame_type == FRAME_END and len(payload) == 8:
+            next_since, count = struct.unpack("<II", payload)
+            if count == len(rows):
+                return rows, next_since, None
+            return rows, resume, f"device sent {count} records, decoded {len(rows)}"
+    return rows, resume, "no end frame received, the stream is incomplete"
+
+
+def open_port(path, baud):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    if os.isatty(fd):
+        tty.setraw(fd)
+        attributes = termios.tcgetattr(fd)
+        speed = getattr(termios, f"B{baud}")
+        attributes[4] = attributes[5] = speed
+        termios.tcsetattr(fd, termios.TCSANOW, attributes)
+    os.set_blocking(fd, False)
+    return fd
+
+
+def query_device(path, baud, since, timeout):
+    fd = open_port(path, baud)
+    try:
+        os.write(fd, WAKE)
+        time.sleep(WAKE_S)
+        os.write(fd, encode_frame(FRAME_QUERY, struct.pack("<I", since)))
+
+        def read():
+            try:
+                return os.read(fd, 4096)
+            except BlockingIOError:
+                time.sleep(0.005)
+                return b""
+
+        return collect(read_frames(read, timeout), since)
+    finally:
+        os.close(fd)
+
+
+def read_capture(path):
+    with open(path, "rb") as capture:
+        data = capture.read()
+    chunks = iter([data])
+    return collect(read_frames(lambda: next(chunks, None), timeout=1.0), None)
+
+
+def write_rows(rows, as_json, output):
+    if as_json:
+        json.dump(rows, output, indent=2)
+        output.write("\n")
+        return
+    writer = csv.DictWriter(output, fieldnames=FIELDS)
+    writer.writeheader()
+    writer.writerows(rows)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port", nargs="?", help="serial device or pty of the export UART")
+    parser.add_argument("--baud", type=int, default=921600)
+    parser.add_argument("--since", type=int, default=0, help="only records with a higher sequence")
+    parser.add_argument("--timeout", type=float, default=2.0, help="seconds without data before giving up")
+    parser.add_argument("--capture", help="decode a recorded device stream instead of querying")
+    parser.add_argument("--json", action="store_true", help="JSON instead of CSV")
+    parser.add_argument("--output", help="file instead of stdout")
+    args = parser.parse_args()
+
+    if args.capture:
+        rows, next_since, problem = read_capture(args.capture)
+    elif args.port:
+        rows, next_since, problem = query_device(args.port, args.baud, args.since, args.timeout)
+    else:
+        parser.error("a port or --capture is required")
+
+    if args.output:
+        with open(args.output, "w", newline="") as output:
+            write_rows(rows, args.json, output)
+    else:
+        write_rows(rows, args.json, sys.stdout)
+
+    if problem:
+        # the end frame's sequence would skip the missing records for good
+        print(problem, file=sys.stderr)
+        if next_since is not None:
+            print(f"resume with --since {next_since}", file=sys.stderr)
+        return 1
+    print(f"next --since {next_since}", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())